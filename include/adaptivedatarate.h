@@ -0,0 +1,40 @@
+#ifndef DATA_RATE_TESTER_ADAPTIVEDATARATE_H
+#define DATA_RATE_TESTER_ADAPTIVEDATARATE_H
+
+#include "Arduino.h"
+#include "lmic.h"
+#include "uplinkstore.h"
+
+/**
+ * Selects the data rate that tells the most about its success rate per second of airtime, until
+ * the success rate of each data rate is known well enough.
+ */
+class AdaptiveDataRate {
+
+private:
+
+  struct DataRateCounters {
+    uint32_t confirmed;
+    uint32_t acks;
+    float airtimeSeconds;
+  };
+
+  DataRateCounters counters[TESTED_DATA_RATES]{};
+  bool isEnabled{false};
+
+  float getHalfWidth(dr_t dr) const;
+  bool isConverged(dr_t dr) const;
+  void log(dr_t dr) const;
+
+public:
+  bool getEnabled() const;
+  void setEnabled(bool enabled);
+  bool isAllConverged(uint16_t candidates) const;
+  dr_t next(uint16_t candidates, uint8_t payloadSize) const;
+  void add(const UplinkRecord &record);
+  void dump() const;
+};
+
+extern AdaptiveDataRate adaptiveDataRate;
+
+#endif // DATA_RATE_TESTER_ADAPTIVEDATARATE_H
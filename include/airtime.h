@@ -0,0 +1,139 @@
+/**
+ * Compile-time LoRa airtime model, following the Semtech SX1276 datasheet and AN1200.13, and the
+ * EU868 duty cycle limits for the LMIC bands.
+ *
+ * All functions are constexpr, so the uplink airtime for each data rate is known at compile time.
+ * Airtime is calculated in microseconds, which is exact for 125, 250 and 500 kHz, and is rounded
+ * up when converting to LMIC ticks. Hence, a transmission that is scheduled using these values
+ * will never be earlier than what LMIC allows.
+ */
+#ifndef DATA_RATE_TESTER_AIRTIME_H
+#define DATA_RATE_TESTER_AIRTIME_H
+
+#include "lmic.h"
+
+namespace Airtime {
+
+// The LoRaWAN MHDR, FHDR without FOpts, FPort and MIC
+const uint8_t LORAWAN_OVERHEAD = 1 + 7 + 1 + 4;
+const uint8_t PREAMBLE_SYMBOLS = 8;
+// Coding rate 4/5
+const uint8_t CODING_RATE = 1;
+
+/**
+ * Symbol time in microseconds.
+ */
+constexpr uint32_t symbolMicros(uint8_t sf, uint16_t bandwidthKHz) {
+  return (1000UL << sf) / bandwidthKHz;
+}
+
+/**
+ * Low data rate optimization is mandatory when the symbol time exceeds 16 ms.
+ */
+constexpr bool isLowDataRateOptimized(uint8_t sf, uint16_t bandwidthKHz) {
+  return symbolMicros(sf, bandwidthKHz) > 16000;
+}
+
+constexpr uint32_t ceilDiv(int32_t numerator, int32_t denominator) {
+  return numerator > 0 ? (numerator + denominator - 1) / denominator : 0;
+}
+
+/**
+ * The number of payload symbols, including the header and the CRC, for a coding rate 4/(4 + cr).
+ */
+constexpr uint32_t payloadSymbols(uint8_t sf, uint16_t bandwidthKHz, uint8_t length, uint8_t cr,
+                                  bool crc, bool explicitHeader) {
+  return 8 + ceilDiv(8 * length - 4 * sf + 28 + (crc ? 16 : 0) - (explicitHeader ? 0 : 20),
+                     4 * (sf - (isLowDataRateOptimized(sf, bandwidthKHz) ? 2 : 0))) *
+                 (cr + 4);
+}
+
+/**
+ * Time on air in microseconds for the given PHY payload length, which for LoRaWAN includes the
+ * MHDR and MIC. The preamble adds 4.25 symbols to the configured preamble length.
+ */
+constexpr uint32_t loraMicros(uint8_t sf, uint16_t bandwidthKHz, uint8_t length,
+                              uint8_t cr = CODING_RATE, bool crc = true,
+                              bool explicitHeader = true,
+                              uint8_t preambleSymbols = PREAMBLE_SYMBOLS) {
+  return ((4 * preambleSymbols + 17) +
+          4 * payloadSymbols(sf, bandwidthKHz, length, cr, crc, explicitHeader)) *
+         symbolMicros(sf, bandwidthKHz) / 4;
+}
+
+/**
+ * Time on air in microseconds for an EU868 LoRa data rate, for an uplink which has a payload CRC,
+ * or for a downlink which does not.
+ */
+constexpr uint32_t dataRateMicros(dr_t dr, uint8_t length, bool crc = true) {
+  return dr == DR_SF7B ? loraMicros(7, 250, length, CODING_RATE, crc)
+                       : loraMicros(12 - dr, 125, length, CODING_RATE, crc);
+}
+
+/**
+ * Symbol time in microseconds for an EU868 LoRa data rate.
+ */
+constexpr uint32_t dataRateSymbolMicros(dr_t dr) {
+  return dr == DR_SF7B ? symbolMicros(7, 250) : symbolMicros(12 - dr, 125);
+}
+
+constexpr ostime_t microsToTicks(uint32_t micros) {
+  return (ostime_t)((micros + (1 << US_PER_OSTICK_EXPONENT) - 1) >> US_PER_OSTICK_EXPONENT);
+}
+
+/**
+ * Time on air in LMIC ticks for an uplink with the given PHY payload length, like LMIC.dataLen.
+ */
+constexpr ostime_t frameTicks(dr_t dr, uint8_t length) {
+  return microsToTicks(dataRateMicros(dr, length));
+}
+
+/**
+ * Time on air in LMIC ticks for an uplink with the given application payload length and no FOpts.
+ */
+constexpr ostime_t uplinkTicks(dr_t dr, uint8_t payloadLength) {
+  return frameTicks(dr, LORAWAN_OVERHEAD + payloadLength);
+}
+
+// The application payload size of the uplinks of this tester, unless a test plan sets another
+const uint8_t PAYLOAD_LENGTH = 1;
+
+// The maximum application payload size without FOpts, indexed by EU868 data rate DR_SF12 (DR0) thru
+// DR_SF7B (DR6), from the LoRaWAN Regional Parameters
+constexpr uint8_t MAX_PAYLOAD_LENGTH[] = {51, 51, 51, 115, 242, 242, 242};
+
+/**
+ * The maximum application payload size for the given data rate, which is also limited by the size
+ * of LMIC's frame buffer; see LMIC_MAX_FRAME_LENGTH in platformio.ini.
+ */
+constexpr uint8_t maxPayloadLength(dr_t dr) {
+  return MAX_PAYLOAD_LENGTH[dr] < MAX_LEN_PAYLOAD ? MAX_PAYLOAD_LENGTH[dr]
+                                                  : (uint8_t)MAX_LEN_PAYLOAD;
+}
+
+// Uplink airtime in LMIC ticks, indexed by EU868 data rate DR_SF12 (DR0) thru DR_SF7B (DR6)
+constexpr ostime_t UPLINK_TICKS[] = {
+    uplinkTicks(DR_SF12, PAYLOAD_LENGTH), uplinkTicks(DR_SF11, PAYLOAD_LENGTH),
+    uplinkTicks(DR_SF10, PAYLOAD_LENGTH), uplinkTicks(DR_SF9, PAYLOAD_LENGTH),
+    uplinkTicks(DR_SF8, PAYLOAD_LENGTH),  uplinkTicks(DR_SF7, PAYLOAD_LENGTH),
+    uplinkTicks(DR_SF7B, PAYLOAD_LENGTH)};
+
+// Sanity checks against the well-known values: 14 bytes on SF7 take 46.3 ms, on SF12 1155.1 ms
+static_assert(dataRateMicros(DR_SF7, 14) == 46336, "SF7 airtime");
+static_assert(dataRateMicros(DR_SF12, 14) == 1155072, "SF12 airtime");
+
+// The inverse of the maximum duty cycle for the LMIC EU868 bands BAND_MILLI (0.1%,
+// 868.7-869.2 MHz), BAND_CENTI (1%, 868.0-868.6 MHz), BAND_DECI (10%, 869.4-869.65 MHz) and
+// BAND_AUX (1%, used for 865-868 MHz in setupLMIC)
+constexpr uint16_t BAND_TXCAP[MAX_BANDS] = {1000, 100, 10, 100};
+
+/**
+ * The time a band is unavailable after a transmission, including the transmission itself.
+ */
+constexpr ostime_t bandOffTicks(uint8_t band, ostime_t airtime) {
+  return airtime * BAND_TXCAP[band];
+}
+
+} // namespace Airtime
+
+#endif // DATA_RATE_TESTER_AIRTIME_H
@@ -0,0 +1,36 @@
+#ifndef DATA_RATE_TESTER_BINARYLOG_H
+#define DATA_RATE_TESTER_BINARYLOG_H
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Encodes log lines as binary records, deferring the formatting to the host; see
+ * tools/decode_log.py. Each record starts with RECORD_MARKER, a record type, and the length of the
+ * payload that follows:
+ *
+ * - RECORD_FORMAT: the format ID and the format string, sent once, before the first record using it
+ * - RECORD_LOG: the format ID, the core, the LMIC ticks, millis() and the arguments, for
+ *   Logger::logf
+ * - RECORD_PRINT: the format ID and the arguments, for Logger::printf
+ *
+ * Integers are sent as varints, floating point numbers as 32 bits little-endian floats, and strings
+ * as a length byte followed by the characters.
+ */
+namespace BinaryLog {
+
+const uint8_t RECORD_MARKER = 0xB1;
+const uint8_t RECORD_FORMAT = 'F';
+const uint8_t RECORD_LOG = 'L';
+const uint8_t RECORD_PRINT = 'P';
+// The marker, type and length
+const uint8_t RECORD_HEADER_LENGTH = 3;
+
+size_t encodeLog(uint8_t *buffer, size_t size, const char *format, va_list args);
+size_t encodePrint(uint8_t *buffer, size_t size, const char *format, va_list args);
+size_t encodeFormatOnce(const uint8_t *record, uint8_t *buffer, size_t size);
+
+} // namespace BinaryLog
+
+#endif // DATA_RATE_TESTER_BINARYLOG_H
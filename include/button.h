@@ -0,0 +1,44 @@
+#ifndef DATA_RATE_TESTER_BUTTON_H
+#define DATA_RATE_TESTER_BUTTON_H
+
+#include "Arduino.h"
+
+typedef void (*ButtonHandler)();
+
+/**
+ * An active LOW button, classifying presses in a task of its own, like OneButton does when polled.
+ */
+class Button {
+
+private:
+  enum State { STATE_IDLE, STATE_PRESSED, STATE_RELEASED, STATE_LONG_PRESSED };
+
+  uint8_t pin{0};
+  TaskHandle_t taskHandle{nullptr};
+
+  ButtonHandler clickHandler{nullptr};
+  ButtonHandler doubleClickHandler{nullptr};
+  ButtonHandler longPressStopHandler{nullptr};
+
+  State state{STATE_IDLE};
+  bool isPressed{false};
+  // For STATE_PRESSED: whether this is the second press of a double click
+  bool isSecondPress{false};
+  uint32_t edgeMillis{0};
+  uint32_t pressedMillis{0};
+
+  static void onEdge(void *button);
+  [[noreturn]] static void task(void *button);
+  void handleEdge(bool pressed, uint32_t now);
+  void handleTimeout(uint32_t now);
+  TickType_t ticksUntilTimeout(uint32_t now) const;
+
+public:
+  void attachClick(ButtonHandler handler);
+  void attachDoubleClick(ButtonHandler handler);
+  void attachLongPressStop(ButtonHandler handler);
+  void begin(uint8_t buttonPin, BaseType_t core);
+  uint32_t getPressedMillis() const;
+};
+
+#endif // DATA_RATE_TESTER_BUTTON_H
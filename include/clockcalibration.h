@@ -0,0 +1,54 @@
+#ifndef DATA_RATE_TESTER_CLOCKCALIBRATION_H
+#define DATA_RATE_TESTER_CLOCKCALIBRATION_H
+
+#include "Arduino.h"
+#include "lmic.h"
+
+// The clock error to use for a data rate until any data rate has been calibrated: 5% of the
+// maximum error, which was found by trial and error to make RX1 work for SF7
+const u2_t UNCALIBRATED_CLOCK_ERROR = MAX_CLOCK_ERROR * 5 / 100;
+
+/**
+ * Calibrates the LMIC clock error per data rate, to open the receive windows just early enough.
+ */
+class ClockCalibration {
+
+private:
+  // EU868 DR_SF12 (DR0) thru DR_SF7B (DR6)
+  static const uint8_t DATA_RATES = DR_SF7B + 1;
+  // The number of recent transmissions to base the clock error on, and the minimum number needed
+  static const uint8_t SAMPLES = 16;
+  static const uint8_t MIN_SAMPLES = 4;
+
+  // How late LMIC detected the end of the most recent transmissions, per data rate
+  ostime_t lateness[DATA_RATES][SAMPLES]{};
+  uint8_t sampleCount[DATA_RATES]{};
+  uint8_t nextSample[DATA_RATES]{};
+  u2_t clockErrors[DATA_RATES]{};
+  // The lateness the clock errors allow for, per data rate
+  ostime_t expectedLateness[DATA_RATES]{};
+  // On top of the clock errors, for the estimated offset of the crystals
+  u2_t crystalDrift{0};
+
+  // The current transmission
+  dr_t txDataRate{DR_SF7};
+  ostime_t txStart{0};
+  ostime_t txAirtime{0};
+  // The end of the current transmission as signalled by DIO0, if known
+  ostime_t txEnd{0};
+  bool hasTxEnd{false};
+
+  u2_t requiredClockError(dr_t rxDataRate, ostime_t delay, ostime_t latenessTicks) const;
+
+public:
+  void startTx(dr_t dr, ostime_t airtime);
+  void setTxEnd(ostime_t end);
+  void addRx1Window(ostime_t lmicTxEnd, ostime_t rxTime);
+  void setCrystalOffset(float ppm);
+  u2_t getClockError(dr_t dr) const;
+  void reset();
+};
+
+extern ClockCalibration clockCalibration;
+
+#endif // DATA_RATE_TESTER_CLOCKCALIBRATION_H
@@ -0,0 +1,13 @@
+#ifndef DATA_RATE_TESTER_CPUSTATS_H
+#define DATA_RATE_TESTER_CPUSTATS_H
+
+#include "Arduino.h"
+
+class CpuStats {
+
+public:
+  static void begin();
+  static void getIdlePercentages(float (&percentages)[portNUM_PROCESSORS]);
+};
+
+#endif // DATA_RATE_TESTER_CPUSTATS_H
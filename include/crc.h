@@ -0,0 +1,20 @@
+#ifndef DATA_RATE_TESTER_CRC_H
+#define DATA_RATE_TESTER_CRC_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Checksums for the binary data the tester writes to and reads from the serial port.
+ */
+namespace Crc {
+
+// The initial value of crc16, to be continued for each block of data
+const uint16_t CRC16_INIT = 0xFFFF;
+
+uint16_t crc16(uint16_t crc, const uint8_t *data, size_t length);
+uint32_t crc32(uint32_t crc, const uint8_t *data, size_t length);
+
+} // namespace Crc
+
+#endif // DATA_RATE_TESTER_CRC_H
@@ -1,22 +1,119 @@
 #ifndef DATA_RATE_TESTER_DISPLAY_H
 #define DATA_RATE_TESTER_DISPLAY_H
 
+#include <atomic>
 #include "Wire.h"
 #include "SSD1306Wire.h"
+#include "fixedstring.h"
+#include "linkstats.h"
 
 enum State { STATE_WAITING, STATE_TX, STATE_RX1, STATE_RX2, STATE_RXDONE, STATE_NOP };
 
+// 128 x 64 pixels, one bit per pixel
+static const uint16_t DISPLAY_BUFFER_SIZE = 128 * 64 / 8;
+
+// More characters than fit on a single line of the display
+static const uint8_t DISPLAY_TEXT_LENGTH = 40;
+
+typedef FixedString<DISPLAY_TEXT_LENGTH> DisplayText;
+
+// Returned by Display::tick if nothing changes until the state or page changes
+static const uint32_t DISPLAY_IDLE = UINT32_MAX;
+
+// The main page, followed by the statistics pages
+enum Page { PAGE_MAIN, PAGE_DATA_RATES, PAGE_CHANNELS, PAGE_RSSI, PAGE_SNR, PAGE_COUNT };
+
+/**
+ * A range of SSD1306 pages, each 8 rows high, and columns.
+ */
+struct Area {
+  uint8_t firstColumn;
+  uint8_t lastColumn;
+  uint8_t firstPage;
+  uint8_t lastPage;
+};
+
+/**
+ * SSD1306Wire that can also transfer a part of a frame, rather than the full 1 KB frame.
+ */
+class PartialSSD1306Wire : public SSD1306Wire {
+
+private:
+  uint8_t address;
+
+  void sendPartialCommand(uint8_t command);
+
+public:
+  PartialSSD1306Wire(uint8_t address, uint8_t sda, uint8_t scl);
+
+  uint8_t *getBuffer() {
+    return buffer;
+  }
+
+  void drawText(int16_t x, int16_t y, DisplayText &text);
+
+  void displayArea(const uint8_t *frame, const Area &area);
+};
+
+/**
+ * A part of the display that is only redrawn and transferred if its contents changed.
+ */
+struct Region {
+  int16_t y;
+  uint8_t height;
+  // What was drawn last, and its leftmost and rightmost columns
+  DisplayText text;
+  uint8_t progress;
+  int16_t left;
+  int16_t right;
+  // The columns that changed since the last transfer, if pendingLeft <= pendingRight
+  int16_t pendingLeft;
+  int16_t pendingRight;
+};
+
 class Display {
 
 private:
-  SSD1306Wire oled;
+  PartialSSD1306Wire oled;
+
+  Region headerRegion{0, 26, {}, 0, 0, -1, 0, -1};
+  Region labelRegion{26, 13, {}, 0, 0, -1, 0, -1};
+  Region progressRegion{40, 7, {}, 0, 0, -1, 0, -1};
+  Region rxDetailsRegion{52, 12, {}, 0, 0, -1, 0, -1};
+  // The full screen, for the statistics pages, and when returning to the main page
+  Region pageRegion{0, 64, {}, 0, 0, -1, 0, -1};
+  Region *const regions[5]{&headerRegion, &labelRegion, &progressRegion, &rxDetailsRegion,
+                           &pageRegion};
+  bool isFullRefreshNeeded{true};
+  // Set when returning to the main page, to redraw all of its regions
+  bool isRedrawNeeded{false};
+
+  // Selected by the button, on the LMIC core
+  std::atomic<uint8_t> page{PAGE_MAIN};
+  uint8_t shownPage{PAGE_MAIN};
+  uint32_t shownStatsVersion{0};
+
+  // While the transfer task sends the areas of the front buffer over I2C, the next frame is drawn
+  // into the library's buffer
+  uint8_t frontBuffer[DISPLAY_BUFFER_SIZE]{};
+  Area transferAreas[5]{};
+  uint8_t transferCount{0};
+  std::atomic<bool> isTransferring{false};
+  // Set when areas are kept pending while transferring
+  std::atomic<bool> isFramePending{false};
+  TaskHandle_t transferTaskHandle{nullptr};
+  TaskHandle_t tickTaskHandle{nullptr};
 
   bool isConfirmedUplink{false};
   bool isFixedDataRate{false};
-  String lastRxDetails;
+  DisplayText lastRxDetails;
   uint32_t fcnt{0};
   uint32_t freq{0};
   uint8_t sf{7};
+  // The Fair Access Policy budget that is left, if enabled
+  bool hasBudget{false};
+  uint32_t airtimeLeftMs{0};
+  uint8_t downlinksLeft{0};
 
   State state{STATE_NOP};
   uint32_t progressStartTime{0};
@@ -24,19 +121,34 @@ private:
 
   void startWait(State state, uint32_t targetTimeMs);
   void showSplash();
+  void updateText(Region &region, const uint8_t *font, const DisplayText &text);
+  void updateProgressBar(uint8_t progress);
+  void queueTransfer(Region &region, int16_t left, int16_t right);
+  void submitFrame();
+  bool updateStatsPage();
+  void drawStatsRow(int16_t y, const char *name, const LinkCounters &counters);
+  void drawDataRatesPage();
+  void drawChannelsPage();
+  void drawHistogramPage(const char *title, const uint32_t *histogram, uint8_t bins);
+  [[noreturn]] static void transferTask(void *pvParameters);
 
 public:
   Display();
 
   void init();
-  void tick();
+  uint32_t tick();
+
+  void showNextPage();
+  void showMainPage();
+  bool isShowingStats() const;
 
   void setIsConfirmedUplink(bool isConfirmed);
   void setIsFixedDataRate(bool isFixed);
-  void setRxDetails(const String &rxDetails);
+  void setRxDetails(const char *rxDetails);
   void setTxCount(uint32_t fCntUp);
   void setTxFreq(uint32_t txFreq);
   void setTxSpreadingFactor(uint8_t spreadingFactor);
+  void setBudget(bool hasBudget, uint32_t airtimeLeftMs, uint8_t downlinksLeft);
 
   void startWaitTx(uint32_t targetTimeMs);
   void startTx();
@@ -0,0 +1,37 @@
+#ifndef DATA_RATE_TESTER_DUTYCYCLE_H
+#define DATA_RATE_TESTER_DUTYCYCLE_H
+
+#include "Arduino.h"
+#include "lmic.h"
+
+struct TxSlot {
+  // The earliest time the transmission is allowed
+  ostime_t time;
+  // The channel LMIC will select for the transmission
+  uint8_t channel;
+};
+
+class DutyCycle {
+
+private:
+  // Like LMIC.bands[].avail: when each band becomes available again
+  ostime_t bandAvail[MAX_BANDS]{};
+  // Like LMIC.bands[].lastchnl: the last channel used in each band, to cycle through its channels
+  uint8_t lastChannel[MAX_BANDS]{};
+  bool isBandUsed[MAX_BANDS]{};
+
+  uint32_t uplinkCount{0};
+  uint32_t firstTxMillis{0};
+
+  ostime_t availableAt(uint8_t band, ostime_t now);
+  bool findChannel(uint8_t band, dr_t dr, uint8_t &channel) const;
+
+public:
+  void registerTx(uint8_t channel, ostime_t txBegin, ostime_t airtime);
+  TxSlot nextTx(dr_t dr, ostime_t now);
+  float getUplinksPerHour() const;
+};
+
+extern DutyCycle dutyCycle;
+
+#endif // DATA_RATE_TESTER_DUTYCYCLE_H
@@ -0,0 +1,64 @@
+#ifndef DATA_RATE_TESTER_FAIRACCESS_H
+#define DATA_RATE_TESTER_FAIRACCESS_H
+
+#include "Arduino.h"
+#include "lmic.h"
+#include "uplinkstore.h"
+
+// The Things Network's Fair Access Policy: the uplink airtime and the number of downlinks per 24
+// hours
+const uint32_t FAIR_ACCESS_AIRTIME_MS = 30000;
+const uint8_t FAIR_ACCESS_DOWNLINKS = 10;
+
+/**
+ * A token bucket, refilled continuously up to its capacity.
+ */
+struct TokenBucket {
+  float capacity;
+  // Tokens per millisecond
+  float rate;
+  float tokens;
+};
+
+/**
+ * Paces the uplinks and confirmations to stay within the Fair Access Policy in any 24 hours.
+ */
+class FairAccess {
+
+private:
+  static const uint8_t HOURS = 24;
+
+  TokenBucket airtime;
+  TokenBucket downlinks;
+  uint32_t updateMillis{0};
+
+  // The airtime and downlinks per hour of the last 24 hours, for the display and logging
+  uint32_t airtimeBins[HOURS]{};
+  // An hour of confirmed SF7 uplinks may get more than 255 downlinks
+  uint16_t downlinkBins[HOURS]{};
+  uint32_t binHour{0};
+
+  // Since enabled: the data rates used, and the confirmed uplinks per data rate
+  uint8_t usedDataRates{0};
+  uint32_t confirmed[TESTED_DATA_RATES]{};
+
+  bool isEnabled{false};
+
+  void update();
+
+public:
+  FairAccess();
+  bool getEnabled() const;
+  void setEnabled(bool enabled);
+  uint32_t getDelayMillis(dr_t dr, uint8_t length, bool needsDownlink);
+  bool takeDownlink(dr_t dr, bool isSelected);
+  void registerTx(dr_t dr, uint8_t length);
+  void registerDownlink();
+  uint32_t getAirtimeLeftMillis() const;
+  uint8_t getDownlinksLeft() const;
+  void log();
+};
+
+extern FairAccess fairAccess;
+
+#endif // DATA_RATE_TESTER_FAIRACCESS_H
@@ -0,0 +1,112 @@
+#ifndef DATA_RATE_TESTER_FIXEDSTRING_H
+#define DATA_RATE_TESTER_FIXEDSTRING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * A string with a fixed capacity, to format text on the stack rather than on the heap. Text that
+ * does not fit is silently truncated.
+ */
+template <size_t N> class FixedString {
+
+private:
+  char text[N + 1]{};
+  size_t textLength{0};
+
+public:
+  const char *c_str() const {
+    return text;
+  }
+
+  /**
+   * The text as a mutable buffer, for APIs like OLEDDisplay::drawStringInternal that do not take a
+   * pointer to const.
+   */
+  char *data() {
+    return text;
+  }
+
+  size_t length() const {
+    return textLength;
+  }
+
+  void clear() {
+    textLength = 0;
+    text[0] = '\0';
+  }
+
+  bool operator==(const char *other) const {
+    return strcmp(text, other) == 0;
+  }
+
+  FixedString &append(char c) {
+    if (textLength < N) {
+      text[textLength++] = c;
+      text[textLength] = '\0';
+    }
+    return *this;
+  }
+
+  FixedString &append(const char *s) {
+    while (*s && textLength < N) {
+      text[textLength++] = *s++;
+    }
+    text[textLength] = '\0';
+    return *this;
+  }
+
+  FixedString &appendNumber(uint32_t value) {
+    // 4294967295 has 10 digits
+    char digits[10];
+    uint8_t count = 0;
+    do {
+      digits[count++] = '0' + value % 10;
+      value /= 10;
+    } while (value);
+    while (count) {
+      append(digits[--count]);
+    }
+    return *this;
+  }
+
+  /**
+   * Append a fixed-point number, like 49 with 1 decimal as "4.9", or -5 with 2 decimals as
+   * "-0.05".
+   */
+  FixedString &appendFixed(int32_t scaled, uint8_t decimals) {
+    if (scaled < 0) {
+      append('-');
+    }
+    uint32_t value = scaled < 0 ? -(uint32_t)scaled : scaled;
+    uint32_t divisor = 1;
+    for (uint8_t i = 0; i < decimals; i++) {
+      divisor *= 10;
+    }
+    appendNumber(value / divisor);
+    if (decimals) {
+      append('.');
+      uint32_t fraction = value % divisor;
+      while (divisor /= 10) {
+        append((char)('0' + fraction / divisor % 10));
+      }
+    }
+    return *this;
+  }
+
+  /**
+   * Append the bytes as lowercase hexadecimal, two characters per byte.
+   */
+  FixedString &appendHex(const uint8_t *bytes, size_t count) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    for (size_t i = 0; i < count && textLength + 2 <= N; i++) {
+      text[textLength++] = HEX_DIGITS[bytes[i] >> 4];
+      text[textLength++] = HEX_DIGITS[bytes[i] & 0x0F];
+    }
+    text[textLength] = '\0';
+    return *this;
+  }
+};
+
+#endif // DATA_RATE_TESTER_FIXEDSTRING_H
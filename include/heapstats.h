@@ -0,0 +1,12 @@
+#ifndef DATA_RATE_TESTER_HEAPSTATS_H
+#define DATA_RATE_TESTER_HEAPSTATS_H
+
+#include <cstdint>
+
+class HeapStats {
+
+public:
+  static uint32_t getAllocationCount();
+};
+
+#endif // DATA_RATE_TESTER_HEAPSTATS_H
@@ -0,0 +1,27 @@
+#ifndef DATA_RATE_TESTER_IDLELOOP_H
+#define DATA_RATE_TESTER_IDLELOOP_H
+
+#include "Arduino.h"
+
+/**
+ * Lets the task running loop() sleep while LMIC has nothing to do.
+ */
+class IdleLoop {
+
+private:
+  bool isEnabled{true};
+  uint32_t sleepCount{0};
+
+public:
+  void begin();
+  void setEnabled(bool enabled);
+  bool getEnabled() const;
+  void sleep();
+  void wake();
+  void wakeFromIsr();
+  uint32_t getSleepCount() const;
+};
+
+extern IdleLoop idleLoop;
+
+#endif // DATA_RATE_TESTER_IDLELOOP_H
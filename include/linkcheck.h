@@ -0,0 +1,35 @@
+#ifndef DATA_RATE_TESTER_LINKCHECK_H
+#define DATA_RATE_TESTER_LINKCHECK_H
+
+#include "Arduino.h"
+#include "lmic.h"
+
+/**
+ * The LoRaWAN LinkCheckReq and LinkCheckAns MAC commands, which MCCI LMIC 3.2.0 neither sends nor
+ * reports.
+ */
+namespace LinkCheck {
+
+// The CID of both LinkCheckReq and LinkCheckAns
+const uint8_t CID = 0x02;
+// LinkCheckReq has no payload; LinkCheckAns holds the margin and the gateway count
+const uint8_t REQUEST_LENGTH = 1;
+const uint8_t ANSWER_LENGTH = 3;
+
+/**
+ * The answer of the network to a LinkCheckReq.
+ */
+struct Answer {
+  // The demodulation margin of the best gateway in dB, 0 thru 254, being the SNR above the SNR that
+  // the data rate of the uplink needs
+  uint8_t margin;
+  // The number of gateways that received the uplink
+  uint8_t gateways;
+};
+
+bool parseCommands(const uint8_t *commands, uint8_t length, Answer &answer);
+bool getAnswer(Answer &answer);
+
+} // namespace LinkCheck
+
+#endif // DATA_RATE_TESTER_LINKCHECK_H
@@ -0,0 +1,80 @@
+#ifndef DATA_RATE_TESTER_LINKSTATS_H
+#define DATA_RATE_TESTER_LINKSTATS_H
+
+#include <atomic>
+#include "lmic.h"
+#include "fixedstring.h"
+#include "uplinkstore.h"
+
+// EU868 DR_SF12 (DR0) thru DR_SF7B (DR6)
+const uint8_t STATS_DATA_RATES = DR_SF7B + 1;
+
+// Downlink RSSI histogram: 5 dB bins from -140 dBm; values outside go into the first or last bin
+const int16_t RSSI_HISTOGRAM_MIN = -140;
+const uint8_t RSSI_HISTOGRAM_BIN = 5;
+const uint8_t RSSI_HISTOGRAM_BINS = 20;
+
+// Downlink SNR histogram: 2 dB bins from -24 dB
+const int16_t SNR_HISTOGRAM_MIN = -24;
+const uint8_t SNR_HISTOGRAM_BIN = 2;
+const uint8_t SNR_HISTOGRAM_BINS = 20;
+
+struct LinkCounters {
+  uint32_t uplinks;
+  uint32_t confirmed;
+  uint32_t acks;
+  // Confirmed uplinks without an ACK
+  uint32_t misses;
+  uint32_t rx1;
+  uint32_t rx2;
+  // For all downlinks; SNR in 0.25 dB
+  int32_t rssiSum;
+  int32_t snrSum;
+  int8_t rssiMin;
+  int8_t rssiMax;
+  int8_t snrMin;
+  int8_t snrMax;
+  uint32_t rssiHistogram[RSSI_HISTOGRAM_BINS];
+  uint32_t snrHistogram[SNR_HISTOGRAM_BINS];
+  // Uplinks with a LinkCheckReq, and the margin in dB and gateway count of their answers
+  uint32_t linkChecks;
+  uint32_t linkAnswers;
+  uint32_t marginSum;
+  uint8_t marginMin;
+  uint8_t marginMax;
+  uint32_t gatewaySum;
+
+  uint32_t getDownlinks() const {
+    return rx1 + rx2;
+  }
+};
+
+/**
+ * Link statistics per data rate, per channel and in total, updated in constant time per uplink.
+ */
+class LinkStats {
+
+private:
+  LinkCounters total{};
+  LinkCounters dataRates[STATS_DATA_RATES]{};
+  LinkCounters channels[MAX_CHANNELS]{};
+  // Odd while being updated
+  std::atomic<uint32_t> sequence{0};
+
+  void read(const LinkCounters &counters, LinkCounters &copy) const;
+
+public:
+  // The number of parts of the dump: the total, each data rate, and each channel
+  static const uint8_t DUMP_PARTS = 1 + STATS_DATA_RATES + MAX_CHANNELS;
+
+  void add(const UplinkRecord &record);
+  uint32_t getVersion() const;
+  void getTotal(LinkCounters &copy) const;
+  void getDataRate(dr_t dr, LinkCounters &copy) const;
+  void getChannel(uint8_t channel, LinkCounters &copy) const;
+  bool dump(uint8_t part) const;
+};
+
+extern LinkStats linkStats;
+
+#endif // DATA_RATE_TESTER_LINKSTATS_H
@@ -9,6 +9,10 @@ class Logger {
 
 public:
   Logger();
+  static void startDrainTask(BaseType_t core);
+  static uint32_t getDroppedCount();
+  static void beginRawOutput();
+  static void endRawOutput();
   static void log(const char *text);
   static void logf(const char *format, ...);
   static void println(const char *text);
@@ -0,0 +1,56 @@
+#ifndef DATA_RATE_TESTER_PAYLOADSWEEP_H
+#define DATA_RATE_TESTER_PAYLOADSWEEP_H
+
+#include "Arduino.h"
+#include "lmic.h"
+#include "uplinkstore.h"
+
+// The header at the start of each uplink's application payload, as far as it fits: the SF as BCD,
+// the payload length, and the 16 least significant bits of the uplink counter, little-endian
+const uint8_t PAYLOAD_HEADER_LENGTH = 4;
+
+/**
+ * Steps the payload size for each data rate, and measures the goodput per data rate and size.
+ */
+class PayloadSweep {
+
+private:
+  // PAYLOAD_HEADER_LENGTH, doubling up to but excluding the maximum size, and the maximum size
+  static const uint8_t MAX_SIZES = 8;
+
+  struct SweepCounters {
+    uint32_t uplinks;
+    uint32_t confirmed;
+    uint32_t acks;
+  };
+
+  uint8_t sizes[TESTED_DATA_RATES][MAX_SIZES]{};
+  uint8_t sizeCount[TESTED_DATA_RATES]{};
+  SweepCounters counters[TESTED_DATA_RATES][MAX_SIZES]{};
+
+  bool isEnabled{false};
+  // The data rate and size index of the most recent uplink, if isStarted
+  dr_t dataRate{DR_SF7};
+  uint8_t sizeIdx{0};
+  bool isStarted{false};
+
+  bool findSize(dr_t dr, uint8_t size, uint8_t &index) const;
+  void logGoodput(dr_t dr, uint8_t index) const;
+
+public:
+  static const uint8_t DUMP_PARTS = TESTED_DATA_RATES * MAX_SIZES;
+
+  PayloadSweep();
+  bool getEnabled() const;
+  void setEnabled(bool enabled);
+  void restart();
+  void next(uint8_t &dr, uint8_t &payloadSize);
+  void add(const UplinkRecord &record);
+  bool dump(uint8_t part) const;
+
+  static void fillPayload(uint8_t *data, uint8_t length, uint8_t sf, uint32_t seqnoUp);
+};
+
+extern PayloadSweep payloadSweep;
+
+#endif // DATA_RATE_TESTER_PAYLOADSWEEP_H
@@ -0,0 +1,30 @@
+#ifndef DATA_RATE_TESTER_RADIOMETRICS_H
+#define DATA_RATE_TESTER_RADIOMETRICS_H
+
+#include "Arduino.h"
+#include "lmic.h"
+
+/**
+ * Reads the frequency error, RSSI and SNR of each downlink from the radio, and estimates how far
+ * off the radio's crystal is.
+ */
+class RadioMetrics {
+
+private:
+  // The number of recent downlinks to base the crystal offset on, and the minimum number needed
+  static const uint8_t SAMPLES = 16;
+  static const uint8_t MIN_SAMPLES = 4;
+
+  float offsets[SAMPLES]{};
+  uint8_t sampleCount{0};
+  uint8_t nextSample{0};
+
+public:
+  void addDownlink(u4_t freq, dr_t dr);
+  bool hasCrystalOffset() const;
+  float getCrystalOffsetPpm() const;
+};
+
+extern RadioMetrics radioMetrics;
+
+#endif // DATA_RATE_TESTER_RADIOMETRICS_H
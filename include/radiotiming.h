@@ -0,0 +1,113 @@
+#ifndef DATA_RATE_TESTER_RADIOTIMING_H
+#define DATA_RATE_TESTER_RADIOTIMING_H
+
+#include <atomic>
+#include "lmic.h"
+#include "hal/hal.h"
+#include "uplinkstore.h"
+
+// Timing histograms in microseconds: bin 0 for less than 1 us, bin i for 2^(i-1) up to 2^i us, and
+// the last bin for anything larger
+const uint8_t TIMING_HISTOGRAM_BINS = 18;
+
+struct TimingHistogram {
+  uint32_t count;
+  int32_t minUs;
+  int32_t maxUs;
+  int64_t sumUs;
+  uint32_t bins[TIMING_HISTOGRAM_BINS];
+
+  void add(int32_t us);
+};
+
+/**
+ * Running estimates of the 5th, 50th and 95th percentile of timings in microseconds, in constant
+ * memory and constant time per value; see radiotiming.cpp.
+ */
+struct RunningPercentiles {
+  static const uint8_t PERCENTILES = 3;
+  // The minimum, the percentiles, the maximum, and the midpoints in between
+  static const uint8_t MARKERS = 2 * PERCENTILES + 3;
+
+  uint32_t count;
+  float heights[MARKERS];
+  int32_t positions[MARKERS];
+
+  void add(int32_t us);
+  int32_t get(uint8_t percentile) const;
+
+private:
+  float parabolic(uint8_t i, int8_t d) const;
+};
+
+/**
+ * Captures the radio's DIO edges in interrupt handlers, and keeps histograms of how late LMIC
+ * detects the end of a transmission, opens the receive windows, and runs the job that transmits.
+ * For each downlink, keeps percentiles of the round trip and the timing of the receive window, per
+ * data rate and receive window.
+ */
+class RadioTiming {
+
+private:
+  static const uint8_t DIO_COUNT = 3;
+  static const uint8_t RX_WINDOWS = 2;
+
+  // Set by the interrupt handlers
+  std::atomic<uint32_t> dioMicros[DIO_COUNT]{};
+  std::atomic<uint32_t> dioCounts[DIO_COUNT]{};
+
+  // The DIO0 edge count at the start of the current transmission
+  uint32_t txDio0Count{0};
+  // Only while set, hal_waitUntil is waiting for a receive window rather than, like when resetting
+  // the radio in os_init, for something else
+  bool isTxPending{false};
+  uint8_t rxWindowCount{0};
+  // For the current uplink; negative if not measured
+  int32_t txEndLatencyUs{-1};
+  int32_t rxOpenErrorsUs[RX_WINDOWS]{-1, -1};
+  int32_t sendLagUs{-1};
+  // The events of the current uplink in micros(); the downlink's receive window if any, or 0
+  dr_t txDr{0};
+  uint32_t txStartMicros{0};
+  uint32_t txEndMicros{0};
+  uint32_t rxOpenMicros[RX_WINDOWS]{};
+  uint32_t rxDoneMicros{0};
+  uint32_t downlinkMicros{0};
+  uint8_t downlinkWindow{0};
+
+  TimingHistogram txEndLatency{};
+  TimingHistogram rxOpenErrors[RX_WINDOWS]{};
+  TimingHistogram sendLag{};
+
+  // Per data rate of the uplink and receive window of the downlink: from the start of the
+  // transmission until the end of the downlink, how much later than nominal the downlink started
+  // after the end of the transmission, and how much earlier the receive window opened
+  RunningPercentiles roundTrips[TESTED_DATA_RATES][RX_WINDOWS]{};
+  RunningPercentiles downlinkLateness[TESTED_DATA_RATES][RX_WINDOWS]{};
+  RunningPercentiles rxSlacks[TESTED_DATA_RATES][RX_WINDOWS]{};
+
+  static void onDio0(void *timing);
+  static void onDio1(void *timing);
+  static void onDio2(void *timing);
+  void captureDio(uint8_t dio);
+  void dumpDownlinks(dr_t dr, uint8_t window) const;
+
+public:
+  // The number of parts of the dump: TX end, RX1, RX2, the send job, and the downlinks of each data
+  // rate and receive window
+  static const uint8_t DUMP_PARTS = 2 + RX_WINDOWS + TESTED_DATA_RATES * RX_WINDOWS;
+
+  void begin(const lmic_pinmap &pins);
+  void startTx(dr_t dr);
+  void endTx();
+  bool addTxEnd(ostime_t lmicTxEnd, ostime_t &txEnd);
+  void addRxOpen(ostime_t lateness);
+  void addDownlink(uint8_t window, dr_t dr, uint8_t length, ostime_t lmicRxTime);
+  void addSendLag(ostime_t lag);
+  void logUplink() const;
+  bool dump(uint8_t part) const;
+};
+
+extern RadioTiming radioTiming;
+
+#endif // DATA_RATE_TESTER_RADIOTIMING_H
@@ -0,0 +1,90 @@
+#ifndef DATA_RATE_TESTER_SERIALPROTOCOL_H
+#define DATA_RATE_TESTER_SERIALPROTOCOL_H
+
+#include "Arduino.h"
+
+// The first byte of each frame in either direction, which never occurs in the text log
+const uint8_t FRAME_START = 0xA5;
+const uint8_t MAX_FRAME_PAYLOAD = 32;
+
+enum FrameType : uint8_t {
+  // Commands from the host; see serialprotocol.cpp for their payloads
+  FRAME_SET_DATA_RATES = 0x01,
+  FRAME_SET_CONFIRMED = 0x02,
+  FRAME_SET_PAYLOAD_SIZE = 0x03,
+  FRAME_SET_CHANNEL_MASK = 0x04,
+  FRAME_SET_RUN_LENGTH = 0x05,
+  FRAME_START_RUN = 0x06,
+  FRAME_STOP_RUN = 0x07,
+  FRAME_SELECT_PLAN = 0x08,
+  FRAME_SET_SWEEP = 0x09,
+  FRAME_SET_ADAPTIVE = 0x0A,
+  FRAME_SET_FAIR_ACCESS = 0x0B,
+  FRAME_SET_LINK_CHECK = 0x0C,
+  // Responses from the tester
+  FRAME_ACK = 0x81,
+  FRAME_NAK = 0x82,
+  FRAME_RESULT = 0x83,
+  FRAME_DONE = 0x84
+};
+
+// The reason in a FRAME_NAK, following the type of the frame that was rejected
+enum FrameError : uint8_t {
+  FRAME_ERROR_CRC = 0x01,
+  FRAME_ERROR_LENGTH = 0x02,
+  FRAME_ERROR_VALUE = 0x03,
+  FRAME_ERROR_TYPE = 0x04
+};
+
+struct Frame {
+  uint8_t type;
+  uint8_t length;
+  uint8_t payload[MAX_FRAME_PAYLOAD];
+};
+
+/**
+ * Parses command frames from the serial port one byte at a time, and writes response frames.
+ */
+class SerialProtocol {
+
+private:
+  enum ParseState : uint8_t {
+    PARSE_IDLE,
+    PARSE_TYPE,
+    PARSE_LENGTH,
+    PARSE_PAYLOAD,
+    PARSE_CRC_LOW,
+    PARSE_CRC_HIGH,
+    // Skipping the rest of a rejected or incomplete frame
+    PARSE_DISCARD
+  };
+
+  ParseState parseState{PARSE_IDLE};
+  Frame frame{};
+  uint8_t received{0};
+  uint16_t crc{0};
+  uint8_t crcLow{0};
+  uint32_t startMillis{0};
+  uint32_t lastByteMillis{0};
+  // The bytes left to skip in PARSE_DISCARD, if known
+  uint16_t discardCount{0};
+  // The type and FrameError of a rejected frame, awaiting sendPendingNak
+  uint8_t nak[2]{};
+  bool isNakPending{false};
+
+  void rejectFrame(FrameError error);
+
+public:
+  bool isParsing() const;
+  bool parse(uint8_t c);
+  const Frame &getFrame() const;
+  void send(FrameType type, const void *payload, uint8_t length);
+  void sendAck(uint8_t type);
+  void sendNak(uint8_t type, FrameError error);
+  bool hasPendingNak() const;
+  void sendPendingNak();
+};
+
+extern SerialProtocol serialProtocol;
+
+#endif // DATA_RATE_TESTER_SERIALPROTOCOL_H
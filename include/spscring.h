@@ -0,0 +1,56 @@
+#ifndef DATA_RATE_TESTER_SPSCRING_H
+#define DATA_RATE_TESTER_SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Lock-free ring buffer for a single producer and a single consumer, which may run on different
+ * cores. Neither side ever blocks: pushing into a full ring, or popping from an empty ring, fails.
+ *
+ * The capacity must be a power of two.
+ */
+template <typename T, size_t N> class SpscRing {
+
+  static_assert(N > 0 && (N & (N - 1)) == 0, "Capacity must be a power of two");
+
+private:
+  T items[N];
+  // Free-running counters; only the producer changes head, and only the consumer changes tail
+  std::atomic<uint32_t> head{0};
+  std::atomic<uint32_t> tail{0};
+
+public:
+  /**
+   * Copy the item into the ring; only to be invoked by the producer.
+   */
+  bool push(const T &item) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == N) {
+      return false;
+    }
+    items[h & (N - 1)] = item;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Copy the oldest item out of the ring; only to be invoked by the consumer.
+   */
+  bool pop(T &item) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (head.load(std::memory_order_acquire) == t) {
+      return false;
+    }
+    item = items[t & (N - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool isEmpty() const {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+  }
+};
+
+#endif // DATA_RATE_TESTER_SPSCRING_H
@@ -0,0 +1,89 @@
+#ifndef DATA_RATE_TESTER_TESTPLANS_H
+#define DATA_RATE_TESTER_TESTPLANS_H
+
+#include "Arduino.h"
+#include "esp_partition.h"
+
+// For PlanStep::channel: any of the enabled channels that supports the data rate
+const uint8_t PLAN_ANY_CHANNEL = 0xFF;
+
+// Flags for PlanStep::flags
+const uint8_t PLAN_STEP_CONFIRMED = 0x01;
+
+// For TestPlans::select: use the built-in data rates rather than a plan from flash
+const uint16_t NO_TEST_PLAN = 0xFFFF;
+
+/**
+ * The start of the test plans partition, 12 bytes, followed by the TestPlans and the PlanSteps. All
+ * values are little-endian, as read by the ESP32; see tools/compile_test_plans.py.
+ */
+struct PlanTableHeader {
+  char magic[4];
+  uint16_t planCount;
+  uint16_t stepCount;
+  // CRC-32 of the plans and steps that follow this header
+  uint32_t crc;
+};
+
+/**
+ * A named range of steps, 16 bytes.
+ */
+struct TestPlan {
+  // Zero-terminated
+  char name[12];
+  uint16_t firstStep;
+  uint16_t stepCount;
+};
+
+/**
+ * The settings for `repeat` consecutive uplinks, 8 bytes.
+ */
+struct PlanStep {
+  // EU868 DR_SF12 (0) thru DR_SF7 (5)
+  uint8_t dataRate;
+  // The channel as configured in setupLMIC, or PLAN_ANY_CHANNEL
+  uint8_t channel;
+  uint8_t payloadSize;
+  uint8_t flags;
+  uint16_t repeat;
+  uint16_t reserved;
+};
+
+static_assert(sizeof(PlanTableHeader) == 12, "PlanTableHeader must not have padding");
+static_assert(sizeof(TestPlan) == 16, "TestPlan must not have padding");
+static_assert(sizeof(PlanStep) == 8, "PlanStep must not have padding");
+
+/**
+ * Reads test plans from a flash partition that is written separately from the firmware, and steps
+ * through the selected plan.
+ */
+class TestPlans {
+
+private:
+  spi_flash_mmap_handle_t handle{0};
+  const PlanTableHeader *header{nullptr};
+  const TestPlan *plans{nullptr};
+  const PlanStep *steps{nullptr};
+
+  // The selected plan, or NO_TEST_PLAN
+  uint16_t selected{NO_TEST_PLAN};
+  // The index of the current step in the selected plan, and the number of uplinks it has been used
+  uint16_t stepIdx{0};
+  uint16_t repeated{0};
+
+  bool isValid(const uint8_t *table, uint32_t size) const;
+
+public:
+  bool begin();
+  uint16_t getPlanCount() const;
+  const TestPlan *getSelected() const;
+  uint16_t getSelectedIndex() const;
+  void select(uint16_t index);
+  void restart();
+  const PlanStep &nextStep();
+  const PlanStep &skipStep();
+};
+
+extern TestPlans testPlans;
+
+#endif // DATA_RATE_TESTER_TESTPLANS_H
@@ -0,0 +1,105 @@
+#ifndef DATA_RATE_TESTER_UPLINKSTORE_H
+#define DATA_RATE_TESTER_UPLINKSTORE_H
+
+#include "Arduino.h"
+#include "esp_partition.h"
+#include "lmic.h"
+
+// Flags for UplinkRecord::flags
+const uint8_t RECORD_CONFIRMED = 0x01;
+const uint8_t RECORD_ACK = 0x02;
+const uint8_t RECORD_RX1 = 0x04;
+const uint8_t RECORD_RX2 = 0x08;
+// The uplink held a LinkCheckReq; the number of gateways of its LinkCheckAns, if any, is in the
+// upper 3 bits, saturated at 7
+const uint8_t RECORD_LINK_CHECK = 0x10;
+const uint8_t RECORD_GATEWAYS_SHIFT = 5;
+const uint8_t RECORD_MAX_GATEWAYS = 7;
+
+/**
+ * The result of a single uplink, 32 bytes. All values are little-endian, as written by the ESP32.
+ */
+struct UplinkRecord {
+  // Increases for every record that was ever written; 0xFFFFFFFF for erased flash
+  uint32_t recordId;
+  // Increases on every boot, as millis() and seqnoUp restart then
+  uint16_t bootCount;
+  uint8_t sf;
+  uint8_t channel;
+  uint32_t seqnoUp;
+  // millis() at EV_TXSTART and at EV_TXCOMPLETE
+  uint32_t txMillis;
+  uint32_t completeMillis;
+  uint32_t freq;
+  uint8_t flags;
+  // The length of the downlink's application payload, if any
+  uint8_t rxLength;
+  // For a downlink: RSSI in dBm and SNR in 0.25 dB
+  int8_t rssi;
+  int8_t snr;
+  // The size of the uplink's application payload; 0 in records written by older versions
+  uint8_t payloadSize;
+  // For a LinkCheckAns: the demodulation margin of the uplink in dB; 0 in records written by older
+  // versions
+  uint8_t linkMargin;
+  uint16_t crc;
+};
+
+static_assert(sizeof(UplinkRecord) == 32, "UplinkRecord must not have padding");
+
+// The EU868 data rates that the tester uses, DR_SF12 (DR0) thru DR_SF7 (DR5)
+const uint8_t TESTED_DATA_RATES = DR_SF7 + 1;
+
+/**
+ * Get the EU868 data rate of a record, where the SF is 6 for DR_SF7B (SF7BW250).
+ */
+inline dr_t recordDataRate(const UplinkRecord &record) {
+  return 12 - record.sf;
+}
+
+/**
+ * Persists uplink records in a ring buffer in a flash partition, and exports them over serial.
+ */
+class UplinkStore {
+
+private:
+  static const uint8_t BATCH_SIZE = 16;
+  static const uint16_t RECORDS_PER_SECTOR = SPI_FLASH_SEC_SIZE / sizeof(UplinkRecord);
+  // The records that the export reads, and writes, at once
+  static const uint8_t EXPORT_CHUNK = 8;
+  // The chunks that the export reads at most, before it writes anything
+  static const uint8_t EXPORT_SCAN = 64;
+
+  const esp_partition_t *partition{nullptr};
+  uint32_t capacity{0};
+  // The slot for the next record that will be written to flash
+  uint32_t nextSlot{0};
+  uint32_t nextRecordId{0};
+  uint32_t recordCount{0};
+  uint16_t bootCount{0};
+
+  UplinkRecord batch[BATCH_SIZE];
+  uint8_t batchCount{0};
+
+  bool isExporting{false};
+  // The slot that the export started at, and how far the export got after that
+  uint32_t exportStart{0};
+  uint32_t exportOffset{0};
+  uint32_t exportCount{0};
+  uint32_t exportCrc{0};
+
+  bool readSlot(uint32_t slot, UplinkRecord &record) const;
+  void findNextSlot();
+
+public:
+  bool begin();
+  void append(UplinkRecord &record);
+  void flush();
+  uint32_t getCount() const;
+  void startExport();
+  bool continueExport();
+};
+
+extern UplinkStore uplinkStore;
+
+#endif // DATA_RATE_TESTER_UPLINKSTORE_H
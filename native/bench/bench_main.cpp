@@ -0,0 +1,168 @@
+/**
+ * Host-native micro-benchmarks of the hot paths, using Google Benchmark: rendering the display for
+ * each state, logging a line, starting a transmission against the simulated LMIC, and encoding a
+ * payload as hex for the log. Besides the time per call, each reports the heap allocations per
+ * call, which should be zero.
+ *
+ * Like the simulation, this runs the unchanged firmware code on the virtual clock, so the time a
+ * benchmark reports is host time, while the firmware sees about 1000 times more passing. The
+ * firmware's serial output is discarded; the results are written to stderr.
+ */
+#include <cstdio>
+#include <iostream>
+#include <unistd.h>
+#include <benchmark/benchmark.h>
+#include "Arduino.h"
+#include "display.h"
+#include "fixedstring.h"
+#include "heapstats.h"
+#include "lmic.h"
+#include "logger.h"
+#include "sim.h"
+
+// Defined in main.cpp
+void setupLMIC();
+void updateStateAndDisplay();
+void do_send(osjob_t *j);
+
+/**
+ * Report the heap allocations since `before`, per iteration.
+ */
+static void reportAllocations(benchmark::State &state, uint32_t before) {
+  state.counters["allocs"] = benchmark::Counter(HeapStats::getAllocationCount() - before,
+                                                benchmark::Counter::kAvgIterations);
+}
+
+/**
+ * Enter the display state like updateStateAndDisplay does, for STATE_RXDONE showing the details of
+ * a downlink.
+ */
+static void showState(State displayState) {
+  uint32_t now = millis();
+  switch (displayState) {
+    case STATE_WAITING:
+      display.startWaitTx(now + 60000);
+      break;
+    case STATE_TX:
+      display.startTx();
+      break;
+    case STATE_RX1:
+      display.startWaitRx1(now + 1000);
+      break;
+    case STATE_RX2:
+      display.startWaitRx2(now + 1000);
+      break;
+    case STATE_RXDONE:
+      display.setRxDetails("-112 5.0 SF7 rx1 ack 0102");
+      display.stop();
+      break;
+    default:
+      display.stop();
+      break;
+  }
+}
+
+/**
+ * Render a frame in the given state. The uplink counter changes for each tick, to redraw at least
+ * the header, like for each new uplink; the other regions only when their contents change.
+ */
+static void BM_DisplayTick(benchmark::State &state) {
+  static const char *const names[] = {"waiting", "tx", "rx1", "rx2", "rxdone", "nop"};
+  State displayState = (State)state.range(0);
+  state.SetLabel(names[displayState]);
+  showState(displayState);
+  uint32_t fcnt = 0;
+  uint32_t before = HeapStats::getAllocationCount();
+  for (auto _ : state) {
+    display.setTxCount(fcnt++);
+    benchmark::DoNotOptimize(display.tick());
+  }
+  reportAllocations(state, before);
+}
+BENCHMARK(BM_DisplayTick)->DenseRange(STATE_WAITING, STATE_NOP);
+
+/**
+ * Log a line like the longest one logged for each uplink. The drain task writes at the speed of
+ * the serial port, so most lines are dropped; the "dropped" counter tells how many.
+ */
+static void BM_LoggerLogf(benchmark::State &state) {
+  uint32_t drops = Logger::getDroppedCount();
+  uint32_t before = HeapStats::getAllocationCount();
+  for (auto _ : state) {
+    Logger::logf("Next TX: seqnoUp=%d; SF=%d; freq=%.1f; wait=%d ticks/%.1f sec; uplinks/hour=%.1f",
+                 1234, 7, 868.1, 62500, 1.0, 123.4);
+  }
+  reportAllocations(state, before);
+  state.counters["dropped"] =
+      benchmark::Counter(Logger::getDroppedCount() - drops, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_LoggerLogf);
+
+/**
+ * Start a transmission, including the events LMIC fires and the logging. In between, forget the
+ * transmission and the duty cycle, to transmit right away for each iteration.
+ */
+static void BM_DoSend(benchmark::State &state) {
+  osjob_t job{};
+  uint32_t before = HeapStats::getAllocationCount();
+  for (auto _ : state) {
+    state.PauseTiming();
+    os_clearCallback(&LMIC.osjob);
+    LMIC.opmode &= ~(OP_TXRXPEND | OP_TXDATA);
+    for (band_t &band : LMIC.bands) {
+      band.avail = os_getTime();
+    }
+    LMIC.globalDutyAvail = os_getTime();
+    // Consume the events published for the display
+    updateStateAndDisplay();
+    state.ResumeTiming();
+
+    do_send(&job);
+  }
+  reportAllocations(state, before);
+}
+BENCHMARK(BM_DoSend);
+
+/**
+ * Encode a payload of the given length as hex, like onEvent does for a downlink.
+ */
+static void BM_AppendHex(benchmark::State &state) {
+  uint8_t payload[MAX_LEN_FRAME];
+  for (uint8_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = i * 37;
+  }
+  size_t length = state.range(0);
+  uint32_t before = HeapStats::getAllocationCount();
+  for (auto _ : state) {
+    FixedString<2 * MAX_LEN_FRAME> text;
+    text.appendHex(payload, length);
+    benchmark::DoNotOptimize(text.c_str());
+  }
+  reportAllocations(state, before);
+}
+BENCHMARK(BM_AppendHex)->Arg(1)->Arg(MAX_LEN_PAYLOAD)->Arg(MAX_LEN_FRAME);
+
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  // The firmware writes its log to stdout
+  if (!std::freopen("/dev/null", "w", stdout)) {
+    return 1;
+  }
+
+  sim::begin();
+  Logger::startDrainTask(0);
+  display.init();
+  setupLMIC();
+
+  // Like Google Benchmark's default reporter, only use colors on a terminal
+  using Reporter = benchmark::ConsoleReporter;
+  Reporter reporter(isatty(STDERR_FILENO) ? Reporter::OO_Defaults : Reporter::OO_Tabular);
+  reporter.SetOutputStream(&std::cerr);
+  benchmark::RunSpecifiedBenchmarks(&reporter);
+  benchmark::Shutdown();
+  // Do not wait for the tasks, which never end
+  std::_Exit(0);
+}
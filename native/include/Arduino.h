@@ -0,0 +1,171 @@
+/**
+ * Host-native stand-in for the subset of the Arduino ESP32 core that the tester uses, including
+ * the Heltec WiFi LoRa 32 pin definitions.
+ */
+#ifndef DATA_RATE_TESTER_NATIVE_ARDUINO_H
+#define DATA_RATE_TESTER_NATIVE_ARDUINO_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+
+#define PROGMEM
+#define IRAM_ATTR
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define memcpy_P memcpy
+
+using std::max;
+using std::min;
+
+#define LOW 0x0
+#define HIGH 0x1
+#define INPUT 0x01
+#define OUTPUT 0x02
+#define INPUT_PULLUP 0x05
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define DEC 10
+#define HEX 16
+
+// Heltec WiFi LoRa 32 (first release)
+static const uint8_t SS = 18;
+static const uint8_t RST_LoRa = 14;
+static const uint8_t DIO0 = 26;
+static const uint8_t DIO1 = 33;
+static const uint8_t DIO2 = 32;
+static const uint8_t KEY_BUILTIN = 0;
+static const uint8_t SDA_OLED = 4;
+static const uint8_t SCL_OLED = 15;
+static const uint8_t RST_OLED = 16;
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+#define digitalPinToInterrupt(p) (p)
+
+/**
+ * The simulation has no pin interrupts, so the handler is never invoked.
+ */
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode);
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode);
+
+/**
+ * Arduino's heap-allocated string, backed by `std::string`.
+ */
+class String {
+
+private:
+  std::string value;
+
+public:
+  String() = default;
+  String(const char *cstr) : value(cstr ? cstr : "") {} // NOLINT(google-explicit-constructor)
+  explicit String(char c) : value(1, c) {}
+  explicit String(unsigned char number, unsigned char base = DEC);
+  explicit String(int number, unsigned char base = DEC);
+  explicit String(unsigned int number, unsigned char base = DEC);
+  explicit String(long number, unsigned char base = DEC);
+  explicit String(unsigned long number, unsigned char base = DEC);
+  explicit String(float number, unsigned char decimals = 2);
+  explicit String(double number, unsigned char decimals = 2);
+
+  const char *c_str() const {
+    return value.c_str();
+  }
+
+  unsigned int length() const {
+    return value.length();
+  }
+
+  bool reserve(unsigned int size) {
+    value.reserve(size);
+    return true;
+  }
+
+  String &operator+=(const String &rhs) {
+    value += rhs.value;
+    return *this;
+  }
+
+  String &operator+=(const char *rhs) {
+    value += rhs;
+    return *this;
+  }
+
+  String &operator+=(char rhs) {
+    value += rhs;
+    return *this;
+  }
+
+  bool operator==(const String &rhs) const {
+    return value == rhs.value;
+  }
+
+  bool operator!=(const String &rhs) const {
+    return value != rhs.value;
+  }
+
+  friend String operator+(const String &lhs, const String &rhs) {
+    String result(lhs);
+    result += rhs;
+    return result;
+  }
+
+  friend String operator+(const String &lhs, const char *rhs) {
+    String result(lhs);
+    result += rhs;
+    return result;
+  }
+
+  friend String operator+(const char *lhs, const String &rhs) {
+    String result(lhs);
+    result += rhs;
+    return result;
+  }
+};
+
+/**
+ * Serial port, writing to stdout and accounting for the time it takes to send each byte, and
+ * reading from stdin.
+ */
+class HardwareSerial {
+
+private:
+  unsigned long baud{115200};
+
+public:
+  void begin(unsigned long baudRate);
+  size_t write(const uint8_t *buffer, size_t size);
+  size_t print(const char *text);
+  size_t print(const String &text);
+  size_t println(const char *text);
+  size_t println();
+  int available();
+  int read();
+
+  explicit operator bool() const {
+    return true;
+  }
+};
+
+extern HardwareSerial Serial;
+
+#endif // DATA_RATE_TESTER_NATIVE_ARDUINO_H
@@ -0,0 +1,97 @@
+/**
+ * Host-native stand-in for the ThingPulse OLEDDisplay base class (v4.1.0): the same drawing API,
+ * rendering into the same page-organized buffer, minus the features the tester does not use.
+ */
+#ifndef DATA_RATE_TESTER_NATIVE_OLEDDISPLAY_H
+#define DATA_RATE_TESTER_NATIVE_OLEDDISPLAY_H
+
+#include "Arduino.h"
+#include "OLEDDisplayFonts.h"
+
+// Header values of the font format
+#define JUMPTABLE_BYTES 4
+#define JUMPTABLE_LSB 1
+#define JUMPTABLE_SIZE 2
+#define JUMPTABLE_WIDTH 3
+#define JUMPTABLE_START 4
+#define WIDTH_POS 0
+#define HEIGHT_POS 1
+#define FIRST_CHAR_POS 2
+#define CHAR_NUM_POS 3
+
+// SSD1306 commands
+#define COLUMNADDR 0x21
+#define PAGEADDR 0x22
+#define SETCONTRAST 0x81
+#define COMSCANINC 0xC0
+#define COMSCANDEC 0xC8
+#define SEGREMAP 0xA0
+
+enum OLEDDISPLAY_COLOR { BLACK = 0, WHITE = 1, INVERSE = 2 };
+
+enum OLEDDISPLAY_TEXT_ALIGNMENT {
+  TEXT_ALIGN_LEFT = 0,
+  TEXT_ALIGN_RIGHT = 1,
+  TEXT_ALIGN_CENTER = 2,
+  TEXT_ALIGN_CENTER_BOTH = 3
+};
+
+enum OLEDDISPLAY_GEOMETRY { GEOMETRY_128_64 = 0 };
+
+enum HW_I2C { I2C_ONE, I2C_TWO };
+
+class OLEDDisplay {
+
+public:
+  virtual ~OLEDDisplay();
+
+  uint16_t width() const {
+    return displayWidth;
+  }
+
+  uint16_t height() const {
+    return displayHeight;
+  }
+
+  bool init();
+  void end();
+
+  void setColor(OLEDDISPLAY_COLOR color);
+  void setPixel(int16_t x, int16_t y);
+  void drawHorizontalLine(int16_t x, int16_t y, int16_t length);
+  void drawVerticalLine(int16_t x, int16_t y, int16_t length);
+  void drawRect(int16_t x, int16_t y, int16_t width, int16_t height);
+  void fillRect(int16_t x, int16_t y, int16_t width, int16_t height);
+  void drawProgressBar(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t progress);
+  void drawXbm(int16_t x, int16_t y, int16_t width, int16_t height, const uint8_t *xbm);
+
+  void drawString(int16_t x, int16_t y, const String &text);
+  uint16_t getStringWidth(const char *text, uint16_t length);
+  void setTextAlignment(OLEDDISPLAY_TEXT_ALIGNMENT textAlignment);
+  void setFont(const uint8_t *fontData);
+
+  void flipScreenVertically();
+  void setBrightness(uint8_t brightness);
+  void clear();
+
+  virtual void display() = 0;
+
+protected:
+  uint16_t displayWidth{128};
+  uint16_t displayHeight{64};
+  uint16_t displayBufferSize{1024};
+
+  uint8_t *buffer{nullptr};
+
+  OLEDDISPLAY_TEXT_ALIGNMENT textAlignment{TEXT_ALIGN_LEFT};
+  OLEDDISPLAY_COLOR color{WHITE};
+  const uint8_t *fontData{ArialMT_Plain_10};
+
+  virtual bool connect() = 0;
+  virtual void sendCommand(uint8_t command) = 0;
+
+  void drawStringInternal(int16_t xMove, int16_t yMove, char *text, uint16_t textLength,
+                          uint16_t textWidth);
+};
+
+#endif // DATA_RATE_TESTER_NATIVE_OLEDDISPLAY_H
@@ -0,0 +1,12 @@
+/**
+ * Host-native stand-in for the ThingPulse default fonts. The glyphs are placeholder boxes, but the
+ * font format and the character widths and heights match what the real fonts use.
+ */
+#ifndef DATA_RATE_TESTER_NATIVE_OLEDDISPLAYFONTS_H
+#define DATA_RATE_TESTER_NATIVE_OLEDDISPLAYFONTS_H
+
+#include <cstdint>
+
+extern const uint8_t *const ArialMT_Plain_10;
+
+#endif // DATA_RATE_TESTER_NATIVE_OLEDDISPLAYFONTS_H
@@ -0,0 +1,11 @@
+/**
+ * Host-native stand-in for the Arduino SPI library; the simulated radio does not use SPI.
+ */
+#ifndef DATA_RATE_TESTER_NATIVE_SPI_H
+#define DATA_RATE_TESTER_NATIVE_SPI_H
+
+class SPIClass {};
+
+extern SPIClass SPI;
+
+#endif // DATA_RATE_TESTER_NATIVE_SPI_H
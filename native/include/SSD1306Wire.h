@@ -0,0 +1,57 @@
+/**
+ * Host-native stand-in for the ThingPulse SSD1306 I2C driver (v4.1.0), sending the very same
+ * bytes over the simulated I2C bus.
+ */
+#ifndef DATA_RATE_TESTER_NATIVE_SSD1306WIRE_H
+#define DATA_RATE_TESTER_NATIVE_SSD1306WIRE_H
+
+#include "OLEDDisplay.h"
+#include "Wire.h"
+
+class SSD1306Wire : public OLEDDisplay {
+
+private:
+  uint8_t _address;
+  uint8_t _sda;
+  uint8_t _scl;
+  int _frequency;
+
+public:
+  SSD1306Wire(uint8_t address, uint8_t sda, uint8_t scl, OLEDDISPLAY_GEOMETRY g = GEOMETRY_128_64,
+              HW_I2C i2cBus = I2C_ONE, int frequency = 700000)
+      : _address(address), _sda(sda), _scl(scl), _frequency(frequency) {}
+
+  bool connect() override {
+    Wire.begin(_sda, _scl);
+    Wire.setClock(_frequency);
+    return true;
+  }
+
+  void display() override {
+    sendCommand(COLUMNADDR);
+    sendCommand(0x0);
+    sendCommand(width() - 1);
+    sendCommand(PAGEADDR);
+    sendCommand(0x0);
+    sendCommand((height() / 8) - 1);
+
+    for (uint16_t i = 0; i < displayBufferSize; i += 16) {
+      Wire.beginTransmission(_address);
+      Wire.write(0x40);
+      for (uint8_t x = 0; x < 16; x++) {
+        Wire.write(buffer[i + x]);
+      }
+      Wire.endTransmission();
+    }
+  }
+
+protected:
+  void sendCommand(uint8_t command) override {
+    Wire.beginTransmission(_address);
+    Wire.write(0x80);
+    Wire.write(command);
+    Wire.endTransmission();
+  }
+};
+
+#endif // DATA_RATE_TESTER_NATIVE_SSD1306WIRE_H
@@ -0,0 +1,34 @@
+/**
+ * Host-native stand-in for the Arduino I2C library, accounting for the bus time of each transfer.
+ */
+#ifndef DATA_RATE_TESTER_NATIVE_WIRE_H
+#define DATA_RATE_TESTER_NATIVE_WIRE_H
+
+#include <cstddef>
+#include <cstdint>
+
+class TwoWire {
+
+private:
+  uint32_t frequency{100000};
+  size_t pending{0};
+  uint64_t transmitted{0};
+
+public:
+  bool begin(int sda = -1, int scl = -1, uint32_t freq = 0);
+  void setClock(uint32_t freq);
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t data);
+  uint8_t endTransmission(bool sendStop = true);
+
+  /**
+   * Total number of bytes sent on the bus, including the address bytes.
+   */
+  uint64_t bytesTransmitted() const {
+    return transmitted;
+  }
+};
+
+extern TwoWire Wire;
+
+#endif // DATA_RATE_TESTER_NATIVE_WIRE_H
@@ -0,0 +1,14 @@
+/**
+ * Host-native stand-in for the ESP-IDF error codes.
+ */
+#ifndef DATA_RATE_TESTER_NATIVE_ESP_ERR_H
+#define DATA_RATE_TESTER_NATIVE_ESP_ERR_H
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_SIZE 0x104
+
+#endif // DATA_RATE_TESTER_NATIVE_ESP_ERR_H
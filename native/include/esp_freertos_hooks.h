@@ -0,0 +1,20 @@
+/**
+ * Host-native stand-in for the ESP-IDF FreeRTOS idle hooks.
+ *
+ * Like the idle task of an ESP32 core invokes the hooks once per FreeRTOS tick while no other task
+ * of that core is ready to run, this invokes the hooks once for each tick that passed while all
+ * tasks pinned to the core were blocked. As there is no idle task, that happens when a task of the
+ * core is unblocked, or when the tick count is read.
+ */
+#ifndef DATA_RATE_TESTER_NATIVE_ESP_FREERTOS_HOOKS_H
+#define DATA_RATE_TESTER_NATIVE_ESP_FREERTOS_HOOKS_H
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef bool (*esp_freertos_idle_cb_t)();
+
+esp_err_t esp_register_freertos_idle_hook_for_cpu(esp_freertos_idle_cb_t new_idle_cb,
+                                                   UBaseType_t cpuid);
+
+#endif // DATA_RATE_TESTER_NATIVE_ESP_FREERTOS_HOOKS_H
@@ -0,0 +1,56 @@
+/**
+ * Host-native stand-in for the ESP-IDF partition API, emulating the data partitions of
+ * partitions.csv in memory. Like NOR flash, erasing sets all bits, and writing can only clear bits.
+ * If SIM_FLASH is set, the contents of the SPIFFS partition are loaded from and saved to that file.
+ * If SIM_PLANS is set, the test plans partition is loaded from that file.
+ */
+#ifndef DATA_RATE_TESTER_NATIVE_ESP_PARTITION_H
+#define DATA_RATE_TESTER_NATIVE_ESP_PARTITION_H
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+
+// Defined in esp_spi_flash.h on the ESP32
+#define SPI_FLASH_SEC_SIZE 4096
+
+typedef enum {
+  ESP_PARTITION_TYPE_APP = 0x00,
+  ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum {
+  ESP_PARTITION_SUBTYPE_DATA_SPIFFS = 0x82,
+  ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+typedef struct {
+  esp_partition_type_t type;
+  esp_partition_subtype_t subtype;
+  uint32_t address;
+  uint32_t size;
+  char label[17];
+  bool encrypted;
+} esp_partition_t;
+
+typedef enum {
+  SPI_FLASH_MMAP_DATA,
+  SPI_FLASH_MMAP_INST,
+} spi_flash_mmap_memory_t;
+
+typedef uint32_t spi_flash_mmap_handle_t;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype, const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst,
+                             size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset,
+                              const void *src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t start_addr,
+                                    size_t size);
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size,
+                             spi_flash_mmap_memory_t memory, const void **out_ptr,
+                             spi_flash_mmap_handle_t *out_handle);
+void spi_flash_munmap(spi_flash_mmap_handle_t handle);
+
+#endif // DATA_RATE_TESTER_NATIVE_ESP_PARTITION_H
@@ -0,0 +1,25 @@
+/**
+ * Host-native stand-in for the FreeRTOS types and configuration of the ESP32.
+ */
+#ifndef DATA_RATE_TESTER_NATIVE_FREERTOS_H
+#define DATA_RATE_TESTER_NATIVE_FREERTOS_H
+
+#include <cstdint>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define configTICK_RATE_HZ 1000
+#define portNUM_PROCESSORS 2
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / 1000))
+
+#endif // DATA_RATE_TESTER_NATIVE_FREERTOS_H
@@ -0,0 +1,15 @@
+/**
+ * Host-native stand-in for FreeRTOS mutexes.
+ */
+#ifndef DATA_RATE_TESTER_NATIVE_FREERTOS_SEMPHR_H
+#define DATA_RATE_TESTER_NATIVE_FREERTOS_SEMPHR_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct QueueDefinition *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore);
+
+#endif // DATA_RATE_TESTER_NATIVE_FREERTOS_SEMPHR_H
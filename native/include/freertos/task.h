@@ -0,0 +1,56 @@
+/**
+ * Host-native stand-in for FreeRTOS tasks on the dual-core ESP32, using one thread per task.
+ */
+#ifndef DATA_RATE_TESTER_NATIVE_FREERTOS_TASK_H
+#define DATA_RATE_TESTER_NATIVE_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+#define tskIDLE_PRIORITY ((UBaseType_t)0U)
+
+typedef void (*TaskFunction_t)(void *);
+typedef struct tskTaskControlBlock *TaskHandle_t;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char *pcName,
+                                   uint32_t usStackDepth, void *pvParameters,
+                                   UBaseType_t uxPriority, TaskHandle_t *pvCreatedTask,
+                                   BaseType_t xCoreID);
+
+void vTaskDelay(TickType_t xTicksToDelay);
+
+/**
+ * The number of ticks since the scheduler started; here, since boot.
+ */
+TickType_t xTaskGetTickCount();
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
+
+/**
+ * The priority the task was created with; nullptr for the calling task.
+ */
+UBaseType_t uxTaskPriorityGet(TaskHandle_t xTask);
+
+/**
+ * Lightweight binary semaphore or counting semaphore using the task's notification value; like
+ * the FreeRTOS macros that delegate to xTaskGenericNotify and ulTaskGenericNotifyTake.
+ */
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken);
+
+// There are no interrupts, so there is no need to switch tasks on leaving an interrupt handler
+#define portYIELD_FROM_ISR()
+
+/**
+ * Like on the ESP32, only suspend the scheduler of the calling core, so no other task on that core
+ * can run until resumed. Here, this is emulated using one lock per core.
+ */
+void vTaskSuspendAll();
+BaseType_t xTaskResumeAll();
+
+/**
+ * The core the calling task is pinned to; like on the ESP32, setup() and loop() run on core 1.
+ */
+BaseType_t xPortGetCoreID();
+
+#endif // DATA_RATE_TESTER_NATIVE_FREERTOS_TASK_H
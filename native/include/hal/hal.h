@@ -0,0 +1,21 @@
+/**
+ * Host-native stand-in for the MCCI LMIC Arduino HAL configuration.
+ */
+#ifndef DATA_RATE_TESTER_NATIVE_HAL_H
+#define DATA_RATE_TESTER_NATIVE_HAL_H
+
+#include "lmic/oslmic_types.h"
+
+static const u1_t LMIC_UNUSED_PIN = 0xff;
+
+struct lmic_pinmap {
+  u1_t nss;
+  u1_t rxtx;
+  u1_t rst;
+  u1_t dio[3];
+};
+
+// Defined by the application
+extern const lmic_pinmap lmic_pins;
+
+#endif // DATA_RATE_TESTER_NATIVE_HAL_H
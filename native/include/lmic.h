@@ -0,0 +1,214 @@
+/**
+ * Host-native stand-in for the MCCI LMIC library (v3.2.0, EU868, ABP, class A only).
+ *
+ * This exposes just the subset of the LMIC API and of the `LMIC` state that the tester uses, with
+ * the same names, values and semantics. The MAC and radio are simulated in `lmic_sim.cpp`, driven
+ * by the virtual clock of `sim.h`.
+ */
+#ifndef DATA_RATE_TESTER_NATIVE_LMIC_H
+#define DATA_RATE_TESTER_NATIVE_LMIC_H
+
+#include <cstddef>
+#include "lmic/oslmic_types.h"
+#include "hal/hal.h"
+
+// Like the Arduino HAL on the ESP32: os_getTime() is micros() >> 4
+#define US_PER_OSTICK_EXPONENT 4
+#define US_PER_OSTICK (1 << US_PER_OSTICK_EXPONENT)
+#define OSTICKS_PER_SEC (1000000 / US_PER_OSTICK)
+
+#define us2osticks(us) ((ostime_t)(((s8_t)(us)*OSTICKS_PER_SEC) / 1000000))
+#define ms2osticks(ms) ((ostime_t)(((s8_t)(ms)*OSTICKS_PER_SEC) / 1000))
+#define sec2osticks(sec) ((ostime_t)((s8_t)(sec)*OSTICKS_PER_SEC))
+#define osticks2ms(os) ((s4_t)(((os) * (s8_t)1000) / OSTICKS_PER_SEC))
+#define osticks2us(os) ((s4_t)(((os) * (s8_t)1000000) / OSTICKS_PER_SEC))
+
+// EU868 data rates
+enum _dr_eu868_t {
+  DR_SF12 = 0,
+  DR_SF11,
+  DR_SF10,
+  DR_SF9,
+  DR_SF8,
+  DR_SF7,
+  DR_SF7B,
+  DR_FSK,
+  DR_NONE
+};
+
+// Spreading factors as used in radio parameters
+enum _sf_t { FSK = 0, SF7, SF8, SF9, SF10, SF11, SF12, SFrfu };
+
+#define DR_RANGE_MAP(drlo, drhi) (((u2_t)0xFFFF << (drlo)) & ((u2_t)0xFFFF >> (15 - (drhi))))
+
+// EU868 duty cycle bands
+enum { BAND_MILLI = 0, BAND_CENTI = 1, BAND_DECI = 2, BAND_AUX = 3 };
+enum { MAX_BANDS = 4 };
+enum { MAX_CHANNELS = 16 };
+
+// Like LMIC, the frame buffer is 64 bytes unless configured otherwise
+#ifndef LMIC_MAX_FRAME_LENGTH
+#define LMIC_MAX_FRAME_LENGTH 64
+#endif
+enum { MAX_LEN_FRAME = LMIC_MAX_FRAME_LENGTH, MAX_LEN_PAYLOAD = MAX_LEN_FRAME - 13 };
+enum { TXCONF_ATTEMPTS = 8 };
+enum { MAX_CLOCK_ERROR = 65536 };
+enum { RSSI_OFF = 64 };
+
+enum _ev_t {
+  EV_SCAN_TIMEOUT = 1,
+  EV_BEACON_FOUND,
+  EV_BEACON_MISSED,
+  EV_BEACON_TRACKED,
+  EV_JOINING,
+  EV_JOINED,
+  EV_RFU1,
+  EV_JOIN_FAILED,
+  EV_REJOIN_FAILED,
+  EV_TXCOMPLETE,
+  EV_LOST_TSYNC,
+  EV_RESET,
+  EV_RXCOMPLETE,
+  EV_LINK_DEAD,
+  EV_LINK_ALIVE,
+  EV_SCAN_FOUND,
+  EV_TXSTART,
+  EV_TXCANCELED,
+  EV_RXSTART,
+  EV_JOIN_TXCOMPLETE
+};
+typedef enum _ev_t ev_t;
+
+enum {
+  OP_NONE = 0x0000,
+  OP_SCAN = 0x0001,
+  OP_TRACK = 0x0002,
+  OP_JOINING = 0x0004,
+  OP_TXDATA = 0x0008,
+  OP_POLL = 0x0010,
+  OP_REJOIN = 0x0020,
+  OP_SHUTDOWN = 0x0040,
+  OP_TXRXPEND = 0x0080,
+  OP_RNDTX = 0x0100,
+  OP_PINGINI = 0x0200,
+  OP_PINGABLE = 0x0400,
+  OP_NEXTCHNL = 0x0800,
+  OP_LINKDEAD = 0x1000,
+  OP_TESTMODE = 0x2000,
+  OP_UNJOIN = 0x4000
+};
+
+enum {
+  TXRX_ACK = 0x80,
+  TXRX_NACK = 0x40,
+  TXRX_NOPORT = 0x20,
+  TXRX_PORT = 0x10,
+  TXRX_LENERR = 0x08,
+  TXRX_PING = 0x04,
+  TXRX_DNW2 = 0x02,
+  TXRX_DNW1 = 0x01
+};
+
+typedef int lmic_tx_error_t;
+enum { LMIC_ERROR_SUCCESS = 0, LMIC_ERROR_TX_BUSY = -1, LMIC_ERROR_TX_TOO_LARGE = -2 };
+
+struct osjob_t;
+typedef void (*osjobcb_t)(struct osjob_t *);
+struct osjob_t {
+  struct osjob_t *next;
+  ostime_t deadline;
+  osjobcb_t func;
+};
+
+struct band_t {
+  u2_t txcap; // duty cycle limitation: 1/txcap
+  s1_t txpow; // maximum TX power
+  u1_t lastchnl; // last used channel
+  ostime_t avail; // channel is blocked until this time
+};
+
+struct lmic_client_data_t {
+  u2_t clockError; // inaccuracy in clock, relative to MAX_CLOCK_ERROR
+};
+
+struct lmic_t {
+  lmic_client_data_t client;
+
+  ostime_t txend;
+  ostime_t rxtime;
+
+  u4_t freq;
+  s1_t rssi;
+  s1_t snr;
+  u1_t rxsyms;
+  s1_t txpow;
+  s1_t adrTxPow;
+
+  osjob_t osjob;
+
+  band_t bands[MAX_BANDS];
+  u4_t channelFreq[MAX_CHANNELS]; // lower 2 bits hold the band
+  u2_t channelDrMap[MAX_CHANNELS];
+  u2_t channelMap;
+
+  u1_t txChnl;
+  u1_t globalDutyRate;
+  ostime_t globalDutyAvail;
+
+  u4_t devaddr;
+  u4_t seqnoDn;
+  u4_t seqnoUp;
+  dr_t datarate;
+  u1_t adrEnabled;
+  u1_t rxDelay;
+  u4_t dn2Freq;
+  dr_t dn2Dr;
+
+  u2_t opmode;
+  u1_t txCnt;
+  u1_t txrxFlags;
+  u1_t dataBeg;
+  u1_t dataLen;
+  u1_t frame[MAX_LEN_FRAME];
+
+  u1_t pendTxPort;
+  u1_t pendTxConf;
+  u1_t pendTxLen;
+  u1_t pendTxData[MAX_LEN_PAYLOAD];
+};
+
+extern lmic_t LMIC;
+
+void os_init();
+ostime_t os_getTime();
+void os_setCallback(osjob_t *job, osjobcb_t cb);
+void os_setTimedCallback(osjob_t *job, ostime_t time, osjobcb_t cb);
+void os_clearCallback(osjob_t *job);
+void os_runloop_once();
+bit_t os_queryTimeCriticalJobs(ostime_t time);
+
+// Invoked by the run loop when no job is due; like LMIC, declared with C linkage
+extern "C" void hal_sleep();
+// Busy-waits until the given time, returning how many ticks late it was invoked, if any
+extern "C" u4_t hal_waitUntil(u4_t time);
+// Reads radio registers, starting at the address in cmd; see `lmic_sim.cpp`
+extern "C" void hal_spi_read(u1_t cmd, u1_t *buf, size_t len);
+
+void LMIC_reset();
+void LMIC_setSession(u4_t netid, u4_t devaddr, const u1_t *nwkKey, const u1_t *artKey);
+bit_t LMIC_setupChannel(u1_t channel, u4_t freq, u2_t drmap, s1_t band);
+void LMIC_setAdrMode(bit_t enabled);
+void LMIC_setLinkCheckMode(bit_t enabled);
+void LMIC_setDrTxpow(dr_t dr, s1_t txpow);
+void LMIC_setClockError(u2_t error);
+lmic_tx_error_t LMIC_setTxData2(u1_t port, u1_t *data, u1_t dlen, u1_t confirmed);
+lmic_tx_error_t LMIC_setTxData2_strict(u1_t port, u1_t *data, u1_t dlen, u1_t confirmed);
+void LMIC_clrTxData();
+
+// Defined by the application
+void onEvent(ev_t ev);
+void os_getArtEui(u1_t *buf);
+void os_getDevEui(u1_t *buf);
+void os_getDevKey(u1_t *buf);
+
+#endif // DATA_RATE_TESTER_NATIVE_LMIC_H
@@ -0,0 +1,21 @@
+/**
+ * Host-native stand-in for the basic MCCI LMIC types.
+ */
+#ifndef DATA_RATE_TESTER_NATIVE_OSLMIC_TYPES_H
+#define DATA_RATE_TESTER_NATIVE_OSLMIC_TYPES_H
+
+#include <cstdint>
+
+typedef uint8_t bit_t;
+typedef uint8_t u1_t;
+typedef int8_t s1_t;
+typedef uint16_t u2_t;
+typedef int16_t s2_t;
+typedef uint32_t u4_t;
+typedef int32_t s4_t;
+typedef uint64_t u8_t;
+typedef int64_t s8_t;
+typedef s4_t ostime_t;
+typedef u1_t dr_t;
+
+#endif // DATA_RATE_TESTER_NATIVE_OSLMIC_TYPES_H
@@ -0,0 +1,80 @@
+/**
+ * Virtual clock and configuration for the host-native simulation.
+ *
+ * Virtual time is the real time since boot, multiplied by a speed factor. All stand-ins (millis,
+ * micros, delay, vTaskDelay, os_getTime, ...) use this clock, so the firmware runs unchanged but,
+ * by default, 1000 times faster than real time.
+ *
+ * Configured using environment variables:
+ *
+ * - SIM_SPEED: speed factor, default 1000
+ * - SIM_HOURS: simulated duration after which the run ends with a report, default 24
+ * - SIM_SEED: seed for the random generator, default 1
+ * - SIM_SNR: mean SNR of the simulated link in dB, default 0
+ * - SIM_LATENCY_MS: how late the board detects the end of a transmission, default 8
+ * - SIM_CRYSTAL_PPM: how much faster the radio's crystal runs than the network's, default 10
+ * - SIM_FLASH: file to keep the simulated flash partition in across runs, default none
+ * - SIM_PLANS: file with test plans as compiled by tools/compile_test_plans.py, default none
+ */
+#ifndef DATA_RATE_TESTER_NATIVE_SIM_H
+#define DATA_RATE_TESTER_NATIVE_SIM_H
+
+#include <cstdint>
+
+namespace sim {
+
+void begin();
+
+/**
+ * Virtual microseconds since boot.
+ */
+uint64_t micros();
+
+/**
+ * Block the calling thread for the given number of virtual microseconds.
+ */
+void sleepMicros(uint64_t us);
+
+/**
+ * Account for the calling thread being blocked by I/O, like a serial or I2C transfer. Short delays
+ * are accumulated and slept in batches, as the host cannot sleep for fractions of a microsecond.
+ */
+void busyMicros(uint64_t us);
+
+/**
+ * True until the configured simulated duration has passed.
+ */
+bool isRunning();
+
+/**
+ * A uniformly distributed random number in the range [0, bound).
+ */
+uint32_t random(uint32_t bound);
+
+/**
+ * A normally distributed random number.
+ */
+double gaussian(double mean, double stddev);
+
+double speed();
+double hours();
+double snr();
+uint32_t latencyMs();
+double crystalPpm();
+const char *flashFile();
+const char *plansFile();
+
+/**
+ * Run the handler attached to the given pin, like for an interrupt, with micros() returning the
+ * given time of the edge while it runs; see `Arduino.cpp`.
+ */
+void raiseInterrupt(uint8_t pin, uint64_t atMicros);
+
+/**
+ * Print the throughput report of the simulated LMIC, see `lmic_sim.cpp`.
+ */
+void report();
+
+} // namespace sim
+
+#endif // DATA_RATE_TESTER_NATIVE_SIM_H
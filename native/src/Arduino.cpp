@@ -0,0 +1,406 @@
+/**
+ * Host-native stand-ins for the Arduino ESP32 core, FreeRTOS tasks, SPI and I2C; see `Arduino.h`.
+ */
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "Arduino.h"
+#include "SPI.h"
+#include "Wire.h"
+#include "esp_freertos_hooks.h"
+#include "sim.h"
+
+HardwareSerial Serial;
+SPIClass SPI;
+TwoWire Wire;
+
+struct QueueDefinition {
+  std::timed_mutex mutex;
+};
+
+struct tskTaskControlBlock {
+  std::mutex mutex;
+  std::condition_variable notified;
+  uint32_t notifyValue{0};
+  UBaseType_t priority{1};
+};
+
+namespace {
+
+// Like on the ESP32, setup() and loop() run on core 1
+thread_local BaseType_t coreId = 1;
+
+tskTaskControlBlock loopTask;
+thread_local TaskHandle_t currentTask = &loopTask;
+
+void (*interruptHandlers[256])(void *);
+void *interruptArgs[256];
+// While running an interrupt handler: the time of the edge that raised it
+thread_local uint64_t interruptMicros = 0;
+
+std::mutex serialMutex;
+
+/**
+ * The bytes read from stdin. Serial.begin is invoked by the Logger's constructor, while the
+ * globals of this file may not have been constructed yet, so construct this on first use.
+ */
+std::deque<uint8_t> &serialInput() {
+  static std::deque<uint8_t> input;
+  return input;
+}
+
+std::recursive_mutex coreSchedulers[portNUM_PROCESSORS];
+
+// Like MAX_HOOKS in ESP-IDF's esp_freertos_hooks.c
+const uint8_t MAX_IDLE_HOOKS = 8;
+
+// The idle hooks per core, the number of tasks per core that are not blocked, starting with the
+// loop task on core 1, and since when a core has no such tasks
+std::mutex loadMutex;
+esp_freertos_idle_cb_t idleHooks[portNUM_PROCESSORS][MAX_IDLE_HOOKS];
+int runningTasks[portNUM_PROCESSORS] = {0, 1};
+uint64_t idleSince[portNUM_PROCESSORS] = {0, 0};
+
+/**
+ * Invoke the idle hooks of an idle core once for each tick that passed since it became idle, or
+ * since the hooks were last invoked. To be invoked while holding loadMutex.
+ */
+void runIdleHooks(BaseType_t core, uint64_t now) {
+  uint64_t ticks = now / 1000 - idleSince[core] / 1000;
+  idleSince[core] = now;
+  for (uint64_t tick = 0; tick < ticks; tick++) {
+    for (esp_freertos_idle_cb_t hook : idleHooks[core]) {
+      if (hook) {
+        hook();
+      }
+    }
+  }
+}
+
+void changeRunningTasks(BaseType_t core, int delta) {
+  std::lock_guard<std::mutex> lock(loadMutex);
+  uint64_t now = sim::micros();
+  if (runningTasks[core] == 0) {
+    runIdleHooks(core, now);
+  }
+  runningTasks[core] += delta;
+  if (runningTasks[core] == 0) {
+    idleSince[core] = now;
+  }
+}
+
+/**
+ * Marks the calling task as blocked while in scope, to tell when its core is idle.
+ */
+class Blocked {
+
+public:
+  Blocked() {
+    changeRunningTasks(coreId, -1);
+  }
+
+  ~Blocked() {
+    changeRunningTasks(coreId, 1);
+  }
+};
+
+String formatNumber(unsigned long number, unsigned char base, bool negative) {
+  char buffer[34];
+  char *p = buffer + sizeof(buffer);
+  *--p = '\0';
+  do {
+    *--p = "0123456789abcdef"[number % base];
+    number /= base;
+  } while (number);
+  if (negative) {
+    *--p = '-';
+  }
+  return String(p);
+}
+
+String formatFloat(double number, unsigned char decimals) {
+  char buffer[33];
+  snprintf(buffer, sizeof(buffer), "%.*f", decimals, number);
+  return String(buffer);
+}
+
+} // namespace
+
+unsigned long millis() {
+  return sim::micros() / 1000;
+}
+
+unsigned long micros() {
+  return interruptMicros ? interruptMicros : sim::micros();
+}
+
+void delay(uint32_t ms) {
+  Blocked blocked;
+  sim::sleepMicros(ms * 1000ULL);
+}
+
+void pinMode(__unused uint8_t pin, __unused uint8_t mode) {}
+
+void digitalWrite(__unused uint8_t pin, __unused uint8_t val) {}
+
+int digitalRead(__unused uint8_t pin) {
+  return HIGH;
+}
+
+static void invokeHandler(void *handler) {
+  reinterpret_cast<void (*)()>(handler)();
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(), __unused int mode) {
+  attachInterruptArg(pin, invokeHandler, reinterpret_cast<void *>(handler), mode);
+}
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, __unused int mode) {
+  interruptHandlers[pin] = handler;
+  interruptArgs[pin] = arg;
+}
+
+void sim::raiseInterrupt(uint8_t pin, uint64_t atMicros) {
+  if (interruptHandlers[pin]) {
+    interruptMicros = atMicros;
+    interruptHandlers[pin](interruptArgs[pin]);
+    interruptMicros = 0;
+  }
+}
+
+String::String(unsigned char number, unsigned char base)
+    : String(formatNumber(number, base, false)) {}
+
+String::String(int number, unsigned char base)
+    : String(base == DEC ? formatNumber(std::labs(number), base, number < 0)
+                         : formatNumber((unsigned int)number, base, false)) {}
+
+String::String(unsigned int number, unsigned char base)
+    : String(formatNumber(number, base, false)) {}
+
+String::String(long number, unsigned char base)
+    : String(base == DEC ? formatNumber(std::labs(number), base, number < 0)
+                         : formatNumber((unsigned long)number, base, false)) {}
+
+String::String(unsigned long number, unsigned char base)
+    : String(formatNumber(number, base, false)) {}
+
+String::String(float number, unsigned char decimals) : String(formatFloat(number, decimals)) {}
+
+String::String(double number, unsigned char decimals) : String(formatFloat(number, decimals)) {}
+
+void HardwareSerial::begin(unsigned long baudRate) {
+  baud = baudRate;
+  // Like a UART receive buffer, queue whatever arrives on stdin until read
+  std::thread([] {
+    int c;
+    while ((c = getchar()) != EOF) {
+      std::lock_guard<std::mutex> lock(serialMutex);
+      serialInput().push_back((uint8_t)c);
+    }
+  }).detach();
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  {
+    std::lock_guard<std::mutex> lock(serialMutex);
+    fwrite(buffer, 1, size, stdout);
+    // Like a UART, do not hold back the output, for a host that responds to it
+    fflush(stdout);
+  }
+  // 8N1: 10 bits per byte; like the ESP32 UART driver, block while the data is being sent
+  sim::busyMicros(size * 10 * 1000000ULL / baud);
+  return size;
+}
+
+size_t HardwareSerial::print(const char *text) {
+  return write(reinterpret_cast<const uint8_t *>(text), strlen(text));
+}
+
+size_t HardwareSerial::print(const String &text) {
+  return print(text.c_str());
+}
+
+size_t HardwareSerial::println(const char *text) {
+  return print(text) + println();
+}
+
+size_t HardwareSerial::println() {
+  return print("\r\n");
+}
+
+int HardwareSerial::available() {
+  std::lock_guard<std::mutex> lock(serialMutex);
+  return (int)serialInput().size();
+}
+
+int HardwareSerial::read() {
+  std::lock_guard<std::mutex> lock(serialMutex);
+  if (serialInput().empty()) {
+    return -1;
+  }
+  uint8_t c = serialInput().front();
+  serialInput().pop_front();
+  return c;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, __unused const char *pcName,
+                                   __unused uint32_t usStackDepth, void *pvParameters,
+                                   UBaseType_t uxPriority, TaskHandle_t *pvCreatedTask,
+                                   BaseType_t xCoreID) {
+  // Tasks never end, so their control blocks are never freed
+  TaskHandle_t task = new tskTaskControlBlock();
+  task->priority = uxPriority;
+  changeRunningTasks(xCoreID, 1);
+  std::thread([=] {
+    coreId = xCoreID;
+    currentTask = task;
+    pvTaskCode(pvParameters);
+  }).detach();
+  if (pvCreatedTask) {
+    *pvCreatedTask = task;
+  }
+  return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return currentTask;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t xTask) {
+  return (xTask ? xTask : currentTask)->priority;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify) {
+  {
+    std::lock_guard<std::mutex> lock(xTaskToNotify->mutex);
+    xTaskToNotify->notifyValue++;
+  }
+  xTaskToNotify->notified.notify_one();
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify,
+                            BaseType_t *pxHigherPriorityTaskWoken) {
+  xTaskNotifyGive(xTaskToNotify);
+  *pxHigherPriorityTaskWoken = pdFALSE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait) {
+  TaskHandle_t task = currentTask;
+  Blocked blocked;
+  std::unique_lock<std::mutex> lock(task->mutex);
+  auto isNotified = [task] { return task->notifyValue != 0; };
+  if (xTicksToWait == 0) {
+    // Do not wait
+  } else if (xTicksToWait == portMAX_DELAY) {
+    task->notified.wait(lock, isNotified);
+  } else {
+    auto realNs = (int64_t)(xTicksToWait * portTICK_PERIOD_MS * 1E6 / sim::speed());
+    task->notified.wait_for(lock, std::chrono::nanoseconds(realNs), isNotified);
+  }
+  uint32_t value = task->notifyValue;
+  if (value) {
+    task->notifyValue = xClearCountOnExit ? 0 : value - 1;
+  }
+  return value;
+}
+
+void vTaskDelay(TickType_t xTicksToDelay) {
+  Blocked blocked;
+  sim::sleepMicros(xTicksToDelay * portTICK_PERIOD_MS * 1000ULL);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  // Mutexes are never deleted
+  return new QueueDefinition();
+}
+
+TickType_t xTaskGetTickCount() {
+  std::lock_guard<std::mutex> lock(loadMutex);
+  uint64_t now = sim::micros();
+  for (BaseType_t core = 0; core < portNUM_PROCESSORS; core++) {
+    if (runningTasks[core] == 0) {
+      runIdleHooks(core, now);
+    }
+  }
+  return (TickType_t)(now / 1000);
+}
+
+esp_err_t esp_register_freertos_idle_hook_for_cpu(esp_freertos_idle_cb_t new_idle_cb,
+                                                   UBaseType_t cpuid) {
+  std::lock_guard<std::mutex> lock(loadMutex);
+  if (runningTasks[cpuid] == 0) {
+    runIdleHooks(cpuid, sim::micros());
+  }
+  for (esp_freertos_idle_cb_t &hook : idleHooks[cpuid]) {
+    if (!hook) {
+      hook = new_idle_cb;
+      return ESP_OK;
+    }
+  }
+  return ESP_ERR_NO_MEM;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime) {
+  if (xSemaphore->mutex.try_lock()) {
+    return pdTRUE;
+  }
+  Blocked blocked;
+  if (xBlockTime == portMAX_DELAY) {
+    xSemaphore->mutex.lock();
+    return pdTRUE;
+  }
+  auto realNs = (int64_t)(xBlockTime * portTICK_PERIOD_MS * 1E6 / sim::speed());
+  return xSemaphore->mutex.try_lock_for(std::chrono::nanoseconds(realNs)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore) {
+  xSemaphore->mutex.unlock();
+  return pdTRUE;
+}
+
+void vTaskSuspendAll() {
+  coreSchedulers[coreId].lock();
+}
+
+BaseType_t xTaskResumeAll() {
+  coreSchedulers[coreId].unlock();
+  return pdFALSE;
+}
+
+BaseType_t xPortGetCoreID() {
+  return coreId;
+}
+
+bool TwoWire::begin(__unused int sda, __unused int scl, uint32_t freq) {
+  if (freq) {
+    frequency = freq;
+  }
+  return true;
+}
+
+void TwoWire::setClock(uint32_t freq) {
+  frequency = freq;
+}
+
+void TwoWire::beginTransmission(__unused uint8_t address) {
+  // The address byte
+  pending = 1;
+}
+
+size_t TwoWire::write(__unused uint8_t data) {
+  pending++;
+  return 1;
+}
+
+uint8_t TwoWire::endTransmission(__unused bool sendStop) {
+  transmitted += pending;
+  // 9 clock cycles per byte including the ACK, plus start and stop conditions
+  sim::busyMicros((pending * 9 + 2) * 1000000ULL / frequency);
+  pending = 0;
+  return 0;
+}
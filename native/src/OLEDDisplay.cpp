@@ -0,0 +1,234 @@
+/**
+ * Host-native stand-in for the ThingPulse OLEDDisplay drawing routines; see `OLEDDisplay.h`.
+ */
+#include <cstdlib>
+#include "OLEDDisplay.h"
+
+namespace {
+
+// Placeholder font, 13 pixels high like ArialMT_Plain_10: a space of 3 pixels, and a box of 5 by
+// 9 pixels in a 6 pixel wide cell for all other characters.
+const uint8_t FONT_HEIGHT = 13;
+const uint8_t FONT_FIRST_CHAR = 32;
+const uint8_t FONT_CHAR_COUNT = 224;
+const uint8_t GLYPH_BYTES = 10;
+const uint8_t GLYPH[GLYPH_BYTES] = {0xFC, 0x07, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0xFC, 0x07};
+
+struct PlaceholderFont {
+  uint8_t data[JUMPTABLE_START + FONT_CHAR_COUNT * JUMPTABLE_BYTES +
+               (FONT_CHAR_COUNT - 1) * GLYPH_BYTES]{};
+
+  constexpr PlaceholderFont() {
+    data[WIDTH_POS] = 6;
+    data[HEIGHT_POS] = FONT_HEIGHT;
+    data[FIRST_CHAR_POS] = FONT_FIRST_CHAR;
+    data[CHAR_NUM_POS] = FONT_CHAR_COUNT;
+    uint8_t *jumpTable = data + JUMPTABLE_START;
+    jumpTable[0] = 0xFF;
+    jumpTable[JUMPTABLE_LSB] = 0xFF;
+    jumpTable[JUMPTABLE_WIDTH] = 3;
+    uint8_t *glyphs = jumpTable + FONT_CHAR_COUNT * JUMPTABLE_BYTES;
+    for (uint16_t c = 1; c < FONT_CHAR_COUNT; c++) {
+      uint16_t offset = (c - 1) * GLYPH_BYTES;
+      uint8_t *entry = jumpTable + c * JUMPTABLE_BYTES;
+      entry[0] = offset >> 8;
+      entry[JUMPTABLE_LSB] = offset & 0xFF;
+      entry[JUMPTABLE_SIZE] = GLYPH_BYTES;
+      entry[JUMPTABLE_WIDTH] = 6;
+      for (uint8_t i = 0; i < GLYPH_BYTES; i++) {
+        glyphs[offset + i] = GLYPH[i];
+      }
+    }
+  }
+};
+
+constexpr PlaceholderFont placeholderFont;
+
+} // namespace
+
+const uint8_t *const ArialMT_Plain_10 = placeholderFont.data;
+
+OLEDDisplay::~OLEDDisplay() {
+  end();
+}
+
+bool OLEDDisplay::init() {
+  if (!connect()) {
+    return false;
+  }
+  if (!buffer) {
+    buffer = static_cast<uint8_t *>(malloc(displayBufferSize));
+  }
+  clear();
+  return buffer != nullptr;
+}
+
+void OLEDDisplay::end() {
+  free(buffer);
+  buffer = nullptr;
+}
+
+void OLEDDisplay::setColor(OLEDDISPLAY_COLOR newColor) {
+  color = newColor;
+}
+
+void OLEDDisplay::setPixel(int16_t x, int16_t y) {
+  if (x < 0 || x >= displayWidth || y < 0 || y >= displayHeight) {
+    return;
+  }
+  uint8_t &b = buffer[x + (y / 8) * displayWidth];
+  uint8_t bit = 1 << (y & 7);
+  switch (color) {
+    case WHITE:
+      b |= bit;
+      break;
+    case BLACK:
+      b &= ~bit;
+      break;
+    case INVERSE:
+      b ^= bit;
+      break;
+  }
+}
+
+void OLEDDisplay::drawHorizontalLine(int16_t x, int16_t y, int16_t length) {
+  for (int16_t i = 0; i < length; i++) {
+    setPixel(x + i, y);
+  }
+}
+
+void OLEDDisplay::drawVerticalLine(int16_t x, int16_t y, int16_t length) {
+  for (int16_t i = 0; i < length; i++) {
+    setPixel(x, y + i);
+  }
+}
+
+void OLEDDisplay::drawRect(int16_t x, int16_t y, int16_t width, int16_t height) {
+  drawHorizontalLine(x, y, width);
+  drawVerticalLine(x, y, height);
+  drawVerticalLine(x + width - 1, y, height);
+  drawHorizontalLine(x, y + height - 1, width);
+}
+
+void OLEDDisplay::fillRect(int16_t x, int16_t y, int16_t width, int16_t height) {
+  for (int16_t i = 0; i < width; i++) {
+    drawVerticalLine(x + i, y, height);
+  }
+}
+
+void OLEDDisplay::drawProgressBar(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+                                  uint8_t progress) {
+  // The real implementation has rounded corners; the pages and columns it touches are the same
+  uint16_t radius = height / 2;
+  uint16_t maxProgressWidth = (width - 2 * radius + 1) * progress / 100;
+  setColor(WHITE);
+  drawRect(x, y, width + 1, height + 1);
+  fillRect(x + 2, y + 2, radius - 1 + maxProgressWidth, height - 3);
+}
+
+void OLEDDisplay::drawXbm(int16_t xMove, int16_t yMove, int16_t width, int16_t height,
+                          const uint8_t *xbm) {
+  int16_t widthInXbm = (width + 7) / 8;
+  for (int16_t y = 0; y < height; y++) {
+    for (int16_t x = 0; x < width; x++) {
+      if (pgm_read_byte(xbm + y * widthInXbm + x / 8) & (1 << (x & 7))) {
+        setPixel(xMove + x, yMove + y);
+      }
+    }
+  }
+}
+
+void OLEDDisplay::drawString(int16_t x, int16_t y, const String &text) {
+  // Like the real implementation, which allocates a copy to convert UTF-8 into extended ASCII
+  uint16_t length = text.length();
+  char *ascii = static_cast<char *>(malloc(length + 1));
+  memcpy(ascii, text.c_str(), length + 1);
+  drawStringInternal(x, y, ascii, length, getStringWidth(ascii, length));
+  free(ascii);
+}
+
+uint16_t OLEDDisplay::getStringWidth(const char *text, uint16_t length) {
+  uint8_t firstChar = pgm_read_byte(fontData + FIRST_CHAR_POS);
+  uint16_t width = 0;
+  for (uint16_t i = 0; i < length; i++) {
+    uint8_t code = text[i];
+    if (code >= firstChar) {
+      width += pgm_read_byte(fontData + JUMPTABLE_START + (code - firstChar) * JUMPTABLE_BYTES +
+                             JUMPTABLE_WIDTH);
+    }
+  }
+  return width;
+}
+
+void OLEDDisplay::setTextAlignment(OLEDDISPLAY_TEXT_ALIGNMENT alignment) {
+  textAlignment = alignment;
+}
+
+void OLEDDisplay::setFont(const uint8_t *newFontData) {
+  fontData = newFontData;
+}
+
+void OLEDDisplay::flipScreenVertically() {
+  sendCommand(SEGREMAP | 0x01);
+  sendCommand(COMSCANDEC);
+}
+
+void OLEDDisplay::setBrightness(uint8_t brightness) {
+  sendCommand(SETCONTRAST);
+  sendCommand(brightness);
+}
+
+void OLEDDisplay::clear() {
+  memset(buffer, 0, displayBufferSize);
+}
+
+void OLEDDisplay::drawStringInternal(int16_t xMove, int16_t yMove, char *text,
+                                     uint16_t textLength, uint16_t textWidth) {
+  uint8_t textHeight = pgm_read_byte(fontData + HEIGHT_POS);
+  uint8_t firstChar = pgm_read_byte(fontData + FIRST_CHAR_POS);
+  uint16_t sizeOfJumpTable = pgm_read_byte(fontData + CHAR_NUM_POS) * JUMPTABLE_BYTES;
+  uint8_t rasterHeight = 1 + ((textHeight - 1) >> 3);
+
+  switch (textAlignment) {
+    case TEXT_ALIGN_CENTER_BOTH:
+      yMove -= textHeight >> 1;
+      // Fallthrough
+    case TEXT_ALIGN_CENTER:
+      xMove -= textWidth >> 1;
+      break;
+    case TEXT_ALIGN_RIGHT:
+      xMove -= textWidth;
+      break;
+    case TEXT_ALIGN_LEFT:
+      break;
+  }
+
+  uint16_t cursorX = 0;
+  for (uint16_t j = 0; j < textLength; j++) {
+    uint8_t code = text[j];
+    if (code < firstChar) {
+      continue;
+    }
+    const uint8_t *entry = fontData + JUMPTABLE_START + (code - firstChar) * JUMPTABLE_BYTES;
+    uint8_t msbJumpToChar = pgm_read_byte(entry);
+    uint8_t lsbJumpToChar = pgm_read_byte(entry + JUMPTABLE_LSB);
+    uint8_t charByteSize = pgm_read_byte(entry + JUMPTABLE_SIZE);
+    uint8_t currentCharWidth = pgm_read_byte(entry + JUMPTABLE_WIDTH);
+
+    if (!(msbJumpToChar == 255 && lsbJumpToChar == 255)) {
+      const uint8_t *charData =
+          fontData + JUMPTABLE_START + sizeOfJumpTable + ((msbJumpToChar << 8) + lsbJumpToChar);
+      for (uint8_t i = 0; i < charByteSize; i++) {
+        uint8_t bits = pgm_read_byte(charData + i);
+        int16_t x = xMove + cursorX + i / rasterHeight;
+        int16_t y = yMove + (i % rasterHeight) * 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+          if (bits & (1 << bit)) {
+            setPixel(x, y + bit);
+          }
+        }
+      }
+    }
+    cursorX += currentCharWidth;
+  }
+}
@@ -0,0 +1,149 @@
+/**
+ * Simulated data partitions; see `esp_partition.h`.
+ */
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include "esp_partition.h"
+#include "sim.h"
+
+namespace {
+
+// Like partitions.csv
+const esp_partition_t partitions[] = {
+    {ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, 0x290000, 0x160000, "spiffs",
+     false},
+    {ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)0x40, 0x3F0000, 0x10000, "plans", false},
+};
+const size_t PARTITIONS = sizeof(partitions) / sizeof(partitions[0]);
+
+// Typical timing of the flash chip: 45 ms to erase a sector, 0.7 ms to program a 256 bytes page
+const uint64_t SECTOR_ERASE_MICROS = 45000;
+const uint64_t PAGE_PROGRAM_MICROS = 700;
+const size_t PAGE_SIZE = 256;
+
+std::mutex flashMutex;
+std::vector<uint8_t> flash[PARTITIONS];
+
+/**
+ * Get the file the given partition is loaded from, and for the SPIFFS partition saved to, if any.
+ */
+const char *fileOf(size_t index) {
+  return index == 0 ? sim::flashFile() : sim::plansFile();
+}
+
+void save(size_t index) {
+  if (index == 0 && fileOf(index)) {
+    FILE *file = fopen(fileOf(index), "wb");
+    if (file) {
+      fwrite(flash[index].data(), 1, flash[index].size(), file);
+      fclose(file);
+    }
+  }
+}
+
+/**
+ * Get the index of the given partition, or PARTITIONS if it is not one of ours.
+ */
+size_t indexOf(const esp_partition_t *partition) {
+  return partition >= partitions && partition < partitions + PARTITIONS ? partition - partitions
+                                                                        : PARTITIONS;
+}
+
+bool isInRange(size_t index, size_t offset, size_t size) {
+  return index < PARTITIONS && offset <= partitions[index].size &&
+         size <= partitions[index].size - offset;
+}
+
+} // namespace
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char *label) {
+  for (size_t i = 0; i < PARTITIONS; i++) {
+    const esp_partition_t &partition = partitions[i];
+    if (type != partition.type ||
+        (subtype != partition.subtype && subtype != ESP_PARTITION_SUBTYPE_ANY) ||
+        (label && strcmp(label, partition.label) != 0)) {
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(flashMutex);
+    if (flash[i].empty()) {
+      flash[i].assign(partition.size, 0xFF);
+      FILE *file = fileOf(i) ? fopen(fileOf(i), "rb") : nullptr;
+      if (file) {
+        size_t count = fread(flash[i].data(), 1, flash[i].size(), file);
+        (void)count;
+        fclose(file);
+      }
+    }
+    return &partition;
+  }
+  return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst,
+                             size_t size) {
+  size_t index = indexOf(partition);
+  if (!isInRange(index, src_offset, size)) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  std::lock_guard<std::mutex> lock(flashMutex);
+  memcpy(dst, flash[index].data() + src_offset, size);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset,
+                              const void *src, size_t size) {
+  size_t index = indexOf(partition);
+  if (!isInRange(index, dst_offset, size)) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  {
+    std::lock_guard<std::mutex> lock(flashMutex);
+    const auto *bytes = static_cast<const uint8_t *>(src);
+    for (size_t i = 0; i < size; i++) {
+      flash[index][dst_offset + i] &= bytes[i];
+    }
+    save(index);
+  }
+  sim::busyMicros((size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_PROGRAM_MICROS);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t start_addr,
+                                    size_t size) {
+  size_t index = indexOf(partition);
+  if (index == PARTITIONS || start_addr % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!isInRange(index, start_addr, size)) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  {
+    std::lock_guard<std::mutex> lock(flashMutex);
+    memset(flash[index].data() + start_addr, 0xFF, size);
+    save(index);
+  }
+  sim::busyMicros(size / SPI_FLASH_SEC_SIZE * SECTOR_ERASE_MICROS);
+  return ESP_OK;
+}
+
+/**
+ * Map the partition's contents. Unlike the ESP32, where the mapping reads the flash through the
+ * cache, writes are visible right away; the firmware only maps what it never writes.
+ */
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size,
+                             spi_flash_mmap_memory_t memory, const void **out_ptr,
+                             spi_flash_mmap_handle_t *out_handle) {
+  size_t index = indexOf(partition);
+  if (memory != SPI_FLASH_MMAP_DATA || !isInRange(index, offset, size)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  *out_ptr = flash[index].data() + offset;
+  *out_handle = index;
+  return ESP_OK;
+}
+
+void spi_flash_munmap(spi_flash_mmap_handle_t handle) {}
@@ -0,0 +1,21 @@
+/**
+ * Host-native stand-in for the part of the MCCI LMIC Arduino HAL that the simulated run loop uses.
+ * Like in the real library, this is not in the same file as its caller, so the linker can redirect
+ * the calls; see `-Wl,--wrap=hal_sleep` and `-Wl,--wrap=hal_waitUntil` in `platformio.ini`.
+ */
+#include "lmic.h"
+#include "sim.h"
+
+void hal_sleep() {
+  // The real HAL does nothing, and the real run loop spins; to spare the host, sleep a little
+  sim::sleepMicros(1000);
+}
+
+u4_t hal_waitUntil(u4_t time) {
+  ostime_t delta = (ostime_t)time - os_getTime();
+  if (delta > 0) {
+    sim::sleepMicros(osticks2us(delta));
+    return 0;
+  }
+  return -delta;
+}
@@ -0,0 +1,555 @@
+/**
+ * Simulated MCCI LMIC for the host-native build: the job scheduler, the EU868 channel and duty
+ * cycle bookkeeping, and a class A radio and network, following the timing of LMIC v3.2.0.
+ *
+ * The network receives an uplink if its SNR is above the demodulation floor of its data rate. For
+ * a confirmed uplink it responds in RX1, or in RX2 if the gateway is busy. The downlink is only
+ * received if it is strong enough, and if its preamble falls within the receive window that LMIC
+ * opened. The board detects the end of a transmission a bit late (SIM_LATENCY_MS), which shifts
+ * that window just like it does on real hardware; the LMIC clock error compensates for that.
+ *
+ * Retries of confirmed uplinks, MAC commands and payload encryption are not simulated.
+ */
+#include <cmath>
+#include "Arduino.h"
+#include "Wire.h"
+#include "lmic.h"
+#include "hal/hal.h"
+#include "logger.h"
+#include "sim.h"
+
+lmic_t LMIC;
+
+namespace {
+
+const ostime_t TX_RAMPUP = us2osticks(2000);
+const ostime_t RX_RAMPUP = us2osticks(2000);
+const u1_t PAMBL_SYMS = 8;
+const u1_t MINRX_SYMS = 6;
+// The number of preamble symbols the radio needs to detect a downlink
+const u1_t DETECT_SYMS = 4;
+const u4_t FREQ_DNW2 = 869525000;
+// Chance that the network uses RX1 rather than RX2 for a downlink
+const u4_t RX1_PERCENTAGE = 90;
+// The gateways in reach, each this much further away than the previous, as seen in the SNR
+const u1_t GATEWAYS = 3;
+const double GATEWAY_SNR_STEP = 6;
+// The CID of LinkCheckReq and LinkCheckAns
+const u1_t LINK_CHECK_CID = 0x02;
+
+osjob_t *scheduledJobs = nullptr;
+
+// The actual end of the current transmission, and whether the network received it
+ostime_t txEndTime;
+bool isUplinkReceived;
+// For a LinkCheckReq: the number of gateways that received the uplink, and the best SNR
+bool isLinkCheck;
+u1_t gatewayCount;
+double uplinkSnr;
+// The receive window the network uses for its downlink, if any, and the window LMIC is handling
+u1_t downlinkWindow;
+u1_t rxWindow;
+u4_t networkSeqnoDn;
+// The actual end of the current downlink
+ostime_t rxEndTime;
+
+// The SX1276 LoRa registers that hal_spi_read provides, as set for the last downlink
+const u1_t REG_PKT_SNR_VALUE = 0x19;
+const u1_t REG_PKT_RSSI_VALUE = 0x1A;
+const u1_t REG_FEI_MSB = 0x28;
+const u1_t RADIO_REGISTERS = 0x80;
+u1_t radioRegisters[RADIO_REGISTERS];
+
+struct DataRateReport {
+  u4_t uplinks;
+  s8_t airtimeUs;
+  u4_t received;
+  u4_t rx1;
+  u4_t rx2;
+  u4_t missed;
+  // How long the radio listened in the receive windows
+  s8_t rxListenUs;
+};
+
+DataRateReport reports[DR_NONE];
+s8_t bandAirtimeUs[MAX_BANDS];
+
+u1_t spreadingFactor(dr_t dr) {
+  return dr == DR_SF7B ? 7 : 12 - dr;
+}
+
+u4_t bandwidthKHz(dr_t dr) {
+  return dr == DR_SF7B ? 250 : 125;
+}
+
+double symbolUs(dr_t dr) {
+  return (1 << spreadingFactor(dr)) * 1000.0 / bandwidthKHz(dr);
+}
+
+/**
+ * LoRa time on air in microseconds, for an explicit header, coding rate 4/5 and 8 preamble
+ * symbols; uplinks have a payload CRC, downlinks do not.
+ */
+s8_t airtimeUs(dr_t dr, u1_t length, bool crc) {
+  if (dr == DR_FSK) {
+    // 50 kbps, 5 bytes preamble, 3 bytes sync word, 1 byte length, 2 bytes CRC
+    return (5 + 3 + 1 + length + 2) * 8 * 1000000LL / 50000;
+  }
+  int sf = spreadingFactor(dr);
+  int de = bandwidthKHz(dr) == 125 && sf >= 11 ? 1 : 0;
+  int bits = 8 * length - 4 * sf + 28 + (crc ? 16 : 0);
+  int payloadSymbols = 8 + std::max((bits + 4 * (sf - 2 * de) - 1) / (4 * (sf - 2 * de)), 0) * 5;
+  return (s8_t)((PAMBL_SYMS + 4.25 + payloadSymbols) * symbolUs(dr));
+}
+
+double snrFloor(dr_t dr) {
+  return -5 - 2.5 * (spreadingFactor(dr) - 6);
+}
+
+void unlinkJob(osjob_t *job) {
+  for (osjob_t **pnext = &scheduledJobs; *pnext; pnext = &(*pnext)->next) {
+    if (*pnext == job) {
+      *pnext = job->next;
+      return;
+    }
+  }
+}
+
+void initDefaultChannels() {
+  for (u1_t i = 0; i < MAX_CHANNELS; i++) {
+    LMIC.channelFreq[i] = 0;
+    LMIC.channelDrMap[i] = 0;
+  }
+  const u4_t defaultFreqs[] = {868100000, 868300000, 868500000};
+  for (u1_t i = 0; i < 3; i++) {
+    LMIC.channelFreq[i] = defaultFreqs[i] | BAND_CENTI;
+    LMIC.channelDrMap[i] = DR_RANGE_MAP(DR_SF12, DR_SF7);
+  }
+  LMIC.channelMap = 0x07;
+
+  const u2_t txcaps[MAX_BANDS] = {1000, 100, 10, 0};
+  const s1_t txpows[MAX_BANDS] = {14, 14, 27, 0};
+  for (u1_t b = 0; b < MAX_BANDS; b++) {
+    LMIC.bands[b].txcap = txcaps[b];
+    LMIC.bands[b].txpow = txpows[b];
+    LMIC.bands[b].lastchnl = sim::random(MAX_CHANNELS);
+    LMIC.bands[b].avail = os_getTime();
+  }
+}
+
+/**
+ * Select the channel that becomes available first, like LMICeu868_nextTx, and return the time it
+ * becomes available.
+ */
+ostime_t nextTx(ostime_t now) {
+  u1_t bmap = 0xF;
+  while (true) {
+    ostime_t mintime = now + sec2osticks(28800);
+    u1_t band = 0;
+    for (u1_t bi = 0; bi < MAX_BANDS; bi++) {
+      if ((bmap & (1 << bi)) && mintime - LMIC.bands[bi].avail > 0) {
+        mintime = LMIC.bands[band = bi].avail;
+      }
+    }
+    u1_t chnl = LMIC.bands[band].lastchnl;
+    for (u1_t ci = 0; ci < MAX_CHANNELS; ci++) {
+      if ((chnl = (chnl + 1)) >= MAX_CHANNELS) {
+        chnl -= MAX_CHANNELS;
+      }
+      if ((LMIC.channelMap & (1 << chnl)) && (LMIC.channelDrMap[chnl] & (1 << LMIC.datarate)) &&
+          band == (LMIC.channelFreq[chnl] & 0x3)) {
+        LMIC.txChnl = LMIC.bands[band].lastchnl = chnl;
+        return mintime;
+      }
+    }
+    if ((bmap &= ~(1 << band)) == 0) {
+      return mintime;
+    }
+  }
+}
+
+void buildDataFrame() {
+  u1_t *f = LMIC.frame;
+  f[0] = LMIC.pendTxConf ? 0x80 : 0x40;
+  f[1] = LMIC.devaddr;
+  f[2] = LMIC.devaddr >> 8;
+  f[3] = LMIC.devaddr >> 16;
+  f[4] = LMIC.devaddr >> 24;
+  f[5] = LMIC.adrEnabled ? 0x80 : 0x00;
+  f[6] = LMIC.seqnoUp;
+  f[7] = LMIC.seqnoUp >> 8;
+  f[8] = LMIC.pendTxPort;
+  memcpy(f + 9, LMIC.pendTxData, LMIC.pendTxLen);
+  u1_t end = 9 + LMIC.pendTxLen;
+  // Not a real MIC
+  for (u1_t i = 0; i < 4; i++) {
+    f[end + i] = (LMIC.seqnoUp * 0x9E3779B1u) >> (8 * i);
+  }
+  LMIC.dataLen = end + 4;
+  LMIC.seqnoUp += 1;
+}
+
+void runEngineUpdate(osjob_t *job);
+void onRxWindow(osjob_t *job);
+
+void complete(u1_t txrxFlags) {
+  LMIC.txrxFlags = txrxFlags;
+  LMIC.opmode &= ~(OP_TXDATA | OP_TXRXPEND);
+  onEvent(EV_TXCOMPLETE);
+  runEngineUpdate(&LMIC.osjob);
+}
+
+dr_t rxDataRate() {
+  return rxWindow == 1 ? LMIC.datarate : LMIC.dn2Dr;
+}
+
+/**
+ * Set LMIC.rxtime to when the radio should start listening, like LMICcore_adjustForDrift widening
+ * the receive window for the clock error, and schedule the window.
+ */
+void scheduleRxWindow(u1_t window) {
+  rxWindow = window;
+  ostime_t delay = sec2osticks(window == 1 ? LMIC.rxDelay : LMIC.rxDelay + 1);
+  ostime_t hsym = us2osticks(symbolUs(rxDataRate()) / 2);
+  ostime_t rxsyms = MINRX_SYMS;
+  if (LMIC.client.clockError != 0) {
+    ostime_t drift = (s8_t)delay * LMIC.client.clockError / MAX_CLOCK_ERROR;
+    delay -= drift;
+    rxsyms = std::min(rxsyms + drift / hsym, (ostime_t)255);
+  }
+  LMIC.rxsyms = rxsyms;
+  LMIC.rxtime = LMIC.txend + delay + (PAMBL_SYMS - rxsyms) * hsym;
+  // Like LMIC, run the job a bit early, and then busy-wait until the radio should start listening
+  os_setTimedCallback(&LMIC.osjob, LMIC.rxtime - RX_RAMPUP, onRxWindow);
+}
+
+/**
+ * Set the packet SNR and RSSI registers like the SX1276 does for a downlink with the SNR and RSSI
+ * of LMIC, and the frequency error for a radio crystal that is off by SIM_CRYSTAL_PPM.
+ */
+void setRadioRegisters(dr_t dr) {
+  int rssi = LMIC.rssi - RSSI_OFF;
+  int pktRssi = LMIC.snr >= 0 ? (rssi + 157) * 15 / 16 : rssi + 157 - LMIC.snr / 4;
+  radioRegisters[REG_PKT_SNR_VALUE] = (u1_t)LMIC.snr;
+  radioRegisters[REG_PKT_RSSI_VALUE] = (u1_t)std::max(std::min(pktRssi, 255), 0);
+
+  // The received signal is lower than the radio expects if its crystal runs fast; FEI in units of
+  // 2^24 / 32 MHz * BW / 500 kHz
+  double errorHz = -sim::gaussian(sim::crystalPpm(), 0.2) * LMIC.freq / 1E6;
+  s4_t fei = (s4_t)std::lround(errorHz * 32E6 / (1 << 24) * 500 / bandwidthKHz(dr));
+  radioRegisters[REG_FEI_MSB] = (fei >> 16) & 0x0F;
+  radioRegisters[REG_FEI_MSB + 1] = fei >> 8;
+  radioRegisters[REG_FEI_MSB + 2] = fei;
+}
+
+void onRxDone(osjob_t *job) {
+  // The radio signals the end of the reception on DIO0
+  sim::raiseInterrupt(lmic_pins.dio[0], sim::micros() - osticks2us(os_getTime() - rxEndTime));
+  LMIC.rxtime = job->deadline;
+  LMIC.seqnoDn = ++networkSeqnoDn;
+  LMIC.frame[0] = 0x60;
+  LMIC.frame[5] = LMIC.pendTxConf ? 0x20 : 0x00;
+  LMIC.frame[6] = networkSeqnoDn - 1;
+  LMIC.frame[7] = (networkSeqnoDn - 1) >> 8;
+  LMIC.dataBeg = 8;
+  LMIC.dataLen = 0;
+  if (isLinkCheck) {
+    // LinkCheckAns in the FOpts, with the margin rounded down to whole dB
+    double margin = uplinkSnr - snrFloor(LMIC.datarate);
+    LMIC.frame[5] |= 3;
+    LMIC.frame[8] = LINK_CHECK_CID;
+    LMIC.frame[9] = (u1_t)std::min(margin, 254.0);
+    LMIC.frame[10] = gatewayCount;
+    LMIC.dataBeg = 11;
+  }
+
+  setRadioRegisters(rxDataRate());
+
+  DataRateReport &report = reports[LMIC.datarate];
+  (rxWindow == 1 ? report.rx1 : report.rx2)++;
+  complete((rxWindow == 1 ? TXRX_DNW1 : TXRX_DNW2) | (LMIC.pendTxConf ? TXRX_ACK : 0) |
+           (isLinkCheck ? TXRX_NOPORT : 0));
+}
+
+void onRxTimeout(__unused osjob_t *job) {
+  if (rxWindow == 1) {
+    // Like LMIC: only after RX1 timed out, set the time for RX2
+    scheduleRxWindow(2);
+    return;
+  }
+  LMIC.dataLen = 0;
+  complete(LMIC.pendTxConf ? TXRX_NACK : 0);
+}
+
+void onRxWindow(__unused osjob_t *job) {
+  hal_waitUntil(LMIC.rxtime);
+  dr_t dr = rxDataRate();
+  double symbol = symbolUs(dr);
+
+  if (downlinkWindow == rxWindow) {
+    // The network sends at exactly the nominal time, relative to the actual end of the uplink
+    ostime_t preamble = txEndTime + sec2osticks(rxWindow == 1 ? LMIC.rxDelay : LMIC.rxDelay + 1);
+    ostime_t earliest = LMIC.rxtime - us2osticks((PAMBL_SYMS - DETECT_SYMS) * symbol);
+    ostime_t latest = LMIC.rxtime + us2osticks((LMIC.rxsyms - DETECT_SYMS) * symbol);
+    double snr = sim::gaussian(sim::snr(), 3);
+    if (preamble - earliest >= 0 && preamble - latest <= 0 && snr >= snrFloor(dr)) {
+      if (rxWindow == 2) {
+        LMIC.freq = LMIC.dn2Freq;
+      }
+      LMIC.snr = (s1_t)std::lround(snr * 4);
+      LMIC.rssi = (s1_t)(std::lround(-115 + std::min(snr, 0.0)) + RSSI_OFF);
+      // The board detects the end of the reception late, just like the end of a transmission. The
+      // downlink holds the MHDR, FHDR and MIC, and LinkCheckAns in the FOpts if requested.
+      u1_t length = isLinkCheck ? 15 : 12;
+      rxEndTime = preamble + us2osticks(airtimeUs(dr, length, false));
+      ostime_t rxDone = rxEndTime + ms2osticks(sim::latencyMs());
+      reports[LMIC.datarate].rxListenUs += osticks2us(rxDone - LMIC.rxtime);
+      os_setTimedCallback(&LMIC.osjob, rxDone, onRxDone);
+      return;
+    }
+    reports[LMIC.datarate].missed++;
+  }
+
+  reports[LMIC.datarate].rxListenUs += (s8_t)(LMIC.rxsyms * symbol);
+  os_setTimedCallback(&LMIC.osjob, LMIC.rxtime + us2osticks(LMIC.rxsyms * symbol), onRxTimeout);
+}
+
+void onTxDone(osjob_t *job) {
+  txEndTime = job->deadline;
+  // The radio signals the end of the transmission on DIO0
+  sim::raiseInterrupt(lmic_pins.dio[0], sim::micros() - osticks2us(os_getTime() - txEndTime));
+  double latencyMs = std::max(sim::gaussian(sim::latencyMs(), sim::latencyMs() / 4.0), 0.0);
+  LMIC.txend = txEndTime + ms2osticks(latencyMs);
+  scheduleRxWindow(1);
+}
+
+void startTx(ostime_t txbeg) {
+  buildDataFrame();
+
+  u4_t freq = LMIC.channelFreq[LMIC.txChnl];
+  band_t &band = LMIC.bands[freq & 0x3];
+  LMIC.freq = freq & ~(u4_t)3;
+  LMIC.txpow = std::min(band.txpow, LMIC.adrTxPow);
+  s8_t airtime = airtimeUs(LMIC.datarate, LMIC.dataLen, true);
+  ostime_t airtimeTicks = us2osticks(airtime);
+  band.avail = txbeg + airtimeTicks * band.txcap;
+  if (LMIC.globalDutyRate != 0) {
+    LMIC.globalDutyAvail = txbeg + (airtimeTicks << LMIC.globalDutyRate);
+  }
+  LMIC.opmode = (LMIC.opmode & ~(OP_POLL | OP_RNDTX)) | OP_TXRXPEND | OP_NEXTCHNL;
+
+  DataRateReport &report = reports[LMIC.datarate];
+  report.uplinks++;
+  report.airtimeUs += airtime;
+  bandAirtimeUs[freq & 0x3] += airtime;
+  gatewayCount = 0;
+  for (u1_t i = 0; i < GATEWAYS; i++) {
+    double snr = sim::gaussian(sim::snr() - i * GATEWAY_SNR_STEP, 3);
+    if (snr >= snrFloor(LMIC.datarate)) {
+      uplinkSnr = gatewayCount++ ? std::max(uplinkSnr, snr) : snr;
+    }
+  }
+  isUplinkReceived = gatewayCount > 0;
+  if (isUplinkReceived) {
+    report.received++;
+  }
+  isLinkCheck =
+      LMIC.pendTxPort == 0 && LMIC.pendTxLen && LMIC.pendTxData[0] == LINK_CHECK_CID;
+  downlinkWindow = 0;
+  if (isUplinkReceived && (LMIC.pendTxConf || isLinkCheck)) {
+    downlinkWindow = sim::random(100) < RX1_PERCENTAGE ? 1 : 2;
+  }
+
+  // Like LMIC, only start the radio after reporting EV_TXSTART
+  onEvent(EV_TXSTART);
+  os_setTimedCallback(&LMIC.osjob, os_getTime() + airtimeTicks, onTxDone);
+}
+
+void engineUpdate() {
+  if ((LMIC.opmode & OP_TXRXPEND) || !(LMIC.opmode & OP_TXDATA)) {
+    return;
+  }
+  ostime_t now = os_getTime();
+  ostime_t txbeg;
+  if (LMIC.opmode & OP_NEXTCHNL) {
+    txbeg = LMIC.txend = nextTx(now);
+    LMIC.opmode &= ~OP_NEXTCHNL;
+  } else {
+    txbeg = LMIC.txend;
+  }
+  if (LMIC.globalDutyRate != 0 && txbeg - LMIC.globalDutyAvail < 0) {
+    txbeg = LMIC.globalDutyAvail;
+  }
+  if (txbeg - (now + TX_RAMPUP) < 0) {
+    startTx(now);
+    return;
+  }
+  os_setTimedCallback(&LMIC.osjob, txbeg - TX_RAMPUP, runEngineUpdate);
+}
+
+void runEngineUpdate(__unused osjob_t *job) {
+  engineUpdate();
+}
+
+} // namespace
+
+void os_init() {
+  scheduledJobs = nullptr;
+}
+
+ostime_t os_getTime() {
+  return (ostime_t)(sim::micros() >> US_PER_OSTICK_EXPONENT);
+}
+
+void os_setCallback(osjob_t *job, osjobcb_t cb) {
+  os_setTimedCallback(job, os_getTime(), cb);
+}
+
+void os_setTimedCallback(osjob_t *job, ostime_t time, osjobcb_t cb) {
+  unlinkJob(job);
+  job->deadline = time;
+  job->func = cb;
+  osjob_t **pnext = &scheduledJobs;
+  while (*pnext && (*pnext)->deadline - time <= 0) {
+    pnext = &(*pnext)->next;
+  }
+  job->next = *pnext;
+  *pnext = job;
+}
+
+void os_clearCallback(osjob_t *job) {
+  unlinkJob(job);
+}
+
+void os_runloop_once() {
+  ostime_t now = os_getTime();
+  osjob_t *job = scheduledJobs;
+  if (job && job->deadline - now <= 0) {
+    scheduledJobs = job->next;
+    job->func(job);
+    return;
+  }
+  // Like LMIC, tell the HAL that no job is due
+  hal_sleep();
+}
+
+bit_t os_queryTimeCriticalJobs(ostime_t time) {
+  return scheduledJobs && scheduledJobs->deadline - time < 0;
+}
+
+void LMIC_reset() {
+  LMIC = lmic_t{};
+  unlinkJob(&LMIC.osjob);
+  LMIC.opmode = OP_NONE;
+  LMIC.adrEnabled = 1;
+  LMIC.adrTxPow = 14;
+  LMIC.datarate = DR_SF12;
+  LMIC.rxDelay = 1;
+  LMIC.dn2Freq = FREQ_DNW2;
+  LMIC.dn2Dr = DR_SF12;
+  initDefaultChannels();
+}
+
+void LMIC_setSession(__unused u4_t netid, u4_t devaddr, __unused const u1_t *nwkKey,
+                     __unused const u1_t *artKey) {
+  LMIC.devaddr = devaddr;
+  initDefaultChannels();
+  LMIC.opmode &= ~(OP_JOINING | OP_TRACK | OP_REJOIN | OP_TXRXPEND | OP_PINGINI);
+  LMIC.opmode |= OP_NEXTCHNL;
+}
+
+bit_t LMIC_setupChannel(u1_t channel, u4_t freq, u2_t drmap, s1_t band) {
+  // Like LMIC: the three default channels cannot be changed
+  if (channel < 3 || channel >= MAX_CHANNELS || band < 0 || band > BAND_AUX) {
+    return 0;
+  }
+  LMIC.channelFreq[channel] = (freq & ~(u4_t)3) | band;
+  LMIC.channelDrMap[channel] = drmap;
+  LMIC.channelMap |= 1 << channel;
+  return 1;
+}
+
+void LMIC_setAdrMode(bit_t enabled) {
+  LMIC.adrEnabled = enabled;
+}
+
+void LMIC_setLinkCheckMode(__unused bit_t enabled) {}
+
+void LMIC_setDrTxpow(dr_t dr, s1_t txpow) {
+  LMIC.adrTxPow = txpow;
+  if (LMIC.datarate != dr) {
+    LMIC.datarate = dr;
+    LMIC.opmode |= OP_NEXTCHNL;
+  }
+}
+
+void hal_spi_read(u1_t cmd, u1_t *buf, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    buf[i] = radioRegisters[(cmd + i) % RADIO_REGISTERS];
+  }
+}
+
+void LMIC_setClockError(u2_t error) {
+  LMIC.client.clockError = error;
+}
+
+lmic_tx_error_t LMIC_setTxData2(u1_t port, u1_t *data, u1_t dlen, u1_t confirmed) {
+  return LMIC_setTxData2_strict(port, data, dlen, confirmed);
+}
+
+lmic_tx_error_t LMIC_setTxData2_strict(u1_t port, u1_t *data, u1_t dlen, u1_t confirmed) {
+  if (dlen > MAX_LEN_PAYLOAD) {
+    return LMIC_ERROR_TX_TOO_LARGE;
+  }
+  if (data) {
+    memcpy(LMIC.pendTxData, data, dlen);
+  }
+  LMIC.pendTxConf = confirmed;
+  LMIC.pendTxPort = port;
+  LMIC.pendTxLen = dlen;
+  LMIC.opmode |= OP_TXDATA;
+  LMIC.txCnt = 0;
+  engineUpdate();
+  return LMIC_ERROR_SUCCESS;
+}
+
+void LMIC_clrTxData() {
+  if (!(LMIC.opmode & OP_TXDATA) || (LMIC.opmode & OP_TXRXPEND)) {
+    return;
+  }
+  LMIC.pendTxLen = 0;
+  LMIC.opmode &= ~(OP_TXDATA | OP_POLL);
+  os_clearCallback(&LMIC.osjob);
+  onEvent(EV_TXCANCELED);
+}
+
+void sim::report() {
+  double hours = sim::micros() / 3600E6;
+  printf("\n==========\n");
+  printf("Simulated %.1f hours at %.0fx real time\n", hours, sim::speed());
+  u4_t total = 0;
+  s8_t totalAirtimeUs = 0;
+  for (dr_t dr = DR_SF12; dr <= DR_SF7; dr++) {
+    total += reports[dr].uplinks;
+    totalAirtimeUs += reports[dr].airtimeUs;
+  }
+  printf("Uplinks: %u (%.1f per hour); airtime %.1f sec (%.2f%%)\n", total, total / hours,
+         totalAirtimeUs / 1E6, totalAirtimeUs / (hours * 36E6));
+  for (dr_t dr = DR_SF7 + 1; dr-- > DR_SF12;) {
+    const DataRateReport &r = reports[dr];
+    printf("  SF%-2d %6u uplinks (%6.1f/hour); airtime %7.1f sec; received %6u; downlinks rx1 "
+           "%5u, rx2 %5u, missed %5u; listening %6.1f sec\n",
+           spreadingFactor(dr), r.uplinks, r.uplinks / hours, r.airtimeUs / 1E6, r.received, r.rx1,
+           r.rx2, r.missed, r.rxListenUs / 1E6);
+  }
+  const char *bandNames[MAX_BANDS] = {"BAND_MILLI", "BAND_CENTI", "BAND_DECI", "BAND_AUX"};
+  for (u1_t b = 0; b < MAX_BANDS; b++) {
+    if (bandAirtimeUs[b]) {
+      printf("  %-10s airtime %7.1f sec (%.2f%%)\n", bandNames[b], bandAirtimeUs[b] / 1E6,
+             bandAirtimeUs[b] / (hours * 36E6));
+    }
+  }
+  printf("Display: %.0f I2C bytes per second\n", Wire.bytesTransmitted() / (hours * 3600));
+  printf("Logger: %u lines dropped\n", Logger::getDroppedCount());
+  fflush(stdout);
+}
@@ -0,0 +1,35 @@
+/**
+ * Global `new` and `delete` using `malloc` and `free`, like on the ESP32. The host's C++ runtime is
+ * a shared library, whose calls to `malloc` the linker cannot redirect to the allocation counter
+ * in `heapstats.cpp`.
+ */
+#include <cstdlib>
+#include <new>
+
+void *operator new(size_t size) {
+  void *ptr = malloc(size);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void *ptr, __attribute__((unused)) size_t size) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void *ptr, __attribute__((unused)) size_t size) noexcept {
+  free(ptr);
+}
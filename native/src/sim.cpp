@@ -0,0 +1,112 @@
+/**
+ * Virtual clock for the host-native simulation; see `sim.h`.
+ */
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <thread>
+#include "sim.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+Clock::time_point bootTime = Clock::now(); // NOLINT(cert-err58-cpp)
+
+double speedFactor = 1000;
+double durationHours = 24;
+double meanSnr = 0;
+uint32_t latency = 8;
+double crystalOffset = 10;
+const char *flash = nullptr;
+const char *plans = nullptr;
+
+std::mutex randomMutex;
+std::mt19937 generator(1); // NOLINT(cert-msc32-c)
+
+// Blocking I/O time not yet slept, in virtual microseconds
+thread_local uint64_t busyDebt = 0;
+
+double envOrDefault(const char *name, double defaultValue) {
+  const char *value = std::getenv(name);
+  return value ? std::atof(value) : defaultValue;
+}
+
+} // namespace
+
+namespace sim {
+
+void begin() {
+  speedFactor = envOrDefault("SIM_SPEED", speedFactor);
+  durationHours = envOrDefault("SIM_HOURS", durationHours);
+  meanSnr = envOrDefault("SIM_SNR", meanSnr);
+  latency = (uint32_t)envOrDefault("SIM_LATENCY_MS", latency);
+  crystalOffset = envOrDefault("SIM_CRYSTAL_PPM", crystalOffset);
+  generator.seed((uint32_t)envOrDefault("SIM_SEED", 1));
+  flash = std::getenv("SIM_FLASH");
+  plans = std::getenv("SIM_PLANS");
+  bootTime = Clock::now();
+}
+
+uint64_t micros() {
+  auto realNs = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - bootTime);
+  return (uint64_t)(realNs.count() * speedFactor / 1000);
+}
+
+void sleepMicros(uint64_t us) {
+  std::this_thread::sleep_for(std::chrono::nanoseconds((int64_t)(us * 1000 / speedFactor)));
+}
+
+void busyMicros(uint64_t us) {
+  busyDebt += us;
+  // Sleeping for less than about 100 real microseconds is not accurate on most hosts
+  if (busyDebt * 1000 / speedFactor >= 100000) {
+    sleepMicros(busyDebt);
+    busyDebt = 0;
+  }
+}
+
+bool isRunning() {
+  return micros() < (uint64_t)(durationHours * 3600E6);
+}
+
+uint32_t random(uint32_t bound) {
+  std::lock_guard<std::mutex> lock(randomMutex);
+  return std::uniform_int_distribution<uint32_t>(0, bound - 1)(generator);
+}
+
+double gaussian(double mean, double stddev) {
+  std::lock_guard<std::mutex> lock(randomMutex);
+  return std::normal_distribution<double>(mean, stddev)(generator);
+}
+
+double speed() {
+  return speedFactor;
+}
+
+double hours() {
+  return durationHours;
+}
+
+double snr() {
+  return meanSnr;
+}
+
+uint32_t latencyMs() {
+  return latency;
+}
+
+double crystalPpm() {
+  return crystalOffset;
+}
+
+const char *flashFile() {
+  return flash;
+}
+
+const char *plansFile() {
+  return plans;
+}
+
+} // namespace sim
@@ -0,0 +1,21 @@
+/**
+ * Entry point of the host-native simulation: run the unchanged firmware on the virtual clock until
+ * the configured simulated duration has passed, and then report the achieved throughput.
+ */
+#include <cstdlib>
+#include "Arduino.h"
+#include "sim.h"
+
+void setup();
+void loop();
+
+int main() {
+  sim::begin();
+  setup();
+  while (sim::isRunning()) {
+    loop();
+  }
+  sim::report();
+  // Do not wait for the display task, which never ends
+  std::_Exit(0);
+}
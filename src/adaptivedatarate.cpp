@@ -0,0 +1,157 @@
+/**
+ * An adaptive mode for the automatic data rates, which rather than cycling through the data rates
+ * in a fixed order, spends the airtime where the success rate is least certain. SF12 takes about 25
+ * times the airtime of SF7, and hence needs that much more time off due to the duty cycle. So once
+ * SF12 has been acknowledged many times in a row, sending more SF12 uplinks tells little.
+ *
+ * This only uses confirmed uplinks, for which an ACK tells the uplink was received, and the ACK
+ * too. For each data rate the success rate gets a 95% Wilson score interval, which unlike the
+ * normal approximation still makes sense for 0 or 100% success and for few uplinks. The next data
+ * rate is the one for which one more uplink is expected to shrink that interval the most, per
+ * second of airtime. Once the interval of a data rate is at most 2 x TARGET_HALF_WIDTH, it is not
+ * used anymore; for a success rate of 100% that takes about 16 uplinks, and for 50% about 96.
+ *
+ * Unconfirmed uplinks tell nothing, so when the Fair Access Policy governor is enabled, each uplink
+ * waits until a downlink is available for its confirmation; see fairaccess.cpp.
+ */
+#include <cmath>
+#include <cstring>
+#include "adaptivedatarate.h"
+#include "airtime.h"
+#include "logger.h"
+
+// Global singleton instance
+AdaptiveDataRate adaptiveDataRate;
+
+// 95% confidence
+static const float Z = 1.96f;
+static const float TARGET_HALF_WIDTH = 0.1f;
+
+/**
+ * Get the center and the half width of the Wilson score interval for the given success rate of n
+ * uplinks. Without any uplinks, this is the maximum half width of 0.5.
+ */
+static float wilsonInterval(float p, uint32_t n, float &center) {
+  if (!n) {
+    center = 0.5f;
+    return 0.5f;
+  }
+  float zz = Z * Z / n;
+  center = (p + zz / 2) / (1 + zz);
+  return Z / (1 + zz) * sqrtf(p * (1 - p) / n + zz / (4 * n));
+}
+
+bool AdaptiveDataRate::getEnabled() const {
+  return isEnabled;
+}
+
+/**
+ * Enable or disable the adaptive mode, starting over when enabled.
+ */
+void AdaptiveDataRate::setEnabled(bool enabled) {
+  isEnabled = enabled;
+  if (enabled) {
+    memset(counters, 0, sizeof(counters));
+  }
+}
+
+float AdaptiveDataRate::getHalfWidth(dr_t dr) const {
+  const DataRateCounters &c = counters[dr];
+  float center;
+  return wilsonInterval(c.confirmed ? (float)c.acks / c.confirmed : 0, c.confirmed, center);
+}
+
+bool AdaptiveDataRate::isConverged(dr_t dr) const {
+  return getHalfWidth(dr) <= TARGET_HALF_WIDTH;
+}
+
+/**
+ * Tell if the success rate of each of the given data rates, as a bitmask, is known well enough.
+ */
+bool AdaptiveDataRate::isAllConverged(uint16_t candidates) const {
+  for (dr_t dr = 0; dr < TESTED_DATA_RATES; dr++) {
+    if ((candidates >> dr & 1) && !isConverged(dr)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Get the data rate for the next confirmed uplink, out of the given data rates as a bitmask,
+ * expecting the given application payload size. Once all have converged, this keeps returning the
+ * data rate for which the interval is widest.
+ */
+dr_t AdaptiveDataRate::next(uint16_t candidates, uint8_t payloadSize) const {
+  dr_t best = DR_SF7;
+  float bestScore = -1;
+  for (dr_t dr = 0; dr < TESTED_DATA_RATES; dr++) {
+    if (!(candidates >> dr & 1)) {
+      continue;
+    }
+    const DataRateCounters &c = counters[dr];
+    // The expected reduction of the half width, assuming the success rate holds; a data rate that
+    // was not used yet is assumed to have a success rate of 50%
+    float p = c.confirmed ? (float)c.acks / c.confirmed : 0.5f;
+    float center;
+    float reduction = getHalfWidth(dr) - wilsonInterval(p, c.confirmed + 1, center);
+    uint8_t length = Airtime::LORAWAN_OVERHEAD + min(payloadSize, Airtime::maxPayloadLength(dr));
+    float score = reduction / Airtime::dataRateMicros(dr, length);
+    if (isConverged(dr)) {
+      // Only if all have converged; then prefer the widest interval
+      score = -1 + getHalfWidth(dr);
+    }
+    if (score > bestScore) {
+      best = dr;
+      bestScore = score;
+    }
+  }
+  return best;
+}
+
+/**
+ * Log the success rate and confidence interval of a data rate.
+ */
+void AdaptiveDataRate::log(dr_t dr) const {
+  const DataRateCounters &c = counters[dr];
+  float center;
+  float halfWidth =
+      wilsonInterval(c.confirmed ? (float)c.acks / c.confirmed : 0, c.confirmed, center);
+  Logger::logf("Adaptive SF%d: acks=%u/%u; interval=%.0f-%.0f%%; airtime=%.1f s%s", 12 - dr, c.acks,
+               c.confirmed, 100 * max(center - halfWidth, 0.0f),
+               100 * min(center + halfWidth, 1.0f), c.airtimeSeconds,
+               halfWidth <= TARGET_HALF_WIDTH ? "; converged" : "");
+}
+
+/**
+ * Count the result of an uplink, if confirmed, and log the new estimate of its data rate. Only to
+ * be invoked on the LMIC core.
+ */
+void AdaptiveDataRate::add(const UplinkRecord &record) {
+  dr_t dr = recordDataRate(record);
+  if (!isEnabled || dr >= TESTED_DATA_RATES || !(record.flags & RECORD_CONFIRMED)) {
+    return;
+  }
+  DataRateCounters &c = counters[dr];
+  c.confirmed++;
+  c.acks += record.flags & RECORD_ACK ? 1 : 0;
+  c.airtimeSeconds +=
+      Airtime::dataRateMicros(dr, Airtime::LORAWAN_OVERHEAD + record.payloadSize) / 1E6f;
+  log(dr);
+}
+
+/**
+ * Log the estimates of all data rates that were used, and the total number of uplinks and airtime.
+ */
+void AdaptiveDataRate::dump() const {
+  uint32_t uplinks = 0;
+  float airtimeSeconds = 0;
+  for (dr_t dr = 0; dr < TESTED_DATA_RATES; dr++) {
+    if (counters[dr].confirmed) {
+      log(dr);
+      uplinks += counters[dr].confirmed;
+      airtimeSeconds += counters[dr].airtimeSeconds;
+    }
+  }
+  Logger::logf("Adaptive data rate: uplinks=%u; airtime=%.1f s", uplinks, airtimeSeconds);
+}
@@ -0,0 +1,301 @@
+/**
+ * Binary log records, to not spend CPU time and serial bandwidth on formatting text on the device.
+ *
+ * Format strings are identified by their address, so must be string literals. The first time a
+ * format is used, it is assigned the next ID, and the types of its arguments are parsed once. The
+ * format string itself is only sent when a record using it is about to be written for the first
+ * time, so it always precedes that record, even if the records of both cores are interleaved.
+ */
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include "Arduino.h"
+#include "binarylog.h"
+#include "lmic.h"
+
+namespace {
+
+const uint8_t MAX_FORMATS = 64;
+const uint8_t MAX_ARGS = 12;
+
+// The argument types, as stored in Format::args; for integers, lowercase for signed conversions
+// like `%d` and uppercase for unsigned conversions like `%u` and `%x`
+const char ARG_INT = 'i';
+const char ARG_UNSIGNED_INT = 'I';
+const char ARG_LONG = 'l';
+const char ARG_UNSIGNED_LONG = 'L';
+const char ARG_LONG_LONG = 'q';
+const char ARG_UNSIGNED_LONG_LONG = 'Q';
+const char ARG_SIZE = 'z';
+const char ARG_UNSIGNED_SIZE = 'Z';
+const char ARG_POINTER = 'P';
+const char ARG_DOUBLE = 'f';
+const char ARG_STRING = 's';
+
+struct Format {
+  const char *text;
+  // One of the ARG_ values for each argument, null-terminated
+  char args[MAX_ARGS + 1];
+  // Only used by the single task that writes to the serial port
+  bool isWritten;
+};
+
+Format formats[MAX_FORMATS];
+// Entries below this count are never changed, so can be searched without locking
+std::atomic<uint8_t> formatCount{0};
+std::atomic_flag isRegistering = ATOMIC_FLAG_INIT;
+
+/**
+ * Get the argument types for a printf-like format, or false if not supported.
+ */
+bool parseArgs(const char *format, char *args) {
+  uint8_t count = 0;
+  for (const char *p = format; *p; p++) {
+    if (*p != '%') {
+      continue;
+    }
+    p++;
+    if (*p == '%') {
+      continue;
+    }
+    // Flags, width and precision; a `*` takes an int argument
+    while (*p && strchr("-+ #0123456789.*", *p)) {
+      if (*p == '*') {
+        if (count == MAX_ARGS) {
+          return false;
+        }
+        args[count++] = ARG_INT;
+      }
+      p++;
+    }
+    char type = ARG_INT;
+    while (*p && strchr("hlzjt", *p)) {
+      if (*p == 'l') {
+        type = type == ARG_LONG ? ARG_LONG_LONG : ARG_LONG;
+      } else if (*p == 'z' || *p == 'j' || *p == 't') {
+        type = ARG_SIZE;
+      }
+      p++;
+    }
+    if (!*p || count == MAX_ARGS) {
+      return false;
+    }
+    if (strchr("fFeEgGaA", *p)) {
+      type = ARG_DOUBLE;
+    } else if (*p == 's') {
+      type = ARG_STRING;
+    } else if (*p == 'p') {
+      type = ARG_POINTER;
+    } else if (strchr("ouxXc", *p)) {
+      // The unsigned variant
+      type = (char)toupper(type);
+    } else if (!strchr("di", *p)) {
+      return false;
+    }
+    args[count++] = type;
+  }
+  args[count] = '\0';
+  return true;
+}
+
+/**
+ * Get the ID of the format, registering it if needed, or -1 if it cannot be encoded.
+ */
+int16_t findFormat(const char *format) {
+  uint8_t count = formatCount.load(std::memory_order_acquire);
+  for (uint8_t id = 0; id < count; id++) {
+    if (formats[id].text == format) {
+      return id;
+    }
+  }
+
+  // Do not let another task on this core run while holding the lock, and wait for the other core
+  vTaskSuspendAll();
+  while (isRegistering.test_and_set(std::memory_order_acquire))
+    ;
+  // The other core may just have registered the same format
+  int16_t result = -1;
+  count = formatCount.load(std::memory_order_relaxed);
+  for (uint8_t id = 0; id < count && result < 0; id++) {
+    if (formats[id].text == format) {
+      result = id;
+    }
+  }
+  if (result < 0 && count < MAX_FORMATS && parseArgs(format, formats[count].args)) {
+    formats[count].text = format;
+    formatCount.store(count + 1, std::memory_order_release);
+    result = count;
+  }
+  isRegistering.clear(std::memory_order_release);
+  xTaskResumeAll();
+  return result;
+}
+
+/**
+ * Appends values to a record, silently dropping what does not fit. Integers are written as base 128
+ * varints, least significant group first, using zigzag encoding for signed values, so small
+ * numbers take a single byte.
+ */
+class RecordWriter {
+
+private:
+  uint8_t *buffer;
+  // The payload length must fit in a single byte
+  size_t maxLength;
+  size_t length{BinaryLog::RECORD_HEADER_LENGTH};
+
+public:
+  RecordWriter(uint8_t *buffer, size_t size, uint8_t type)
+      : buffer(buffer), maxLength(min(size, (size_t)BinaryLog::RECORD_HEADER_LENGTH + 255)) {
+    buffer[0] = BinaryLog::RECORD_MARKER;
+    buffer[1] = type;
+  }
+
+  void append(const void *bytes, size_t count) {
+    if (length + count <= maxLength) {
+      memcpy(buffer + length, bytes, count);
+      length += count;
+    }
+  }
+
+  void append(uint8_t value) {
+    append(&value, 1);
+  }
+
+  void appendUnsigned(uint64_t value) {
+    // A 64 bits value takes at most 10 bytes
+    uint8_t bytes[10];
+    uint8_t count = 0;
+    while (value >= 0x80) {
+      bytes[count++] = (uint8_t)value | 0x80;
+      value >>= 7;
+    }
+    bytes[count++] = (uint8_t)value;
+    append(bytes, count);
+  }
+
+  void appendSigned(int64_t value) {
+    appendUnsigned(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+  }
+
+  /**
+   * Append a 32 bits little-endian float, which is plenty for the `%.1f` values being logged.
+   */
+  void append(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint8_t bytes[] = {(uint8_t)bits, (uint8_t)(bits >> 8), (uint8_t)(bits >> 16),
+                       (uint8_t)(bits >> 24)};
+    append(bytes, sizeof(bytes));
+  }
+
+  void appendString(const char *text) {
+    if (length == maxLength) {
+      return;
+    }
+    // Truncate, rather than dropping the whole string
+    size_t count = min(strlen(text), maxLength - length - 1);
+    append((uint8_t)count);
+    append(text, count);
+  }
+
+  void appendArgs(const char *types, va_list args) {
+    for (const char *type = types; *type; type++) {
+      switch (*type) {
+        case ARG_INT:
+          appendSigned(va_arg(args, int));
+          break;
+        case ARG_UNSIGNED_INT:
+          appendUnsigned(va_arg(args, unsigned int));
+          break;
+        case ARG_LONG:
+          appendSigned(va_arg(args, long));
+          break;
+        case ARG_UNSIGNED_LONG:
+          appendUnsigned(va_arg(args, unsigned long));
+          break;
+        case ARG_LONG_LONG:
+          appendSigned(va_arg(args, long long));
+          break;
+        case ARG_UNSIGNED_LONG_LONG:
+          appendUnsigned(va_arg(args, unsigned long long));
+          break;
+        case ARG_SIZE:
+          appendSigned(va_arg(args, ptrdiff_t));
+          break;
+        case ARG_UNSIGNED_SIZE:
+          appendUnsigned(va_arg(args, size_t));
+          break;
+        case ARG_POINTER:
+          appendUnsigned((uintptr_t)va_arg(args, void *));
+          break;
+        case ARG_DOUBLE:
+          append((float)va_arg(args, double));
+          break;
+        case ARG_STRING:
+          appendString(va_arg(args, const char *));
+          break;
+        default:
+          break;
+      }
+    }
+  }
+
+  size_t finish() {
+    buffer[2] = length - BinaryLog::RECORD_HEADER_LENGTH;
+    return length;
+  }
+};
+
+} // namespace
+
+/**
+ * Encode a log line with the current timestamp and core, or return 0 if the format is not
+ * supported.
+ */
+size_t BinaryLog::encodeLog(uint8_t *buffer, size_t size, const char *format, va_list args) {
+  int16_t id = findFormat(format);
+  if (id < 0) {
+    return 0;
+  }
+  RecordWriter record(buffer, size, RECORD_LOG);
+  record.append((uint8_t)id);
+  record.append((uint8_t)xPortGetCoreID());
+  record.appendSigned(os_getTime());
+  record.appendUnsigned(millis());
+  record.appendArgs(formats[id].args, args);
+  return record.finish();
+}
+
+/**
+ * Encode text without a timestamp, or return 0 if the format is not supported.
+ */
+size_t BinaryLog::encodePrint(uint8_t *buffer, size_t size, const char *format, va_list args) {
+  int16_t id = findFormat(format);
+  if (id < 0) {
+    return 0;
+  }
+  RecordWriter record(buffer, size, RECORD_PRINT);
+  record.append((uint8_t)id);
+  record.appendArgs(formats[id].args, args);
+  return record.finish();
+}
+
+/**
+ * If the given record uses a format that has not been written yet, then encode that format and
+ * mark it as written. Only to be invoked by whoever writes the records to the serial port.
+ */
+size_t BinaryLog::encodeFormatOnce(const uint8_t *record, uint8_t *buffer, size_t size) {
+  if (record[0] != RECORD_MARKER || (record[1] != RECORD_LOG && record[1] != RECORD_PRINT)) {
+    return 0;
+  }
+  Format &format = formats[record[RECORD_HEADER_LENGTH]];
+  if (format.isWritten) {
+    return 0;
+  }
+  format.isWritten = true;
+  RecordWriter definition(buffer, size, RECORD_FORMAT);
+  definition.append(record[RECORD_HEADER_LENGTH]);
+  definition.append(format.text, strlen(format.text));
+  return definition.finish();
+}
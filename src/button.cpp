@@ -0,0 +1,152 @@
+/**
+ * Handles the button using a GPIO interrupt and a task of its own on the display core, so
+ * detecting a press does not depend on how often the LMIC loop gets to poll the button, and polling
+ * the button does not delay LMIC.
+ *
+ * The interrupt handler only wakes the task. The task then waits for the pin to be stable for a
+ * while, and classifies the presses like OneButton 1.5.0 with its default timing: a click, a double
+ * click, or a long press when released. The handlers run in the button task.
+ */
+#include "button.h"
+
+// The time the pin must be stable after an edge
+static const uint32_t DEBOUNCE_MS = 50;
+// The maximum time between the release of a click and the second press of a double click
+static const uint32_t CLICK_MS = 600;
+// The time after which a press is a long press
+static const uint32_t LONG_PRESS_MS = 1000;
+
+void Button::attachClick(ButtonHandler handler) {
+  clickHandler = handler;
+}
+
+void Button::attachDoubleClick(ButtonHandler handler) {
+  doubleClickHandler = handler;
+}
+
+void Button::attachLongPressStop(ButtonHandler handler) {
+  longPressStopHandler = handler;
+}
+
+static void invoke(ButtonHandler handler) {
+  if (handler) {
+    handler();
+  }
+}
+
+void IRAM_ATTR Button::onEdge(void *button) {
+  BaseType_t isHigherPriorityTaskWoken = pdFALSE;
+  vTaskNotifyGiveFromISR(static_cast<Button *>(button)->taskHandle, &isHigherPriorityTaskWoken);
+  if (isHigherPriorityTaskWoken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+/**
+ * Handle a debounced edge, which started at the given time.
+ */
+void Button::handleEdge(bool pressed, uint32_t now) {
+  switch (state) {
+    case STATE_IDLE:
+      if (pressed) {
+        state = STATE_PRESSED;
+        isSecondPress = false;
+      }
+      break;
+    case STATE_PRESSED:
+      if (!pressed) {
+        if (isSecondPress) {
+          state = STATE_IDLE;
+          invoke(doubleClickHandler);
+        } else {
+          state = STATE_RELEASED;
+        }
+      }
+      break;
+    case STATE_RELEASED:
+      if (pressed) {
+        state = STATE_PRESSED;
+        isSecondPress = true;
+      }
+      break;
+    case STATE_LONG_PRESSED:
+      if (!pressed) {
+        state = STATE_IDLE;
+        pressedMillis = now - edgeMillis;
+        invoke(longPressStopHandler);
+      }
+      break;
+  }
+  edgeMillis = now;
+}
+
+/**
+ * Handle the button being pressed or released for too long to change the classification.
+ */
+void Button::handleTimeout(uint32_t now) {
+  if (state == STATE_PRESSED && !isSecondPress && now - edgeMillis >= LONG_PRESS_MS) {
+    state = STATE_LONG_PRESSED;
+  } else if (state == STATE_RELEASED && now - edgeMillis >= CLICK_MS) {
+    state = STATE_IDLE;
+    invoke(clickHandler);
+  }
+}
+
+/**
+ * Get the time until handleTimeout may change the classification.
+ */
+TickType_t Button::ticksUntilTimeout(uint32_t now) const {
+  uint32_t timeout;
+  if (state == STATE_PRESSED && !isSecondPress) {
+    timeout = LONG_PRESS_MS;
+  } else if (state == STATE_RELEASED) {
+    timeout = CLICK_MS;
+  } else {
+    return portMAX_DELAY;
+  }
+  uint32_t elapsed = now - edgeMillis;
+  // Round up, to not wake up just before the timeout
+  return elapsed >= timeout ? 0 : pdMS_TO_TICKS(timeout - elapsed) + 1;
+}
+
+// Endless loop that does not return
+[[noreturn]] void Button::task(void *button) {
+  auto *self = static_cast<Button *>(button);
+  while (true) {
+    if (ulTaskNotifyTake(pdTRUE, self->ticksUntilTimeout(millis()))) {
+      uint32_t now = millis();
+      // Wait for the bouncing to end
+      while (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DEBOUNCE_MS))) {
+      }
+      bool pressed = digitalRead(self->pin) == LOW;
+      if (pressed != self->isPressed) {
+        self->isPressed = pressed;
+        self->handleEdge(pressed, now);
+      }
+    }
+    self->handleTimeout(millis());
+  }
+}
+
+/**
+ * Get how long the button was pressed, when invoked from the long press stop handler.
+ */
+uint32_t Button::getPressedMillis() const {
+  return pressedMillis;
+}
+
+/**
+ * Configure the pin, and start handling its interrupts in a task on the given core.
+ */
+void Button::begin(uint8_t buttonPin, BaseType_t core) {
+  pin = buttonPin;
+  pinMode(pin, INPUT_PULLUP);
+  isPressed = digitalRead(pin) == LOW;
+  xTaskCreatePinnedToCore(task, "ButtonTask",
+                          2048, // Stack size in words
+                          this, // Parameters for the task
+                          2, // Priority of the task
+                          &taskHandle,
+                          core); // Core for the task
+  attachInterruptArg(digitalPinToInterrupt(pin), onEdge, this, CHANGE);
+}
@@ -0,0 +1,179 @@
+/**
+ * Calibrates the LMIC clock error per data rate, based on when downlinks will actually arrive.
+ *
+ * A network server sends a downlink exactly 1 second (RX1) or 2 seconds (RX2) after the end of the
+ * uplink. But LMIC bases its receive windows on the time it detected the end of the transmission,
+ * which may be several milliseconds late. So, the preamble arrives earlier than LMIC expects, for
+ * SF7 with its 1 ms symbols often too early to be detected. The LMIC clock error compensates for
+ * that by opening the receive windows earlier, and listening longer. But a fixed value that works
+ * for SF7 keeps the radio listening much longer than needed for the slower data rates.
+ *
+ * Rather than the end of a reception, which is detected just as late, this uses the start of the
+ * transmission to tell when a preamble will arrive: LMIC starts the radio right after EV_TXSTART,
+ * and the airtime is known. Even better, when the interrupt handler for DIO0 timestamped the actual
+ * end of the transmission, that is used instead; see radiotiming.cpp. So, this does not even need
+ * any downlinks. For each data rate, the clock error is set to the minimum for which both RX1 and
+ * RX2 would catch the preamble, given the spread of the recent transmissions. Until a data rate has
+ * enough transmissions of its own, the largest lateness expected for the other data rates is used,
+ * as that hardly depends on the data rate; only when no data rate is calibrated yet, this falls
+ * back to a blanket UNCALIBRATED_CLOCK_ERROR.
+ *
+ * On top of that, the receive windows are widened for the offset of the crystal as estimated from
+ * the frequency error of the downlinks; see radiometrics.cpp.
+ *
+ * See LMICcore_adjustForDrift in
+ * https://github.com/mcci-catena/arduino-lmic/blob/v3.2.0/src/lmic/lmic.c
+ */
+#include <cmath>
+#include "clockcalibration.h"
+#include "airtime.h"
+#include "logger.h"
+
+// Global singleton instance
+ClockCalibration clockCalibration;
+
+// Like LMIC v3.2.0 for EU868
+static const uint8_t PREAMBLE_SYMBOLS = 8;
+static const uint8_t MIN_RX_SYMBOLS = 6;
+// The number of preamble symbols the SX1276 needs to detect a downlink, rounded up
+static const uint8_t DETECT_SYMBOLS = 5;
+// On top of the largest lateness seen, to allow for some more jitter
+static const ostime_t MARGIN = ms2osticks(1);
+
+/**
+ * Get the minimal clock error for a receive window with the given data rate and delay, if the end
+ * of the transmission is detected with the given lateness.
+ */
+u2_t ClockCalibration::requiredClockError(dr_t rxDataRate, ostime_t delay,
+                                          ostime_t latenessTicks) const {
+  ostime_t hsym = us2osticks(Airtime::dataRateSymbolMicros(rxDataRate) / 2);
+
+  // Without a clock error, LMIC starts listening PREAMBLE_SYMBOLS - MIN_RX_SYMBOLS half symbols
+  // after the time it expects the preamble, while the preamble arrives `lateness` before that time,
+  // and may start up to PREAMBLE_SYMBOLS - DETECT_SYMBOLS symbols before the window opens. For a
+  // clock error, LMIC starts listening `drift` earlier, and listens `drift / hsym` symbols longer,
+  // which it gets by starting even earlier; as it rounds the latter down, add another half symbol.
+  ostime_t shift = latenessTicks + MARGIN + (PREAMBLE_SYMBOLS - MIN_RX_SYMBOLS) * hsym -
+                   2 * (PREAMBLE_SYMBOLS - DETECT_SYMBOLS) * hsym + hsym;
+  if (shift <= 0) {
+    return 0;
+  }
+  // Rounded up, as LMIC rounds the drift down
+  s8_t drift = (shift + 1) / 2;
+  return min(drift * MAX_CLOCK_ERROR / delay + 1, (s8_t)MAX_CLOCK_ERROR - 1);
+}
+
+/**
+ * Register the start of a transmission; to be invoked as late as possible for EV_TXSTART.
+ */
+void ClockCalibration::startTx(dr_t dr, ostime_t airtime) {
+  txStart = os_getTime();
+  txDataRate = dr;
+  txAirtime = airtime;
+  hasTxEnd = false;
+}
+
+/**
+ * Set the actual end of the current transmission, to use rather than its start plus its airtime.
+ */
+void ClockCalibration::setTxEnd(ostime_t end) {
+  txEnd = end;
+  hasTxEnd = true;
+}
+
+/**
+ * Measure the timing of RX1 once LMIC has set it up, and update the clock error for the data rate
+ * of the transmission.
+ */
+void ClockCalibration::addRx1Window(ostime_t lmicTxEnd, ostime_t rxTime) {
+  if (txDataRate >= DATA_RATES) {
+    return;
+  }
+  ostime_t actualEnd = hasTxEnd ? txEnd : txStart + txAirtime;
+  ostime_t preamble = actualEnd + sec2osticks(LMIC.rxDelay);
+  ostime_t latenessTicks = lmicTxEnd - actualEnd;
+  Logger::logf("RX1 timing: SF%d; preamble at %d us after LMIC.rxtime; TX end detected %d us late",
+               12 - txDataRate, osticks2us(preamble - rxTime), osticks2us(latenessTicks));
+
+  u2_t previous = getClockError(txDataRate);
+  ostime_t *samples = lateness[txDataRate];
+  uint8_t &next = nextSample[txDataRate];
+  uint8_t &count = sampleCount[txDataRate];
+  samples[next] = latenessTicks;
+  next = (next + 1) % SAMPLES;
+  if (count < SAMPLES) {
+    count++;
+  }
+  if (count < MIN_SAMPLES) {
+    return;
+  }
+
+  // A few samples do not tell much about the worst case; also allow for the mean plus 4 standard
+  // deviations, which for a normal distribution is only exceeded once in 30,000 transmissions
+  ostime_t largest = 0;
+  s8_t sum = 0;
+  s8_t squares = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    largest = max(largest, samples[i]);
+    sum += samples[i];
+    squares += (s8_t)samples[i] * samples[i];
+  }
+  float mean = (float)sum / count;
+  float deviation = sqrtf(max((float)squares / count - mean * mean, 0.0f));
+  ostime_t expected = max(largest, (ostime_t)ceilf(mean + 4 * deviation));
+  expectedLateness[txDataRate] = expected;
+  clockErrors[txDataRate] =
+    max(requiredClockError(txDataRate, sec2osticks(LMIC.rxDelay), expected),
+        requiredClockError(LMIC.dn2Dr, sec2osticks(LMIC.rxDelay + 1), expected));
+  u2_t error = getClockError(txDataRate);
+  if (error != previous) {
+    Logger::logf("Clock error for SF%d: %u (%.2f%%); was %u", 12 - txDataRate, error,
+                 error * 100.0f / MAX_CLOCK_ERROR, previous);
+  }
+}
+
+/**
+ * Set the estimated offset of the crystals in ppm, for which each receive window then opens earlier
+ * and lasts longer, whether it runs fast or slow.
+ */
+void ClockCalibration::setCrystalOffset(float ppm) {
+  crystalDrift = min((u2_t)ceilf(fabsf(ppm) * MAX_CLOCK_ERROR / 1E6f), (u2_t)(MAX_CLOCK_ERROR - 1));
+}
+
+/**
+ * Get the clock error to use for the given data rate. Until calibrated, this is based on the other
+ * data rates, or is a safe default if none is calibrated either.
+ */
+u2_t ClockCalibration::getClockError(dr_t dr) const {
+  if (dr >= DATA_RATES) {
+    return UNCALIBRATED_CLOCK_ERROR;
+  }
+  u2_t error;
+  if (sampleCount[dr] >= MIN_SAMPLES) {
+    error = clockErrors[dr];
+  } else {
+    ostime_t expected = -1;
+    for (uint8_t other = 0; other < DATA_RATES; other++) {
+      if (sampleCount[other] >= MIN_SAMPLES) {
+        expected = max(expected, expectedLateness[other]);
+      }
+    }
+    if (expected < 0) {
+      return UNCALIBRATED_CLOCK_ERROR;
+    }
+    error = max(requiredClockError(dr, sec2osticks(LMIC.rxDelay), expected),
+                requiredClockError(LMIC.dn2Dr, sec2osticks(LMIC.rxDelay + 1), expected));
+  }
+  return min((u2_t)(error + crystalDrift), (u2_t)(MAX_CLOCK_ERROR - 1));
+}
+
+/**
+ * Forget all measurements, like after changes that may affect the timing.
+ */
+void ClockCalibration::reset() {
+  for (uint8_t dr = 0; dr < DATA_RATES; dr++) {
+    sampleCount[dr] = 0;
+    nextSample[dr] = 0;
+  }
+  Logger::log("Clock error calibration restarted");
+}
@@ -0,0 +1,51 @@
+/**
+ * Measures how much of the time each core is idle, to tell how much CPU is left for statistics and
+ * logging, and how much the loop task sleeps.
+ *
+ * The idle task of each core invokes the idle hooks whenever it runs, after which the core waits
+ * for the next interrupt. With no other work, that is the FreeRTOS tick, so while a core is idle,
+ * its hook is invoked once per tick. Other interrupts that do not make another task ready may add a
+ * few invocations, so the result is capped at 100%.
+ */
+#include <atomic>
+#include "esp_freertos_hooks.h"
+#include "cpustats.h"
+
+static std::atomic<uint32_t> idleTicks[portNUM_PROCESSORS];
+
+static bool onIdleCore0() {
+  idleTicks[0].fetch_add(1, std::memory_order_relaxed);
+  // Allow the core to wait for the next interrupt
+  return true;
+}
+
+static bool onIdleCore1() {
+  idleTicks[1].fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+// The tick count and the idle ticks as of the previous measurement
+static TickType_t previousTicks;
+static uint32_t previousIdleTicks[portNUM_PROCESSORS];
+
+void CpuStats::begin() {
+  previousTicks = xTaskGetTickCount();
+  esp_register_freertos_idle_hook_for_cpu(onIdleCore0, 0);
+  esp_register_freertos_idle_hook_for_cpu(onIdleCore1, 1);
+}
+
+/**
+ * Get the percentage of time each core was idle since the previous invocation, or since begin().
+ */
+void CpuStats::getIdlePercentages(float (&percentages)[portNUM_PROCESSORS]) {
+  // Read the tick count before the idle ticks, so an idle tick in between is counted next time
+  TickType_t ticks = xTaskGetTickCount();
+  TickType_t elapsed = ticks - previousTicks;
+  previousTicks = ticks;
+  for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+    uint32_t idle = idleTicks[core].load(std::memory_order_relaxed);
+    percentages[core] = elapsed ? min(100.0f * (idle - previousIdleTicks[core]) / elapsed, 100.0f)
+                                : 100.0f;
+    previousIdleTicks[core] = idle;
+  }
+}
@@ -0,0 +1,28 @@
+#include "crc.h"
+
+/**
+ * CRC-16/CCITT-FALSE, to be continued for each block of data, starting with CRC16_INIT.
+ */
+uint16_t Crc::crc16(uint16_t crc, const uint8_t *data, size_t length) {
+  while (length--) {
+    crc ^= *data++ << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+/**
+ * CRC-32 as used by zlib, to be continued for each block of data, starting with 0.
+ */
+uint32_t Crc::crc32(uint32_t crc, const uint8_t *data, size_t length) {
+  crc = ~crc;
+  while (length--) {
+    crc ^= *data++;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+  }
+  return ~crc;
+}
@@ -2,6 +2,17 @@
  * Controls the OLED display, showing the next uplink details, a progress bar indicating when the
  * next event happens, and the last downlink details if applicable.
  *
+ * To not keep the I2C bus busy with pushing the full 1 KB buffer every 50 ms, each part of the
+ * display is only redrawn if its contents changed, and only the SSD1306 pages and columns that
+ * changed are transferred. The transfer runs in a task of its own, from a front buffer, so drawing
+ * the next frame (and sampling the LMIC state in the calling task) does not wait for the I2C bus.
+ *
+ * Next to the main page, the button selects pages with link statistics. Those are only redrawn when
+ * the statistics changed.
+ *
+ * The caller does not need to tick at a fixed rate: each tick tells how long nothing visible will
+ * change, like while the progress bar of a long wait moves less than a pixel.
+ *
  * See https://github.com/ThingPulse/esp8266-oled-ssd1306
  */
 #include "display.h"
@@ -13,6 +24,89 @@
 // Global singleton instance
 Display display; // NOLINT(cert-err58-cpp)
 
+// The SSD1306 organizes its memory in pages of 8 rows, with one byte per column
+static const uint8_t PAGE_HEIGHT = 8;
+
+// The number of bytes the ThingPulse library also sends per I2C transmission
+static const uint8_t BYTES_PER_TRANSMISSION = 16;
+
+// Below this, the countdown shows tenths of seconds
+static const int32_t TENTHS_COUNTDOWN_MS = 5000;
+
+// The longest time between ticks while counting down whole seconds
+static const uint32_t MAX_COUNTDOWN_TICK_MS = 1000;
+
+// The shortest time between ticks, for states that only last a few seconds
+static const uint32_t MIN_TICK_MS = 50;
+
+PartialSSD1306Wire::PartialSSD1306Wire(uint8_t address, uint8_t sda, uint8_t scl)
+    : SSD1306Wire(address, sda, scl), address(address) {}
+
+/**
+ * Send a command like the library does; its own sendCommand is private.
+ */
+void PartialSSD1306Wire::sendPartialCommand(uint8_t command) {
+  Wire.beginTransmission(address);
+  Wire.write(0x80);
+  Wire.write(command);
+  Wire.endTransmission();
+}
+
+/**
+ * Transfer the given area of the given frame, which uses the same layout as the library's buffer.
+ * Like `display()`, this uses the horizontal addressing mode of the SSD1306, which wraps to the
+ * first column of the next page after the last column of a page.
+ */
+void PartialSSD1306Wire::displayArea(const uint8_t *frame, const Area &area) {
+  sendPartialCommand(COLUMNADDR);
+  sendPartialCommand(area.firstColumn);
+  sendPartialCommand(area.lastColumn);
+  sendPartialCommand(PAGEADDR);
+  sendPartialCommand(area.firstPage);
+  sendPartialCommand(area.lastPage);
+
+  uint8_t count = 0;
+  for (uint8_t page = area.firstPage; page <= area.lastPage; page++) {
+    for (uint8_t column = area.firstColumn; column <= area.lastColumn; column++) {
+      if (count == 0) {
+        Wire.beginTransmission(address);
+        Wire.write(0x40);
+      }
+      Wire.write(frame[column + page * width()]);
+      if (++count == BYTES_PER_TRANSMISSION) {
+        Wire.endTransmission();
+        count = 0;
+      }
+    }
+  }
+  if (count) {
+    Wire.endTransmission();
+  }
+}
+
+/**
+ * Like `drawString`, but without the heap allocation it uses to convert UTF-8 to the extended ASCII
+ * of the font; the tester only uses plain ASCII.
+ */
+void PartialSSD1306Wire::drawText(int16_t x, int16_t y, DisplayText &text) {
+  drawStringInternal(x, y, text.data(), text.length(), getStringWidth(text.c_str(), text.length()));
+}
+
+/**
+ * The given milliseconds, rounded to tenths of seconds, like `String(ms / 1000.0, 1)` does.
+ */
+static int32_t toTenths(int32_t ms) {
+  return (ms >= 0 ? ms + 50 : ms - 50) / 100;
+}
+
+/**
+ * The milliseconds until the given decreasing time, rounded to tenths like `toTenths` does, shows
+ * another value.
+ */
+static uint32_t msUntilNextTenth(int32_t ms) {
+  return ms - (toTenths(ms) * 100 - 50) + 1;
+}
+
 Display::Display() : oled(OLED_ADDRESS, SDA_OLED, SCL_OLED) {}
 
 void Display::showSplash() {
@@ -33,14 +127,87 @@ void Display::init() {
   // Set reset pin GPIO16 high while OLED is running
   digitalWrite(RST_OLED, HIGH);
 
+  // To be notified when a pending frame can be submitted
+  tickTaskHandle = xTaskGetCurrentTaskHandle();
+
   oled.init();
   oled.flipScreenVertically();
   // Try to avoid burn-in of details such as the progress bar
   oled.setBrightness(80);
   showSplash();
+
+  // Higher priority than the calling task, to start a transfer right away, and to continue drawing
+  // while the transfer task is blocked by the I2C driver
+  xTaskCreatePinnedToCore(transferTask, "DisplayTransferTask",
+                          2048, // Stack size
+                          this, // Parameters for the task
+                          uxTaskPriorityGet(nullptr) + 1, // Priority of the task
+                          &transferTaskHandle,
+                          xPortGetCoreID()); // Core for the task
 }
 
-void Display::tick() {
+/**
+ * Endless loop that transfers the areas of the front buffer whenever a frame has been submitted.
+ */
+void Display::transferTask(void *pvParameters) {
+  auto *self = static_cast<Display *>(pvParameters);
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    for (uint8_t i = 0; i < self->transferCount; i++) {
+      self->oled.displayArea(self->frontBuffer, self->transferAreas[i]);
+    }
+    self->isTransferring = false;
+    if (self->isFramePending.exchange(false)) {
+      xTaskNotifyGive(self->tickTaskHandle);
+    }
+  }
+}
+
+/**
+ * If the previous frame has been transferred, copy the areas that changed into the front buffer,
+ * and hand them over to the transfer task. Otherwise, keep them pending, and have the transfer task
+ * notify the ticking task when done.
+ */
+void Display::submitFrame() {
+  // Set before checking isTransferring, for the transfer task to see it if it is about to finish
+  isFramePending = true;
+  if (isTransferring) {
+    return;
+  }
+  isFramePending = false;
+  const uint8_t *backBuffer = oled.getBuffer();
+  transferCount = 0;
+  for (Region *region : regions) {
+    if (region->pendingLeft > region->pendingRight) {
+      continue;
+    }
+    Area area{(uint8_t)region->pendingLeft, (uint8_t)region->pendingRight,
+              (uint8_t)(region->y / PAGE_HEIGHT),
+              (uint8_t)((region->y + region->height - 1) / PAGE_HEIGHT)};
+    for (uint8_t page = area.firstPage; page <= area.lastPage; page++) {
+      uint16_t offset = page * oled.width() + area.firstColumn;
+      memcpy(frontBuffer + offset, backBuffer + offset, area.lastColumn - area.firstColumn + 1);
+    }
+    transferAreas[transferCount++] = area;
+    region->pendingLeft = 0;
+    region->pendingRight = -1;
+  }
+  if (transferCount) {
+    isTransferring = true;
+    xTaskNotifyGive(transferTaskHandle);
+  }
+}
+
+/**
+ * Redraw and transfer what changed, and get the number of milliseconds until the next change, or
+ * DISPLAY_IDLE if nothing will change until a state change or a new page.
+ */
+uint32_t Display::tick() {
+  if (!isFullRefreshNeeded && updateStatsPage()) {
+    submitFrame();
+    return DISPLAY_IDLE;
+  }
+
   // The range may be negative for state changes that did not define new values, like during TX.
   int32_t rangeMs = progressTargetTime - progressStartTime;
 
@@ -53,38 +220,64 @@ void Display::tick() {
 
   float sec = timeLeftMs / 1000.0f;
 
-  String label;
+  DisplayText label;
   uint8_t progress = 0;
+  uint32_t nextTickMs = MIN_TICK_MS;
 
   switch (state) {
     case STATE_WAITING:
       // This may become slightly negative; suppress
       if (sec >= 0) {
-        label = "tx in " + String(sec, 1) + " sec";
-        progress = rangeMs > 0 ? min(int32_t(100 - (100 * timeLeftMs / rangeMs)), 100) : 0;
+        // Only show tenths near the end, to not need 10 ticks per second for a long wait. Before
+        // that, the seconds are updated along with the progress bar, so not exactly on time.
+        label.append("tx in ");
+        if (timeLeftMs >= TENTHS_COUNTDOWN_MS) {
+          label.appendNumber((timeLeftMs + 999) / 1000);
+          nextTickMs = min(MAX_COUNTDOWN_TICK_MS, (uint32_t)(timeLeftMs - TENTHS_COUNTDOWN_MS + 1));
+        } else {
+          label.appendFixed(toTenths(timeLeftMs), 1);
+          nextTickMs = msUntilNextTenth(timeLeftMs);
+        }
+        label.append(" sec");
+        if (hasBudget) {
+          // Like "(23.4s 7dl)": the airtime and downlinks left in the last 24 hours
+          label.append(" (").appendFixed(airtimeLeftMs / 100, 1).append("s ");
+          label.appendNumber(downlinksLeft).append("dl)");
+        }
+        if (rangeMs > 0) {
+          int32_t percentLeft = 100 * timeLeftMs / rangeMs;
+          progress = min(int32_t(100 - percentLeft), 100);
+          // Until the next percent, being about a pixel
+          nextTickMs = min(nextTickMs, (uint32_t)(timeLeftMs - percentLeft * rangeMs / 100 + 1));
+        }
       } else {
         progress = 100;
+        nextTickMs = DISPLAY_IDLE;
       }
       break;
 
     case STATE_TX:
       // Though we expect LMIC to be transmitting, it may actually apply some safety zone before
       // it's doing that. That's okay.
-      label = "tx " + (sec < 0.1 ? String(-sec, 1) + " sec" : "");
-      // label = "tx";
+      label.append("tx ");
+      if (sec < 0.1) {
+        label.appendFixed(toTenths(-timeLeftMs), 1).append(" sec");
+      }
       progress = 100;
       break;
 
     case STATE_RX1:
       if (sec > 1) {
-        label = "unknown rx1 state " + String(sec, 1) + " sec";
+        label.append("unknown rx1 state ").appendFixed(toTenths(timeLeftMs), 1).append(" sec");
       } else {
         if (sec <= 0.1) {
           // See comment about negative values above
-          label = "rx1 " + (sec < -0.5 ? String(sec, 1) + " sec" : "");
+          label.append("rx1 ");
+          if (sec < -0.5) {
+            label.appendFixed(toTenths(timeLeftMs), 1).append(" sec");
+          }
         } else {
-          // label = "rx1 in " + String(sec, 1) + " sec";
-          label = "awaiting rx1";
+          label.append("awaiting rx1");
         }
         // 1.0..0 reading as 100..50 (rightmost half of the backwards progress bar)
         progress = 50 + int(50 * sec);
@@ -93,13 +286,15 @@ void Display::tick() {
 
     case STATE_RX2:
       if (sec > 1) {
-        label = "unknown rx2 state: " + String(sec, 1) + " sec";
+        label.append("unknown rx2 state: ").appendFixed(toTenths(timeLeftMs), 1).append(" sec");
       } else {
         if (sec <= 0.1) {
-          label = "rx2 " + (sec < -0.5 ? String(sec, 1) + " sec" : "");
+          label.append("rx2 ");
+          if (sec < -0.5) {
+            label.appendFixed(toTenths(timeLeftMs), 1).append(" sec");
+          }
         } else {
-          // label = "rx2 in " + String(sec, 1) + " sec";
-          label = "awaiting rx2";
+          label.append("awaiting rx2");
         }
         // 1.0..0 reading as 50..0 (leftmost half of the backwards progress bar)
         progress = max(int32_t(50 * sec), 0);
@@ -107,28 +302,274 @@ void Display::tick() {
       break;
 
     case STATE_NOP:
-      label = "";
+      nextTickMs = DISPLAY_IDLE;
       break;
 
     default:
-      label = "unknown state " + String(sec, 1) + " sec";
+      label.append("unknown state ").appendFixed(toTenths(timeLeftMs), 1).append(" sec");
   }
 
-  oled.clear();
+  if (isFullRefreshNeeded) {
+    // Get rid of the splash screen
+    oled.clear();
+  }
   oled.setTextAlignment(TEXT_ALIGN_CENTER);
 
   // Available default fonts: ArialMT_Plain_10, ArialMT_Plain_16, ArialMT_Plain_24. Or create one
   // with the font tool at http://oleddisplay.squix.ch
-  oled.setFont(Open_Sans_Condensed_Light_18);
-  oled.drawString(64, 0,
-                  "#" + String(fcnt) + (isFixedDataRate ? " [" : " ") + "SF" + String(sf) +
-                      (isFixedDataRate ? "]" : "") + (isConfirmedUplink ? "* " : " ") +
-                      String(freq / 1E6, 1));
+  DisplayText header;
+  header.append('#').appendNumber(fcnt).append(isFixedDataRate ? " [" : " ").append("SF");
+  header.appendNumber(sf).append(isFixedDataRate ? "]" : "").append(isConfirmedUplink ? "* " : " ");
+  // Frequency in MHz, with one decimal
+  header.appendFixed((freq + 50000) / 100000, 1);
+  updateText(headerRegion, Open_Sans_Condensed_Light_18, header);
+  updateText(labelRegion, ArialMT_Plain_10, label);
+  updateProgressBar(progress);
+  updateText(rxDetailsRegion, ArialMT_Plain_10, lastRxDetails);
+  isRedrawNeeded = false;
+
+  if (isFullRefreshNeeded) {
+    // Only once, before the transfer task is used
+    oled.display();
+    isFullRefreshNeeded = false;
+    return MIN_TICK_MS;
+  }
+  submitFrame();
+  return nextTickMs == DISPLAY_IDLE ? nextTickMs : max(nextTickMs, MIN_TICK_MS);
+}
+
+/**
+ * Mark the given columns of the pages of the given region for the next transfer.
+ */
+void Display::queueTransfer(Region &region, int16_t left, int16_t right) {
+  if (isFullRefreshNeeded) {
+    return;
+  }
+  left = max(left, (int16_t)0);
+  right = min(right, (int16_t)(oled.width() - 1));
+  if (left > right) {
+    return;
+  }
+  if (region.pendingLeft > region.pendingRight) {
+    region.pendingLeft = left;
+    region.pendingRight = right;
+  } else {
+    region.pendingLeft = min(region.pendingLeft, left);
+    region.pendingRight = max(region.pendingRight, right);
+  }
+}
+
+/**
+ * Redraw and transfer the centered text of the given region if it changed.
+ */
+void Display::updateText(Region &region, const uint8_t *font, const DisplayText &text) {
+  if (!isFullRefreshNeeded && !isRedrawNeeded && region.text == text.c_str()) {
+    return;
+  }
+  oled.setFont(font);
+  int16_t width = oled.getStringWidth(text.c_str(), text.length());
+  int16_t left = oled.width() / 2 - width / 2;
+  int16_t right = left + width - 1;
+
+  // The regions do not share any rows, but may share pages
+  oled.setColor(BLACK);
+  oled.fillRect(0, region.y, oled.width(), region.height);
+  oled.setColor(WHITE);
+  region.text = text;
+  oled.drawText(oled.width() / 2, region.y, region.text);
+
+  queueTransfer(region, min(left, region.left), max(right, region.right));
+  region.left = left;
+  region.right = right;
+}
+
+/**
+ * Redraw the progress bar if it changed, and transfer the columns between its old and new end.
+ */
+void Display::updateProgressBar(uint8_t progress) {
+  if (!isFullRefreshNeeded && !isRedrawNeeded && progress == progressRegion.progress) {
+    return;
+  }
+  const uint8_t barHeight = progressRegion.height - 1;
+  const uint8_t radius = barHeight / 2;
+  const uint8_t barWidth = oled.width() - 1;
+  oled.setColor(BLACK);
+  oled.fillRect(0, progressRegion.y, oled.width(), progressRegion.height);
+  oled.setColor(WHITE);
+  oled.drawProgressBar(0, progressRegion.y, barWidth, barHeight, progress);
+
+  // The filled part ends with a half circle
+  uint8_t oldEnd = (barWidth - 2 * radius + 1) * progressRegion.progress / 100;
+  uint8_t newEnd = (barWidth - 2 * radius + 1) * progress / 100;
+  queueTransfer(progressRegion, min(oldEnd, newEnd), max(oldEnd, newEnd) + 2 * radius);
+  progressRegion.progress = progress;
+}
+
+/**
+ * Draw the selected statistics page if the page or the statistics changed, returning false if the
+ * main page is selected. When returning to the main page, clear the screen for a full redraw.
+ */
+bool Display::updateStatsPage() {
+  uint8_t selected = page;
+  uint32_t version = linkStats.getVersion();
+  if (selected == shownPage && (selected == PAGE_MAIN || version == shownStatsVersion)) {
+    return selected != PAGE_MAIN;
+  }
+  shownPage = selected;
+  shownStatsVersion = version;
+
+  oled.setColor(BLACK);
+  oled.fillRect(0, 0, oled.width(), oled.height());
+  oled.setColor(WHITE);
+  queueTransfer(pageRegion, 0, oled.width() - 1);
+
+  switch (selected) {
+    case PAGE_DATA_RATES:
+      drawDataRatesPage();
+      break;
+    case PAGE_CHANNELS:
+      drawChannelsPage();
+      break;
+    case PAGE_RSSI: {
+      LinkCounters total;
+      linkStats.getTotal(total);
+      drawHistogramPage("RSSI dBm", total.rssiHistogram, RSSI_HISTOGRAM_BINS);
+      break;
+    }
+    case PAGE_SNR: {
+      LinkCounters total;
+      linkStats.getTotal(total);
+      drawHistogramPage("SNR dB", total.snrHistogram, SNR_HISTOGRAM_BINS);
+      break;
+    }
+    default:
+      isRedrawNeeded = true;
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Draw a row of the data rates page: the name, ACKs per confirmed uplink, downlinks in RX1 and RX2,
+ * and the average SNR of the downlinks.
+ */
+void Display::drawStatsRow(int16_t y, const char *name, const LinkCounters &counters) {
+  DisplayText text;
+  text.append(name);
+  oled.setTextAlignment(TEXT_ALIGN_LEFT);
+  oled.drawText(0, y, text);
+
+  oled.setTextAlignment(TEXT_ALIGN_RIGHT);
+  text.clear();
+  text.appendNumber(counters.acks).append('/').appendNumber(counters.confirmed);
+  oled.drawText(66, y, text);
+  text.clear();
+  text.appendNumber(counters.rx1).append('/').appendNumber(counters.rx2);
+  oled.drawText(98, y, text);
+  text.clear();
+  uint32_t downlinks = counters.getDownlinks();
+  if (downlinks) {
+    // Tenths of dB, from quarters of dB
+    text.appendFixed(counters.snrSum * 10 / 4 / (int32_t)downlinks, 1);
+  } else {
+    text.append('-');
+  }
+  oled.drawText(oled.width() - 1, y, text);
+}
+
+/**
+ * Show the totals and a row for SF12 thru SF7, 9 pixels apart, which just fits the ArialMT_Plain_10
+ * digits.
+ */
+void Display::drawDataRatesPage() {
   oled.setFont(ArialMT_Plain_10);
-  oled.drawString(64, 24, label);
-  oled.drawProgressBar(0, 40, 127, 6, progress);
-  oled.drawString(64, 52, lastRxDetails);
-  oled.display();
+  LinkCounters counters;
+  linkStats.getTotal(counters);
+  drawStatsRow(0, "all", counters);
+  DisplayText name;
+  for (dr_t dr = DR_SF12; dr <= DR_SF7; dr++) {
+    linkStats.getDataRate(dr, counters);
+    name.clear();
+    name.append("SF").appendNumber(12 - dr);
+    drawStatsRow(9 * (dr + 1), name.c_str(), counters);
+  }
+}
+
+/**
+ * Show ACKs per confirmed uplink for channels 0 thru 7, in two columns.
+ */
+void Display::drawChannelsPage() {
+  oled.setFont(ArialMT_Plain_10);
+  DisplayText text;
+  text.append("ACKs per channel");
+  oled.setTextAlignment(TEXT_ALIGN_CENTER);
+  oled.drawText(oled.width() / 2, 0, text);
+
+  LinkCounters counters;
+  for (uint8_t channel = 0; channel < 8; channel++) {
+    linkStats.getChannel(channel, counters);
+    int16_t x = channel < 4 ? 0 : oled.width() / 2 + 2;
+    int16_t y = 13 + 13 * (channel % 4);
+    text.clear();
+    // MHz with one decimal; the channels do not change after setup, so this is safe on this core
+    text.appendFixed((LMIC.channelFreq[channel] & ~(u4_t)0x3) / 100000, 1);
+    oled.setTextAlignment(TEXT_ALIGN_LEFT);
+    oled.drawText(x, y, text);
+    text.clear();
+    text.appendNumber(counters.acks).append('/').appendNumber(counters.confirmed);
+    oled.setTextAlignment(TEXT_ALIGN_RIGHT);
+    oled.drawText(x + oled.width() / 2 - 3, y, text);
+  }
+}
+
+/**
+ * Show the title with the number of downlinks, and a bar per bin, scaled to the largest bin.
+ */
+void Display::drawHistogramPage(const char *title, const uint32_t *histogram, uint8_t bins) {
+  uint32_t count = 0;
+  uint32_t largest = 0;
+  for (uint8_t i = 0; i < bins; i++) {
+    count += histogram[i];
+    largest = max(largest, histogram[i]);
+  }
+
+  oled.setFont(ArialMT_Plain_10);
+  DisplayText text;
+  text.append(title);
+  oled.setTextAlignment(TEXT_ALIGN_LEFT);
+  oled.drawText(0, 0, text);
+  text.clear();
+  text.append("n=").appendNumber(count);
+  oled.setTextAlignment(TEXT_ALIGN_RIGHT);
+  oled.drawText(oled.width() - 1, 0, text);
+
+  const int16_t top = 14;
+  const int16_t bottom = oled.height() - 1;
+  const int16_t barWidth = oled.width() / bins;
+  const int16_t left = (oled.width() - bins * barWidth) / 2;
+  oled.drawHorizontalLine(0, bottom, oled.width());
+  for (uint8_t i = 0; i < bins && largest; i++) {
+    if (histogram[i]) {
+      // At least one pixel above the baseline for any non-empty bin
+      int16_t height = max((int16_t)(histogram[i] * (bottom - top) / largest), (int16_t)1);
+      oled.fillRect(left + i * barWidth, bottom - height, barWidth - 1, height);
+    }
+  }
+}
+
+/**
+ * Select the next page, after the last statistics page returning to the main page.
+ */
+void Display::showNextPage() {
+  page = (page + 1) % PAGE_COUNT;
+}
+
+void Display::showMainPage() {
+  page = PAGE_MAIN;
+}
+
+bool Display::isShowingStats() const {
+  return page != PAGE_MAIN;
 }
 
 void Display::setIsConfirmedUplink(const bool isConfirmed) {
@@ -139,8 +580,9 @@ void Display::setIsFixedDataRate(const bool isFixed) {
   isFixedDataRate = isFixed;
 }
 
-void Display::setRxDetails(const String &rxDetails) {
-  lastRxDetails = rxDetails;
+void Display::setRxDetails(const char *rxDetails) {
+  lastRxDetails.clear();
+  lastRxDetails.append(rxDetails);
 }
 
 void Display::setTxCount(const uint32_t fCntUp) {
@@ -155,6 +597,12 @@ void Display::setTxFreq(const uint32_t txFreq) {
   freq = txFreq;
 }
 
+void Display::setBudget(const bool isBudget, const uint32_t airtimeMs, const uint8_t downlinks) {
+  hasBudget = isBudget;
+  airtimeLeftMs = airtimeMs;
+  downlinksLeft = downlinks;
+}
+
 void Display::startWait(const State waitState, const uint32_t targetTimeMs) {
   state = waitState;
   progressStartTime = millis();
@@ -0,0 +1,82 @@
+/**
+ * Keeps track of the EU868 duty cycle per band, just like LMIC does internally, to know when and on
+ * which channel LMIC will allow the next transmission, before actually asking LMIC to send.
+ *
+ * See https://github.com/mcci-catena/arduino-lmic/blob/v3.2.0/src/lmic/lmic_eu868.c
+ */
+#include "dutycycle.h"
+#include "airtime.h"
+
+// Global singleton instance
+DutyCycle dutyCycle;
+
+/**
+ * Register a transmission that started at the given time, as soon as possible after LMIC did, to
+ * not end up with a band that we think is available before LMIC thinks it is.
+ */
+void DutyCycle::registerTx(uint8_t channel, ostime_t txBegin, ostime_t airtime) {
+  uint8_t band = LMIC.channelFreq[channel] & 0x3;
+  bandAvail[band] = txBegin + Airtime::bandOffTicks(band, airtime);
+  lastChannel[band] = channel;
+  isBandUsed[band] = true;
+
+  if (uplinkCount++ == 0) {
+    firstTxMillis = millis();
+  }
+}
+
+/**
+ * Get the time the given band becomes available, which is never before the given time. As LMIC
+ * ticks overflow after about 9.5 hours, a band that has been available for a while is marked as
+ * being available right now.
+ */
+ostime_t DutyCycle::availableAt(uint8_t band, ostime_t now) {
+  if (!isBandUsed[band] || now - bandAvail[band] >= 0) {
+    bandAvail[band] = now;
+    isBandUsed[band] = false;
+  }
+  return bandAvail[band];
+}
+
+/**
+ * Like LMIC, find the next enabled channel in the given band that supports the given data rate,
+ * searching from the channel that was used last in that band.
+ */
+bool DutyCycle::findChannel(uint8_t band, dr_t dr, uint8_t &channel) const {
+  uint8_t ch = lastChannel[band];
+  for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+    ch = (ch + 1) % MAX_CHANNELS;
+    if ((LMIC.channelMap & (1 << ch)) && (LMIC.channelDrMap[ch] & (1 << dr)) &&
+        (LMIC.channelFreq[ch] & 0x3) == band) {
+      channel = ch;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Get the time and channel for the next transmission using the given data rate: the channel in
+ * the band that becomes available first, like LMICeu868_nextTx selects it.
+ */
+TxSlot DutyCycle::nextTx(dr_t dr, ostime_t now) {
+  TxSlot slot{now, LMIC.txChnl};
+  bool isFound = false;
+  for (uint8_t band = 0; band < MAX_BANDS; band++) {
+    uint8_t channel;
+    ostime_t avail = availableAt(band, now);
+    if ((!isFound || avail - slot.time < 0) && findChannel(band, dr, channel)) {
+      slot = {avail, channel};
+      isFound = true;
+    }
+  }
+  return slot;
+}
+
+/**
+ * Get the achieved number of uplinks per hour, since the first transmission.
+ */
+float DutyCycle::getUplinksPerHour() const {
+  uint32_t elapsedMs = millis() - firstTxMillis;
+  return elapsedMs > 0 ? uplinkCount * 3600000.0f / elapsedMs : 0;
+}
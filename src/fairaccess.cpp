@@ -0,0 +1,174 @@
+/**
+ * A governor for The Things Network's Fair Access Policy of 30 seconds uplink airtime and 10
+ * downlinks per 24 hours, which, unlike the EU868 duty cycle, LMIC does not know about. Without
+ * this, the tester spends a day's budget in the first few minutes. But with this, it only gets a
+ * few uplinks per hour, so it is disabled until enabled using the serial port.
+ *
+ * Both the airtime and the downlinks use a token bucket. A bucket with capacity B that is refilled
+ * at a rate of (P - B) / 24 hours never allows more than P in any 24 hours, so that is how the
+ * budget P is split into a burst and a steady rate. The airtime burst must fit the longest uplink,
+ * being SF12 with a 51 bytes payload; the remainder paces the uplinks evenly across the day,
+ * whatever the data rates and payload sizes. The budget is not persisted, so it restarts in full
+ * after a reset, like the uplink counter.
+ *
+ * Confirmations are planned for coverage: the next downlink is only spent on a data rate that had
+ * the fewest confirmed uplinks so far, unless the bucket is full and the downlink would be wasted.
+ * Other uplinks are sent unconfirmed. The adaptive data rate only learns from confirmed uplinks, so
+ * it selects the data rates itself, and its uplinks wait for a downlink too; see
+ * adaptivedatarate.cpp.
+ */
+#include <cstring>
+#include "fairaccess.h"
+#include "airtime.h"
+#include "logger.h"
+
+// Global singleton instance
+FairAccess fairAccess;
+
+static const uint32_t DAY_MS = 24 * 3600000UL;
+static const uint32_t HOUR_MS = 3600000UL;
+static const uint32_t AIRTIME_BURST_MS = 3000;
+static const uint8_t DOWNLINK_BURST = 2;
+
+static_assert(Airtime::dataRateMicros(DR_SF12, Airtime::LORAWAN_OVERHEAD + 51) <=
+                  AIRTIME_BURST_MS * 1000,
+              "AIRTIME_BURST_MS must fit the longest uplink");
+
+FairAccess::FairAccess()
+    : airtime{AIRTIME_BURST_MS, (float)(FAIR_ACCESS_AIRTIME_MS - AIRTIME_BURST_MS) / DAY_MS,
+              AIRTIME_BURST_MS},
+      downlinks{DOWNLINK_BURST, (float)(FAIR_ACCESS_DOWNLINKS - DOWNLINK_BURST) / DAY_MS,
+                DOWNLINK_BURST} {
+}
+
+bool FairAccess::getEnabled() const {
+  return isEnabled;
+}
+
+/**
+ * Enable or disable the governor. The buckets and the hourly usage are kept while disabled, so
+ * toggling this does not allow for more than the budget. But while disabled, the buckets are not
+ * drained below empty, so enabling this after running without it does not first wait for all of
+ * that to be refilled.
+ */
+void FairAccess::setEnabled(bool enabled) {
+  isEnabled = enabled;
+  if (enabled) {
+    usedDataRates = 0;
+    memset(confirmed, 0, sizeof(confirmed));
+  }
+}
+
+/**
+ * Refill the buckets, and clear the hourly usage of the hours that passed.
+ */
+void FairAccess::update() {
+  uint32_t now = millis();
+  uint32_t elapsedMs = now - updateMillis;
+  updateMillis = now;
+  airtime.tokens = min(airtime.capacity, airtime.tokens + airtime.rate * elapsedMs);
+  downlinks.tokens = min(downlinks.capacity, downlinks.tokens + downlinks.rate * elapsedMs);
+
+  uint32_t hour = now / HOUR_MS;
+  for (uint8_t i = 0; i < HOURS && binHour != hour; i++) {
+    binHour++;
+    airtimeBins[binHour % HOURS] = 0;
+    downlinkBins[binHour % HOURS] = 0;
+  }
+  binHour = hour;
+}
+
+/**
+ * Get the number of milliseconds until the bucket holds the airtime of an uplink with the given
+ * data rate and frame length, and, if it needs a downlink, until a downlink is available too.
+ */
+uint32_t FairAccess::getDelayMillis(dr_t dr, uint8_t length, bool needsDownlink) {
+  update();
+  float needed = Airtime::dataRateMicros(dr, length) / 1000.0f - airtime.tokens;
+  uint32_t delayMs = needed > 0 ? (uint32_t)(needed / airtime.rate) + 1 : 0;
+  float neededDownlinks = needsDownlink ? 1 - downlinks.tokens : 0;
+  if (neededDownlinks > 0) {
+    delayMs = max(delayMs, (uint32_t)(neededDownlinks / downlinks.rate) + 1);
+  }
+  return delayMs;
+}
+
+/**
+ * Tell if an uplink with the given data rate should be confirmed, and if so, take its downlink
+ * from the bucket. If the data rate was selected for its confirmation, like by the adaptive data
+ * rate, it gets any downlink that is available, rather than only if it had the fewest confirmed
+ * uplinks.
+ */
+bool FairAccess::takeDownlink(dr_t dr, bool isSelected) {
+  update();
+  if (dr >= TESTED_DATA_RATES || downlinks.tokens < 1) {
+    return false;
+  }
+  usedDataRates |= 1 << dr;
+  uint32_t fewest = UINT32_MAX;
+  for (dr_t i = 0; i < TESTED_DATA_RATES; i++) {
+    if (usedDataRates >> i & 1) {
+      fewest = min(fewest, confirmed[i]);
+    }
+  }
+  if (!isSelected && confirmed[dr] > fewest && downlinks.tokens < downlinks.capacity) {
+    return false;
+  }
+  downlinks.tokens -= 1;
+  downlinkBins[binHour % HOURS]++;
+  confirmed[dr]++;
+  return true;
+}
+
+/**
+ * Take the airtime of an uplink that just started from the bucket. Only to be invoked on the LMIC
+ * core.
+ */
+void FairAccess::registerTx(dr_t dr, uint8_t length) {
+  update();
+  if (dr < TESTED_DATA_RATES) {
+    usedDataRates |= 1 << dr;
+  }
+  float airtimeMs = Airtime::dataRateMicros(dr, length) / 1000.0f;
+  airtime.tokens = isEnabled ? airtime.tokens - airtimeMs : max(airtime.tokens - airtimeMs, 0.0f);
+  airtimeBins[binHour % HOURS] += (uint32_t)(airtimeMs + 0.5f);
+}
+
+/**
+ * Count a downlink that was not taken from the bucket, like for an uplink that was not confirmed.
+ */
+void FairAccess::registerDownlink() {
+  update();
+  downlinks.tokens = isEnabled ? downlinks.tokens - 1 : max(downlinks.tokens - 1, 0.0f);
+  downlinkBins[binHour % HOURS]++;
+}
+
+/**
+ * Get the airtime that is left of the budget of the last 24 hours, counted per hour.
+ */
+uint32_t FairAccess::getAirtimeLeftMillis() const {
+  uint32_t used = 0;
+  for (uint8_t i = 0; i < HOURS; i++) {
+    used += airtimeBins[i];
+  }
+  return used < FAIR_ACCESS_AIRTIME_MS ? FAIR_ACCESS_AIRTIME_MS - used : 0;
+}
+
+/**
+ * Get the number of downlinks that is left of the budget of the last 24 hours, counted per hour.
+ */
+uint8_t FairAccess::getDownlinksLeft() const {
+  uint32_t used = 0;
+  for (uint8_t i = 0; i < HOURS; i++) {
+    used += downlinkBins[i];
+  }
+  return used < FAIR_ACCESS_DOWNLINKS ? FAIR_ACCESS_DOWNLINKS - used : 0;
+}
+
+void FairAccess::log() {
+  update();
+  Logger::logf("Fair access: airtime left=%.1f s; downlinks left=%u; tokens: airtime=%.2f s; "
+               "downlinks=%.2f",
+               getAirtimeLeftMillis() / 1000.0f, getDownlinksLeft(), airtime.tokens / 1000.0f,
+               downlinks.tokens);
+}
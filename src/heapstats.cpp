@@ -0,0 +1,42 @@
+/**
+ * Counts heap allocations, to prove that the steady-state loop does not use the heap at all, as
+ * allocating and freeing many small strings fragments the heap during multi-day runs.
+ *
+ * This needs the linker to redirect all references to `malloc`, `calloc` and `realloc` to the
+ * `__wrap_` functions below, using `-Wl,--wrap=malloc` and so on; see `platformio.ini`. This also
+ * covers `new`, and the Arduino `String` class.
+ */
+#include <atomic>
+#include <cstddef>
+#include "heapstats.h"
+
+static std::atomic<uint32_t> allocationCount{0};
+
+extern "C" {
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  allocationCount++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  allocationCount++;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  allocationCount++;
+  return __real_realloc(ptr, size);
+}
+}
+
+/**
+ * The number of allocations since boot, including reallocations.
+ */
+uint32_t HeapStats::getAllocationCount() {
+  return allocationCount;
+}
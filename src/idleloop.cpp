@@ -0,0 +1,135 @@
+/**
+ * Lets the task running loop() sleep while LMIC has nothing to do, rather than spinning on
+ * os_runloop_once and keeping its core busy all the time, even when the next uplink is tens of
+ * seconds away.
+ *
+ * LMIC does not expose its job queue, but it invokes hal_sleep whenever no job is runnable or due,
+ * and os_queryTimeCriticalJobs tells if any job is due before a given time. This needs the linker
+ * to redirect LMIC's call to hal_sleep to __wrap_hal_sleep below, using `-Wl,--wrap=hal_sleep`; see
+ * `platformio.ini`.
+ *
+ * The LMIC Arduino HAL polls the radio's DIO pins, so the interrupts on those pins (see
+ * radiotiming.cpp) only serve to wake the task. The task also wakes when the button task queues a
+ * command, and regularly to poll the serial port.
+ */
+#include "idleloop.h"
+#include "lmic.h"
+
+// Global singleton instance
+IdleLoop idleLoop;
+
+// Wake up this much before an LMIC job is due, as a FreeRTOS tick takes 1 ms, while LMIC only
+// starts preparing the radio a few milliseconds before a transmission or receive window
+static const ostime_t WAKE_MARGIN = ms2osticks(2);
+// Wake up at least this often to poll the serial port
+static const uint32_t MAX_SLEEP_MS = 100;
+
+static TaskHandle_t loopTaskHandle = nullptr;
+// Set by LMIC when it found nothing to do in the current os_runloop_once
+static bool isLmicIdle = false;
+
+extern "C" {
+
+void __real_hal_sleep();
+
+void __wrap_hal_sleep() {
+  isLmicIdle = true;
+  if (!idleLoop.getEnabled()) {
+    __real_hal_sleep();
+  }
+}
+}
+
+/**
+ * Get the time until the first scheduled LMIC job is due, or `limit` if none is due before that.
+ * LMIC only tells if any job is due before a given time, so bisect.
+ */
+static ostime_t ticksUntilNextJob(ostime_t now, ostime_t limit) {
+  if (!os_queryTimeCriticalJobs(now + limit)) {
+    return limit;
+  }
+  if (os_queryTimeCriticalJobs(now)) {
+    return 0;
+  }
+  // No job is due before now + low, but some job is due before now + high
+  ostime_t low = 0;
+  ostime_t high = limit;
+  while (high - low > 1) {
+    ostime_t middle = low + (high - low) / 2;
+    if (os_queryTimeCriticalJobs(now + middle)) {
+      high = middle;
+    } else {
+      low = middle;
+    }
+  }
+  return low;
+}
+
+/**
+ * Register the task that invokes this as the task to sleep and wake.
+ */
+void IdleLoop::begin() {
+  loopTaskHandle = xTaskGetCurrentTaskHandle();
+}
+
+void IdleLoop::setEnabled(bool enabled) {
+  isEnabled = enabled;
+}
+
+bool IdleLoop::getEnabled() const {
+  return isEnabled;
+}
+
+/**
+ * If LMIC found nothing to do in the last os_runloop_once, sleep until its next job is due, until a
+ * radio interrupt or a wake(), or until it is time to poll the serial port.
+ */
+void IdleLoop::sleep() {
+  bool isIdle = isLmicIdle;
+  isLmicIdle = false;
+  if (!isEnabled || !isIdle) {
+    return;
+  }
+
+  ostime_t untilJob = ticksUntilNextJob(os_getTime(), ms2osticks(MAX_SLEEP_MS) + WAKE_MARGIN);
+  if (untilJob <= WAKE_MARGIN) {
+    return;
+  }
+  // FreeRTOS may wake up to one tick early, but never late
+  TickType_t ticks = pdMS_TO_TICKS(osticks2ms(untilJob - WAKE_MARGIN));
+  if (ticks == 0) {
+    return;
+  }
+  sleepCount++;
+  ulTaskNotifyTake(pdTRUE, ticks);
+}
+
+/**
+ * Make the loop task run right away if it is sleeping, or skip its next sleep. Not to be invoked
+ * from an interrupt handler.
+ */
+void IdleLoop::wake() {
+  if (loopTaskHandle) {
+    xTaskNotifyGive(loopTaskHandle);
+  }
+}
+
+/**
+ * Like wake(), for interrupt handlers.
+ */
+void IRAM_ATTR IdleLoop::wakeFromIsr() {
+  if (loopTaskHandle) {
+    BaseType_t isHigherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(loopTaskHandle, &isHigherPriorityTaskWoken);
+    if (isHigherPriorityTaskWoken) {
+      portYIELD_FROM_ISR();
+    }
+  }
+}
+
+/**
+ * Get the number of times the loop task went to sleep since boot.
+ */
+uint32_t IdleLoop::getSleepCount() const {
+  return sleepCount;
+}
@@ -0,0 +1,88 @@
+/**
+ * Finds the LinkCheckAns in the downlink of an uplink that held a LinkCheckReq. Where a bare ACK
+ * only tells that a single downlink was received, the answer also tells how much margin the uplink
+ * had, and by how many gateways it was received, all for the same single downlink.
+ *
+ * LMIC 3.2.0 skips LinkCheckAns when processing the MAC commands of a downlink, but leaves the
+ * decoded downlink in LMIC.frame, so it can be parsed afterwards. See
+ * https://github.com/mcci-catena/arduino-lmic/blob/v3.2.0/src/lmic/lmic.c#L917-L921
+ */
+#include "linkcheck.h"
+
+// The offset of FCtrl, and of the FOpts, in a LoRaWAN data frame
+static const uint8_t OFF_FCTRL = 5;
+static const uint8_t OFF_FOPTS = 8;
+
+/**
+ * Get the payload length of a MAC command that a network server sends, or -1 if unknown.
+ */
+static int8_t commandLength(uint8_t cid) {
+  switch (cid) {
+    // DevStatusReq
+    case 0x06:
+      return 0;
+    // DutyCycleReq, RXTimingSetupReq, TxParamSetupReq
+    case 0x04:
+    case 0x08:
+    case 0x09:
+      return 1;
+    // LinkCheckAns
+    case 0x02:
+      return 2;
+    // LinkADRReq, RXParamSetupReq, DlChannelReq
+    case 0x03:
+    case 0x05:
+    case 0x0A:
+      return 4;
+    // NewChannelReq, DeviceTimeAns
+    case 0x07:
+    case 0x0D:
+      return 5;
+    default:
+      return -1;
+  }
+}
+
+/**
+ * Find a LinkCheckAns in the given downlink MAC commands, returning false if there is none. As the
+ * length of each command follows from its CID, parsing stops at the first unknown command.
+ */
+bool LinkCheck::parseCommands(const uint8_t *commands, uint8_t length, Answer &answer) {
+  uint8_t i = 0;
+  while (i < length) {
+    int8_t payloadLength = commandLength(commands[i]);
+    if (payloadLength < 0 || i + 1 + payloadLength > length) {
+      return false;
+    }
+    if (commands[i] == CID) {
+      answer.margin = commands[i + 1];
+      answer.gateways = commands[i + 2];
+      return true;
+    }
+    i += 1 + payloadLength;
+  }
+  return false;
+}
+
+/**
+ * Find a LinkCheckAns in the downlink LMIC just received, either in its FOpts or in a payload on
+ * port 0. Only to be invoked at EV_TXCOMPLETE.
+ */
+bool LinkCheck::getAnswer(Answer &answer) {
+  const uint8_t *frame = LMIC.frame;
+  // After a receive window timed out, LMIC.frame still holds the uplink; the MType of a downlink is
+  // either 3 (unconfirmed) or 5 (confirmed)
+  uint8_t mtype = frame[0] >> 5;
+  uint32_t devaddr = frame[1] | frame[2] << 8 | frame[3] << 16 | (uint32_t)frame[4] << 24;
+  if (!(LMIC.txrxFlags & (TXRX_DNW1 | TXRX_DNW2)) || (mtype != 3 && mtype != 5) ||
+      devaddr != LMIC.devaddr) {
+    return false;
+  }
+  if (parseCommands(frame + OFF_FOPTS, frame[OFF_FCTRL] & 0x0F, answer)) {
+    return true;
+  }
+  // LMIC decrypts the payload in place, and leaves the port in front of it
+  return (LMIC.txrxFlags & TXRX_PORT) && LMIC.dataLen && LMIC.dataBeg > OFF_FOPTS &&
+         frame[LMIC.dataBeg - 1] == 0 &&
+         parseCommands(frame + LMIC.dataBeg, LMIC.dataLen, answer);
+}
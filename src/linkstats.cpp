@@ -0,0 +1,203 @@
+/**
+ * Keeps link statistics while testing, to show success rates and the link budget live, rather than
+ * computing those from the log afterwards.
+ *
+ * The statistics are only updated on the LMIC core, and read by the display task on the other core.
+ * Rather than locking, readers copy the counters and retry if an update was running meanwhile.
+ */
+#include "linkstats.h"
+#include "logger.h"
+
+// Global singleton instance
+LinkStats linkStats;
+
+/**
+ * Get the histogram bin for the value, clamping values outside the histogram to the outer bins.
+ */
+static uint8_t histogramBin(int16_t value, int16_t first, uint8_t binWidth, uint8_t bins) {
+  if (value < first) {
+    return 0;
+  }
+  return min((value - first) / binWidth, bins - 1);
+}
+
+static void addTo(LinkCounters &counters, const UplinkRecord &record) {
+  counters.uplinks++;
+  if (record.flags & RECORD_CONFIRMED) {
+    counters.confirmed++;
+    if (record.flags & RECORD_ACK) {
+      counters.acks++;
+    } else {
+      counters.misses++;
+    }
+  }
+  if (record.flags & RECORD_LINK_CHECK) {
+    counters.linkChecks++;
+    uint8_t gateways = record.flags >> RECORD_GATEWAYS_SHIFT;
+    if (gateways) {
+      bool isFirst = counters.linkAnswers == 0;
+      counters.linkAnswers++;
+      counters.marginSum += record.linkMargin;
+      counters.marginMin = isFirst ? record.linkMargin : min(counters.marginMin, record.linkMargin);
+      counters.marginMax = isFirst ? record.linkMargin : max(counters.marginMax, record.linkMargin);
+      counters.gatewaySum += gateways;
+    }
+  }
+  if (!(record.flags & (RECORD_RX1 | RECORD_RX2))) {
+    return;
+  }
+
+  bool isFirst = counters.getDownlinks() == 0;
+  if (record.flags & RECORD_RX1) {
+    counters.rx1++;
+  } else {
+    counters.rx2++;
+  }
+  counters.rssiSum += record.rssi;
+  counters.snrSum += record.snr;
+  counters.rssiMin = isFirst ? record.rssi : min(counters.rssiMin, record.rssi);
+  counters.rssiMax = isFirst ? record.rssi : max(counters.rssiMax, record.rssi);
+  counters.snrMin = isFirst ? record.snr : min(counters.snrMin, record.snr);
+  counters.snrMax = isFirst ? record.snr : max(counters.snrMax, record.snr);
+  counters.rssiHistogram[histogramBin(record.rssi, RSSI_HISTOGRAM_MIN, RSSI_HISTOGRAM_BIN,
+                                      RSSI_HISTOGRAM_BINS)]++;
+  // Round the SNR down to whole dB
+  counters.snrHistogram[histogramBin(record.snr >> 2, SNR_HISTOGRAM_MIN, SNR_HISTOGRAM_BIN,
+                                     SNR_HISTOGRAM_BINS)]++;
+}
+
+/**
+ * Add the results of an uplink, including its downlink if any. Only to be invoked on the LMIC core.
+ */
+void LinkStats::add(const UplinkRecord &record) {
+  dr_t dr = recordDataRate(record);
+  sequence.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  addTo(total, record);
+  if (dr < STATS_DATA_RATES) {
+    addTo(dataRates[dr], record);
+  }
+  if (record.channel < MAX_CHANNELS) {
+    addTo(channels[record.channel], record);
+  }
+  sequence.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * Get a number that changes whenever the statistics change.
+ */
+uint32_t LinkStats::getVersion() const {
+  return sequence.load(std::memory_order_acquire);
+}
+
+void LinkStats::read(const LinkCounters &counters, LinkCounters &copy) const {
+  uint32_t before;
+  uint32_t after;
+  do {
+    before = sequence.load(std::memory_order_acquire);
+    copy = counters;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = sequence.load(std::memory_order_relaxed);
+  } while ((before & 1) || before != after);
+}
+
+void LinkStats::getTotal(LinkCounters &copy) const {
+  read(total, copy);
+}
+
+void LinkStats::getDataRate(dr_t dr, LinkCounters &copy) const {
+  read(dataRates[dr], copy);
+}
+
+void LinkStats::getChannel(uint8_t channel, LinkCounters &copy) const {
+  read(channels[channel], copy);
+}
+
+/**
+ * Log the non-empty part of a histogram.
+ */
+static void dumpHistogram(const char *name, const char *label, const uint32_t *histogram,
+                          uint8_t bins, int16_t first, uint8_t binWidth) {
+  uint8_t from = 0;
+  uint8_t to = bins - 1;
+  while (from < to && !histogram[from]) {
+    from++;
+  }
+  while (to > from && !histogram[to]) {
+    to--;
+  }
+  FixedString<11 * RSSI_HISTOGRAM_BINS> counts;
+  for (uint8_t i = from; i <= to; i++) {
+    counts.append(i > from ? "," : "").appendNumber(histogram[i]);
+  }
+  Logger::logf("Stats %s: %s histogram from %d per %u dB: %s", name, label,
+               first + from * binWidth, binWidth, counts.c_str());
+}
+
+/**
+ * Log the link checks and their answers, if any.
+ */
+static void dumpLinkChecks(const char *name, const LinkCounters &c) {
+  if (!c.linkAnswers) {
+    Logger::logf("Stats %s: link checks=%u; answers=0", name, c.linkChecks);
+    return;
+  }
+  Logger::logf("Stats %s: link checks=%u; answers=%u; margin=%.1f (%u..%u) dB; gateways=%.1f",
+               name, c.linkChecks, c.linkAnswers, (float)c.marginSum / c.linkAnswers, c.marginMin,
+               c.marginMax, (float)c.gatewaySum / c.linkAnswers);
+}
+
+/**
+ * Log the counters, the link checks if any, and the histograms if there were any downlinks.
+ */
+static void dumpCounters(const char *name, const LinkCounters &c) {
+  uint32_t downlinks = c.getDownlinks();
+  if (!downlinks) {
+    Logger::logf("Stats %s: uplinks=%u; confirmed=%u; acks=%u; misses=%u; downlinks=0", name,
+                 c.uplinks, c.confirmed, c.acks, c.misses);
+    if (c.linkChecks) {
+      dumpLinkChecks(name, c);
+    }
+    return;
+  }
+  Logger::logf("Stats %s: uplinks=%u; confirmed=%u; acks=%u; misses=%u; rx1=%u; rx2=%u; "
+               "rssi=%.1f (%d..%d) dBm; snr=%.1f (%.1f..%.1f) dB",
+               name, c.uplinks, c.confirmed, c.acks, c.misses, c.rx1, c.rx2,
+               (float)c.rssiSum / downlinks, c.rssiMin, c.rssiMax, c.snrSum / 4.0f / downlinks,
+               c.snrMin / 4.0f, c.snrMax / 4.0f);
+  if (c.linkChecks) {
+    dumpLinkChecks(name, c);
+  }
+  dumpHistogram(name, "rssi", c.rssiHistogram, RSSI_HISTOGRAM_BINS, RSSI_HISTOGRAM_MIN,
+                RSSI_HISTOGRAM_BIN);
+  dumpHistogram(name, "snr", c.snrHistogram, SNR_HISTOGRAM_BINS, SNR_HISTOGRAM_MIN,
+                SNR_HISTOGRAM_BIN);
+}
+
+/**
+ * Log the statistics of a single part of the dump: 0 for the total, followed by the data rates and
+ * the channels. Returns false if nothing was logged, when the part did not see any uplinks. The
+ * dump is split into parts to not overflow the logger.
+ */
+bool LinkStats::dump(uint8_t part) const {
+  LinkCounters counters;
+  FixedString<16> name;
+  if (part == 0) {
+    getTotal(counters);
+    name.append("total");
+  } else if (part <= STATS_DATA_RATES) {
+    dr_t dr = part - 1;
+    getDataRate(dr, counters);
+    name.append("SF").appendNumber(dr == DR_SF7B ? 7 : 12 - dr);
+    name.append(dr == DR_SF7B ? "BW250" : "");
+  } else {
+    uint8_t channel = part - 1 - STATS_DATA_RATES;
+    getChannel(channel, counters);
+    name.append("channel ").appendNumber(channel);
+  }
+  if (part > 0 && !counters.uplinks) {
+    return false;
+  }
+  dumpCounters(name.c_str(), counters);
+  return true;
+}
@@ -1,21 +1,159 @@
 /**
  * A logger that, for its `log` and `logf` methods, prefixes each log entry with the LMIC ticks and
  * the number of seconds since boot.
+ *
+ * Until `startDrainTask` is invoked, this writes to the serial port right away. After that, each
+ * line is copied into a single-producer single-consumer ring of the calling core, and a
+ * low-priority task writes those to the serial port. To have a single producer per ring, the copy
+ * is a critical section that suspends the scheduler of the calling core, which is short as it never
+ * waits for the serial port. So, logging never blocks on the serial port; if the task cannot keep
+ * up, lines are dropped, and counted.
+ *
+ * When built with `-D LOG_BINARY`, this does not format any text on the device at all, but writes
+ * binary records with a format ID and the raw arguments instead; see binarylog.h. Use
+ * tools/decode_log.py to turn those back into text.
  */
 #include <sys/cdefs.h>
+#include "freertos/semphr.h"
+#include "binarylog.h"
 #include "logger.h"
+#include "spscring.h"
+
+// Including the timestamp prefix
+static const size_t LOG_LINE_LENGTH = 256;
+static const size_t LOG_RING_SIZE = 16;
+// How long the drain task sleeps when all rings are empty
+static const TickType_t DRAIN_DELAY = pdMS_TO_TICKS(10);
+
+// Text, or a binary record
+struct LogLine {
+  uint16_t length;
+  uint8_t bytes[LOG_LINE_LENGTH];
+};
+
+// One ring per core, each having a single consumer (the drain task) and a single producer, as
+// output() suspends the scheduler of the calling core while pushing
+static SpscRing<LogLine, LOG_RING_SIZE> rings[portNUM_PROCESSORS];
+static std::atomic<uint32_t> droppedLines{0};
+static std::atomic<bool> isAsync{false};
+// Held while writing to the serial port, to not mix log lines into other output
+static SemaphoreHandle_t serialMutex;
+
+/**
+ * Write the line to the serial port, preceded by the definition of its format if that has not been
+ * written before.
+ */
+static void write(const LogLine &line) {
+  xSemaphoreTake(serialMutex, portMAX_DELAY);
+#ifdef LOG_BINARY
+  uint8_t definition[LOG_LINE_LENGTH];
+  size_t length = BinaryLog::encodeFormatOnce(line.bytes, definition, sizeof(definition));
+  if (length) {
+    Serial.write(definition, length);
+  }
+#endif
+  Serial.write(line.bytes, line.length);
+  xSemaphoreGive(serialMutex);
+}
+
+// Endless loop that does not return
+[[noreturn]] static void drainTask(__unused void *pvParameters) {
+  uint32_t reportedDrops = 0;
+  LogLine line;
+
+  while (true) {
+    // Take turns, to more or less keep the order in which the cores logged
+    bool isDrained;
+    do {
+      isDrained = true;
+      for (auto &ring : rings) {
+        if (ring.pop(line)) {
+          write(line);
+          isDrained = false;
+        }
+      }
+    } while (!isDrained);
+
+    uint32_t drops = Logger::getDroppedCount();
+    if (drops != reportedDrops) {
+      reportedDrops = drops;
+      char warning[40];
+      snprintf(warning, sizeof(warning), "WARNING: logger dropped %u lines\n", drops);
+      xSemaphoreTake(serialMutex, portMAX_DELAY);
+      Serial.print(warning);
+      xSemaphoreGive(serialMutex);
+    }
+
+    vTaskDelay(DRAIN_DELAY);
+  }
+}
+
+/**
+ * Write the line to the serial port, or have the drain task write it.
+ */
+static void output(const LogLine &line) {
+  if (!isAsync.load(std::memory_order_acquire)) {
+    write(line);
+    return;
+  }
+
+  // Another task on the same core must not push into the same ring at the same time
+  vTaskSuspendAll();
+  bool isPushed = rings[xPortGetCoreID()].push(line);
+  xTaskResumeAll();
+
+  if (!isPushed) {
+    droppedLines.fetch_add(1, std::memory_order_relaxed);
+  }
+}
 
 // Global singleton instance to invoke the constructor; not used directly as all methods are static
 __unused Logger logger; // NOLINT(cert-err58-cpp)
 
 Logger::Logger() {
+  serialMutex = xSemaphoreCreateMutex();
   Serial.begin(115200);
   while (!Serial)
     ;
 }
 
 /**
- * Log a single line with the given text, prefixed with the current timestamp and core number.
+ * Start writing to the serial port from a task on the given core, rather than from the caller.
+ */
+void Logger::startDrainTask(BaseType_t core) {
+  // The stack size is trial and error, and includes one LogLine and one binary format definition
+  xTaskCreatePinnedToCore(drainTask, "LogDrainTask",
+                          2048, // Stack size in words
+                          nullptr, // Parameters for the task
+                          tskIDLE_PRIORITY, // Priority of the task
+                          nullptr, // Task handle
+                          core); // Core for the task
+  isAsync.store(true, std::memory_order_release);
+}
+
+/**
+ * Get the number of lines that were dropped as the ring of the logging core was full.
+ */
+uint32_t Logger::getDroppedCount() {
+  return droppedLines.load(std::memory_order_relaxed);
+}
+
+/**
+ * Keep the logger from writing to the serial port, until `endRawOutput`, to allow for writing
+ * binary data. Meanwhile, log lines are queued, or dropped if the rings are full. Blocks until a
+ * line that is being written has completed, so must not be invoked before `startDrainTask`.
+ */
+void Logger::beginRawOutput() {
+  xSemaphoreTake(serialMutex, portMAX_DELAY);
+}
+
+void Logger::endRawOutput() {
+  xSemaphoreGive(serialMutex);
+}
+
+/**
+ * Log a single line with the given text, prefixed with the current timestamp and core number. Like
+ * for `logf`, the text must be a string literal.
  */
 void Logger::log(const char *text) {
   // Of course, one could also invoke Logger::logf with just a single parameter directly
@@ -24,39 +162,72 @@ void Logger::log(const char *text) {
 
 /**
  * Log a single line using a printf-like format and one or more token values, prefixed with the
- * current timestamp and core number.
+ * current timestamp and core number. The format must be a string literal.
  */
 void Logger::logf(const char *format, ...) {
-  char formatted[200] = {0};
-  va_list args;
-  va_start(args, format);
-  vsnprintf(formatted, 200, format, args);
-  va_end(args);
-
   // For `framework = arduino` logging should probably use the built-in `log_i` (or even `ESP_LOGI`,
   // though that is is actually delegated to the first for which its required `TAG` is lost; see
   // https://github.com/espressif/arduino-esp32/blob/1.0.4/cores/esp32/esp32-hal-log.h#L142-L146),
   // along with some `-D CORE_DEBUG_LEVEL=ARDUHAL_LOG_LEVEL_INFO`. However, a semicolon after those
   // macros will make Clang-Tidy complain about an empty statement.
+  LogLine line;
+  va_list args;
+
+#ifdef LOG_BINARY
+  va_start(args, format);
+  line.length = BinaryLog::encodeLog(line.bytes, LOG_LINE_LENGTH, format, args);
+  va_end(args);
+  if (line.length) {
+    output(line);
+    return;
+  }
+  // The format is not supported, or too many formats are in use; fall back to text
+#endif
+
   unsigned long ms = millis();
+  char *text = reinterpret_cast<char *>(line.bytes);
   // NOLINTNEXTLINE(cppcoreguidelines-narrowing-conversions)
-  Logger::printf("[%d/%lums/%.1fs][%d] %s\n", os_getTime(), ms, ms / 1000.0, xPortGetCoreID(),
-                 formatted);
+  int length = snprintf(text, LOG_LINE_LENGTH, "[%d/%lums/%.1fs][%d] ", os_getTime(), ms,
+                        ms / 1000.0, xPortGetCoreID());
+
+  // Format once, right after the prefix, leaving room for the newline
+  va_start(args, format);
+  vsnprintf(text + length, LOG_LINE_LENGTH - length - 1, format, args);
+  va_end(args);
+  strcat(text, "\n");
+  line.length = strlen(text);
+  output(line);
 }
 
+/**
+ * Print using a printf-like format, without a timestamp. The format must be a string literal.
+ */
 void Logger::printf(const char *format, ...) {
-  char formatted[200] = {0};
+  LogLine line;
   va_list args;
+
+#ifdef LOG_BINARY
+  va_start(args, format);
+  line.length = BinaryLog::encodePrint(line.bytes, LOG_LINE_LENGTH, format, args);
+  va_end(args);
+  if (line.length) {
+    output(line);
+    return;
+  }
+#endif
+
+  char *text = reinterpret_cast<char *>(line.bytes);
   va_start(args, format);
-  vsnprintf(formatted, 200, format, args);
+  vsnprintf(text, LOG_LINE_LENGTH, format, args);
   va_end(args);
-  Serial.print(formatted);
+  line.length = strlen(text);
+  output(line);
 }
 
 void Logger::println() {
-  Serial.println();
+  Logger::printf("\r\n");
 }
 
 void Logger::println(const char *text) {
-  Serial.println(text);
+  Logger::printf("%s\r\n", text);
 }
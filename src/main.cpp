@@ -2,130 +2,431 @@
  * Test LoRaWAN uplinks by quickly cycling through different data rates, (ab)using the EU868 maximum
  * duty cycle, optionally using confirmed uplinks to also test downlinks (but without actually
  * retrying if no confirmation is received), and always using the maximum transmission power.
+ * Optionally, a governor paces the uplinks to stay within the TTN Fair Access Policy instead.
  *
  * This code is specific for EU868 on The Things Network.
  */
 #include "SPI.h"
-#include "OneButton.h"
 #include "lmic.h"
 #include "hal/hal.h"
+#include "adaptivedatarate.h"
+#include "airtime.h"
+#include "button.h"
+#include "clockcalibration.h"
 #include "config.h"
+#include "cpustats.h"
 #include "display.h"
+#include "dutycycle.h"
+#include "fairaccess.h"
+#include "fixedstring.h"
+#include "heapstats.h"
+#include "idleloop.h"
+#include "linkcheck.h"
+#include "linkstats.h"
 #include "logger.h"
+#include "payloadsweep.h"
+#include "radiometrics.h"
+#include "radiotiming.h"
+#include "serialprotocol.h"
+#include "spscring.h"
+#include "testplans.h"
+#include "uplinkstore.h"
 
 bool isConfirmed = false;
+// Whether to send a LinkCheckReq to get the margin and gateway count of each uplink
+bool isLinkCheck = false;
 bool isAutoDataRate = true;
 
-// The order in which to cycle through data rates if isAutoDataRate == true. This order prioritizes
-// testing the better data rates, while balancing the waiting time between uplinks, and while still
-// allowing for quickly switching to manual mode after starting. This does not test DR_SF7B (known
-// as DR6, SF7BW250) nor FSK, which will both be short range anyhow. Assume EU868;
-static const uint8_t dataRates[] = {DR_SF7, DR_SF8,  DR_SF9, DR_SF7, DR_SF12, DR_SF7,
-                                    DR_SF8, DR_SF10, DR_SF8, DR_SF9, DR_SF11, DR_SF7};
+// The order in which to cycle through data rates if isAutoDataRate == true and no test plan from
+// flash is selected. This order prioritizes testing the better data rates, while balancing the
+// waiting time between uplinks, and while still allowing for quickly switching to manual mode after
+// starting. This does not test DR_SF7B (known as DR6, SF7BW250) nor FSK, which will both be short
+// range anyhow. Assume EU868; a test plan may replace this, see serialprotocol.cpp.
+static const uint8_t MAX_DATA_RATES = 16;
+uint8_t dataRates[MAX_DATA_RATES] = {DR_SF7, DR_SF8,  DR_SF9, DR_SF7, DR_SF12, DR_SF7,
+                                     DR_SF8, DR_SF10, DR_SF8, DR_SF9, DR_SF11, DR_SF7};
+uint8_t dataRateCount = 12;
 
 // The running index of the next data rate in array `dataRates`, if isAutoDataRate == true
 int8_t dataRateIdx = -1;
 uint8_t dataRate;
 
-// Re-use the state as used by Display; we could also have defined our own instead
-State state = STATE_NOP;
+// The size of the application payload, and the channels to use, as set by a test plan. The
+// channels configured in setupLMIC may all be used; a step of a plan from flash may select just
+// one.
+uint8_t payloadSize = 1;
+uint16_t configuredChannels;
+uint16_t enabledChannels;
+
+// A run stops after runLength uplinks, if not zero. While a test plan is running, the results of
+// the uplinks are queued on the LMIC core, to be written to the serial port when no transmission
+// is pending.
+uint32_t runLength = 0;
+uint32_t runUplinks = 0;
+bool isStreaming = false;
+bool isDonePending = false;
+// After a run was stopped or completed, no uplink is scheduled until resumeUplinks
+bool isStopped = false;
+SpscRing<UplinkRecord, 4> results;
+
+/**
+ * Snapshot of a TX/RX state transition, published by the LMIC core for stateAndDisplayTask, so the
+ * latter never reads the LMIC state while LMIC is changing it.
+ */
+struct LinkEvent {
+  // Re-use the state as used by Display; we could also have defined our own instead
+  State state;
+  // For STATE_WAITING, STATE_RX1 and STATE_RX2: when the transmission or receive window starts
+  ostime_t targetTime;
+  // For STATE_RX1: when the transmission completed
+  ostime_t txEnd;
+  uint32_t seqnoUp;
+  uint32_t freq;
+  uint8_t sf;
+  // For STATE_WAITING, if the Fair Access Policy governor is enabled: what is left of the budget of
+  // the last 24 hours
+  bool hasBudget;
+  uint32_t airtimeLeftMs;
+  uint8_t downlinksLeft;
+  // For STATE_RXDONE: details of the downlink, if any
+  bool hasRxDetails;
+  DisplayText rxDetails;
+};
+
+// Produced on the LMIC core, consumed by stateAndDisplayTask on the other core
+SpscRing<LinkEvent, 16> linkEvents;
+std::atomic<uint32_t> droppedLinkEvents{0};
+
+/**
+ * A change of the uplink settings, requested using the button.
+ */
+enum Command : uint8_t { COMMAND_NEXT_DATA_RATE, COMMAND_TOGGLE_CONFIRMED, COMMAND_TOGGLE_AUTO };
+
+// Produced by the button task, consumed on the LMIC core while no transmission is pending
+SpscRing<Command, 8> commands;
+
+TaskHandle_t stateAndDisplayTaskHandle = nullptr;
+// The number of times stateAndDisplayTask woke up, and how many of those were due to a notification
+std::atomic<uint32_t> displayWakeups{0};
+std::atomic<uint32_t> notifiedDisplayWakeups{0};
 
 // After TX, LMIC.seqnoUp will already be increased while still awaiting the receive windows
 uint32_t seqnoUp = LMIC.seqnoUp;
+uint8_t txChannel;
 uint32_t txFreq;
-ostime_t rx1time;
-ostime_t rx2time;
+// The time the next transmission is scheduled for, at which the duty cycle allows for it
+ostime_t txTime;
+// The SF of the current transmission, as the user may select another while awaiting RX1 and RX2
+uint8_t txSf;
+uint32_t txStartMillis;
+// The Fair Access Policy governor took the downlink of the current transmission from its bucket
+bool isDownlinkTaken = false;
+// The number of receive windows LMIC has set up for the current transmission, and the last start
+// time LMIC set for such window
+uint8_t rxWindowCount;
+ostime_t lastRxTime;
+bool isTxRxPending = false;
+
+// Only used in stateAndDisplayTask
+State state = STATE_NOP;
+ostime_t countdownTime;
+
+/**
+ * Make stateAndDisplayTask handle a change right away, rather than at its next scheduled tick.
+ */
+static void wakeStateAndDisplayTask() {
+  if (stateAndDisplayTaskHandle) {
+    xTaskNotifyGive(stateAndDisplayTaskHandle);
+  }
+}
 
 static void toggleConfirmed() {
   isConfirmed = !isConfirmed;
   display.setIsConfirmedUplink(isConfirmed);
 }
 
+/**
+ * Use the settings of a step of the selected test plan from flash for the next uplink.
+ */
+static void applyPlanStep(const PlanStep &step) {
+  dataRate = step.dataRate;
+  payloadSize = step.payloadSize;
+  isConfirmed = step.flags & PLAN_STEP_CONFIRMED;
+  display.setIsConfirmedUplink(isConfirmed);
+  // Select the channel by disabling all others, as used for the duty cycle bookkeeping too
+  bool isChannel = step.channel != PLAN_ANY_CHANNEL && (configuredChannels >> step.channel & 1);
+  LMIC.channelMap = isChannel ? 1 << step.channel : enabledChannels;
+}
+
+/**
+ * Select a test plan from flash, or the built-in data rates for NO_TEST_PLAN, starting with the
+ * next uplink that is scheduled.
+ */
+static void selectTestPlan(uint16_t index) {
+  testPlans.select(index);
+  if (!testPlans.getSelected()) {
+    LMIC.channelMap = enabledChannels;
+  }
+}
+
+/**
+ * Enable or disable the payload sweep, which takes precedence over the test plans and data rates,
+ * starting with the next uplink that is scheduled.
+ */
+static void setPayloadSweep(bool enabled) {
+  payloadSweep.setEnabled(enabled);
+  LMIC.channelMap = enabledChannels;
+  if (!enabled) {
+    payloadSize = Airtime::PAYLOAD_LENGTH;
+    testPlans.restart();
+  }
+  Logger::logf("Payload sweep %s", enabled ? "enabled" : "disabled");
+}
+
+/**
+ * Get the distinct data rates of array `dataRates`, as a bitmask.
+ */
+static uint16_t getDataRateMask() {
+  uint16_t mask = 0;
+  for (uint8_t i = 0; i < dataRateCount; i++) {
+    mask |= 1 << dataRates[i];
+  }
+  return mask;
+}
+
+/**
+ * Enable or disable the adaptive selection of the automatic data rates, starting with the next
+ * uplink that is scheduled, and log its results when disabled.
+ */
+static void setAdaptiveDataRate(bool enabled) {
+  adaptiveDataRate.setEnabled(enabled);
+  Logger::logf("Adaptive data rate %s", enabled ? "enabled" : "disabled");
+  if (!enabled) {
+    adaptiveDataRate.dump();
+  }
+}
+
+/**
+ * Disable the adaptive data rate once the success rate of each data rate is known well enough,
+ * returning true if it was just disabled.
+ */
+static bool completeAdaptiveDataRate() {
+  if (!adaptiveDataRate.getEnabled() || !adaptiveDataRate.isAllConverged(getDataRateMask())) {
+    return false;
+  }
+  Logger::log("Adaptive data rate: all data rates converged");
+  setAdaptiveDataRate(false);
+  return true;
+}
+
+/**
+ * Enable or disable the Fair Access Policy governor, starting with the next uplink that is
+ * scheduled.
+ */
+static void setFairAccess(bool enabled) {
+  fairAccess.setEnabled(enabled);
+  Logger::logf("Fair access governor %s", enabled ? "enabled" : "disabled");
+}
+
+/**
+ * Enable or disable sending a LinkCheckReq, starting with the next uplink that is scheduled.
+ */
+static void setLinkCheck(bool enabled) {
+  isLinkCheck = enabled;
+  Logger::logf("Link check %s", enabled ? "enabled" : "disabled");
+}
+
+/**
+ * Tell if the adaptive data rate selects the data rates, as the payload sweep takes precedence.
+ */
+static bool isAdaptiveDataRate() {
+  return adaptiveDataRate.getEnabled() && isAutoDataRate && !payloadSweep.getEnabled();
+}
+
+/**
+ * Tell if the next uplink is requested to be confirmed. The adaptive data rate always requests
+ * that, as only an ACK tells if an uplink was received, but leaves the user's setting as is.
+ */
+static bool isConfirmedUplink() {
+  return isConfirmed || isAdaptiveDataRate();
+}
+
 static void nextDataRate() {
-  if (isAutoDataRate) {
-    dataRateIdx = (dataRateIdx + 1) % (int)(sizeof(dataRates) / sizeof(dataRates[0]));
+  if (payloadSweep.getEnabled() && isAutoDataRate) {
+    payloadSweep.next(dataRate, payloadSize);
+  } else if (isAdaptiveDataRate()) {
+    dataRate = adaptiveDataRate.next(getDataRateMask(), payloadSize);
+  } else if (testPlans.getSelected()) {
+    applyPlanStep(isAutoDataRate ? testPlans.nextStep() : testPlans.skipStep());
+  } else if (isAutoDataRate) {
+    dataRateIdx = (dataRateIdx + 1) % dataRateCount;
     dataRate = dataRates[dataRateIdx];
   } else {
     // Assume EU868, DR_SF7 thru DR_SF12
-    dataRateIdx = (dataRateIdx + 1) % 6;
+    dataRateIdx = (dataRateIdx + 1) % TESTED_DATA_RATES;
     dataRate = DR_SF7 - dataRateIdx;
   }
 
   // Assume EU868
   display.setTxSpreadingFactor(12 - dataRate);
+  display.setIsConfirmedUplink(isConfirmedUplink());
 }
 
 static void toggleAutoDataRate() {
   isAutoDataRate = !isAutoDataRate;
   display.setIsFixedDataRate(!isAutoDataRate);
-  // Changing the data rate for a canceled/delayed TX may make LMIC select another frequency when
-  // scheduling the transmission again. We cannot tell at this point.
+  // All channels support SF7 thru SF12, so this will not change the channel or time of the next
+  // transmission, unless a test plan selects another channel
   dataRateIdx = -1;
+  testPlans.restart();
+  payloadSweep.restart();
   nextDataRate();
 }
 
 /**
- * Update the current state, using the internals of the LMIC timing.
+ * Publish a state transition; only to be invoked on the LMIC core. This never blocks; if
+ * stateAndDisplayTask did not keep up, the event is dropped.
  */
-void updateStateAndDisplay() {
-  ostime_t now = os_getTime();
-
-  // Even if we canceled a scheduled transmission, LMIC.txend will still be set
-  if (state == STATE_RXDONE && LMIC.txend - now > 0) {
-    state = STATE_WAITING;
-    int32_t targetMs = osticks2ms(LMIC.txend);
-    Logger::logf("TX at %d ticks/%.1f sec", LMIC.txend, targetMs / 1000.0);
-    display.startWaitTx(targetMs);
+static void publishLinkEvent(const LinkEvent &event) {
+  if (!linkEvents.push(event)) {
+    droppedLinkEvents++;
   }
+  wakeStateAndDisplayTask();
+}
 
-  // The very first transmission has no waiting time
-  if ((state == STATE_NOP || state == STATE_WAITING) && (now - LMIC.txend > 0)) {
-    state = STATE_TX;
-    // The transmission is also logged in do_send, but this can help debugging timing problems, like
-    // when this is logged after seeing EV_TXCOMPLETE
-    Logger::log("TX");
-    display.startTx();
+/**
+ * Publish the transitions for which LMIC does not fire an event: the end of the transmission, for
+ * which LMIC sets the start of RX1, and the end of RX1, for which LMIC sets the start of RX2. This
+ * runs on the LMIC core, in between LMIC's jobs, so always sees a consistent LMIC state.
+ */
+void publishRxWindows() {
+  // When a downlink is received, LMIC sets LMIC.rxtime to the time of reception, which is in the
+  // past; only a time in the future is the start of a receive window
+  if (!isTxRxPending || LMIC.rxtime == lastRxTime || LMIC.rxtime - os_getTime() <= 0) {
+    return;
   }
-
-  // When transmission starts, LMIC.txend will temporarily be zero; when done, it will be set to the
-  // exact time transmission completed
-  if (state == STATE_TX && (LMIC.rxtime - now > 0)) {
-    state = STATE_RX1;
-    rx1time = LMIC.rxtime;
-    int32_t targetMs = osticks2ms(rx1time);
-
-    // LMIC.seqnoUp has already been increased; we may use LMIC.datarate and LMIC.freq as long as
-    // RX1 has not started
-    Logger::logf(
-        "TX done: seqnoUp=%d; SF=%d; freq=%.1f; txend=%d ticks/%.1f sec; RX1 at %d ticks/%.1f sec",
-        seqnoUp, 12 - LMIC.datarate, LMIC.freq / 1E6, LMIC.txend, osticks2ms(LMIC.txend) / 1000.0,
-        rx1time, targetMs / 1000.0);
-    display.startWaitRx1(targetMs);
+  lastRxTime = LMIC.rxtime;
+
+  LinkEvent event{};
+  event.state = ++rxWindowCount == 1 ? STATE_RX1 : STATE_RX2;
+  if (event.state == STATE_RX1) {
+    ostime_t dioTxEnd;
+    if (radioTiming.addTxEnd(LMIC.txend, dioTxEnd)) {
+      clockCalibration.setTxEnd(dioTxEnd);
+    }
+    clockCalibration.addRx1Window(LMIC.txend, LMIC.rxtime);
   }
+  event.targetTime = LMIC.rxtime;
+  event.txEnd = LMIC.txend;
+  event.seqnoUp = seqnoUp;
+  // LMIC.freq changes when RX2 starts
+  event.freq = LMIC.freq;
+  event.sf = txSf;
+  publishLinkEvent(event);
+}
 
-  // If LMIC has set a new value for LMIC.rxtime, then it has completed RX1
-  if (state == STATE_RX1 && (LMIC.rxtime - rx1time > 0)) {
-    state = STATE_RX2;
-    rx2time = LMIC.rxtime;
-    int32_t targetMs = osticks2ms(rx2time);
-    Logger::logf("RX1 done: RX2 at %d ticks/%.1f sec", rx2time, targetMs / 1000.0);
-    display.startWaitRx2(targetMs);
+/**
+ * Update the current state and the display, using the events published by the LMIC core.
+ */
+void updateStateAndDisplay() {
+  LinkEvent event;
+  while (linkEvents.pop(event)) {
+    state = event.state;
+    int32_t targetMs = osticks2ms(event.targetTime);
+
+    switch (event.state) {
+      case STATE_WAITING:
+        countdownTime = event.targetTime;
+        Logger::logf("TX at %d ticks/%.1f sec", event.targetTime, targetMs / 1000.0);
+        display.setTxCount(event.seqnoUp);
+        display.setTxFreq(event.freq);
+        display.setBudget(event.hasBudget, event.airtimeLeftMs, event.downlinksLeft);
+        display.startWaitTx(targetMs);
+        break;
+
+      case STATE_TX:
+        // The transmission is also logged in do_send, but this can help debugging timing problems
+        Logger::log("TX");
+        // LMIC may have selected another channel than the one that was scheduled
+        display.setTxFreq(event.freq);
+        display.startTx();
+        break;
+
+      case STATE_RX1:
+        Logger::logf("TX done: seqnoUp=%d; SF=%d; freq=%.1f; txend=%d ticks/%.1f sec; RX1 at %d "
+                     "ticks/%.1f sec",
+                     event.seqnoUp, event.sf, event.freq / 1E6, event.txEnd,
+                     osticks2ms(event.txEnd) / 1000.0, event.targetTime, targetMs / 1000.0);
+        display.startWaitRx1(targetMs);
+        break;
+
+      case STATE_RX2:
+        Logger::logf("RX1 done: RX2 at %d ticks/%.1f sec", event.targetTime, targetMs / 1000.0);
+        display.startWaitRx2(targetMs);
+        break;
+
+      case STATE_RXDONE:
+        // RX2 is skipped if a downlink is received in RX1
+        if (event.hasRxDetails) {
+          display.setRxDetails(event.rxDetails.c_str());
+        }
+        Logger::log("RX done");
+        display.stop();
+        break;
+
+      case STATE_NOP:
+        // A run of a test plan completed or was stopped
+        Logger::log("Stopped");
+        display.stop();
+        break;
+
+      default:
+        break;
+    }
   }
 
-  // RX2 is skipped if a downlink is received in RX1
-  if ((state == STATE_RX1 || state == STATE_RX2) && (LMIC.opmode & OP_TXRXPEND) == 0) {
-    // We could also set this in the LMIC onEvent handler
-    state = STATE_RXDONE;
-    Logger::log("RX done");
-    display.stop();
+  static uint32_t reportedDrops = 0;
+  uint32_t drops = droppedLinkEvents.load(std::memory_order_relaxed);
+  if (drops != reportedDrops) {
+    reportedDrops = drops;
+    Logger::logf("ERROR: dropped %d state transitions", drops);
   }
 }
 
 static osjob_t sendjob;
 
 /**
- * Schedule a new transmission, immediately canceling and re-scheduling if LMIC did not send right
- * away, to allow for changing the transmission parameters while awaiting the duty cycle limit.
+ * Apply the settings requested using the button, returning true if there were any. Only to be
+ * invoked on the LMIC core while no transmission or reception is pending, so the display never
+ * shows new settings along with the results of an uplink that used the old settings.
+ */
+static bool applyCommands() {
+  Command command;
+  bool isApplied = false;
+  while (commands.pop(command)) {
+    switch (command) {
+      case COMMAND_NEXT_DATA_RATE:
+        nextDataRate();
+        break;
+      case COMMAND_TOGGLE_CONFIRMED:
+        toggleConfirmed();
+        break;
+      case COMMAND_TOGGLE_AUTO:
+        toggleAutoDataRate();
+        break;
+    }
+    isApplied = true;
+  }
+  if (isApplied) {
+    wakeStateAndDisplayTask();
+  }
+  return isApplied;
+}
+
+/**
+ * Transmit right away, assuming this is invoked at the time the duty cycle allows for it. This uses
+ * the settings at that time, to allow for changing the transmission parameters while awaiting the
+ * duty cycle limit.
  */
 void do_send(__unused osjob_t *j) {
   // Check if there is not a current TX/RX job running; should not happen
@@ -134,72 +435,78 @@ void do_send(__unused osjob_t *j) {
     return;
   }
 
-  if (isAutoDataRate && state != STATE_WAITING) {
-    nextDataRate();
-    Logger::logf("Next auto data rate index=%d", dataRateIdx);
-  }
+  radioTiming.addSendLag(os_getTime() - txTime);
+
+  // Any button presses right before the transmission
+  applyCommands();
 
   // Data rate and transmission power
   LMIC_setDrTxpow(dataRate, 14);
 
-  // Dummy data; this is redundant (already known in TTN Console/MQTT). Assume EU868; SF in BCD,
-  // binary-coded decimal, so: 0x07, 08, 09, 10, 11, 12 rather than 0x07 thru 0x0C.
-  uint8_t data[1];
+  // Make LMIC select the channel we scheduled this job for, by temporarily disabling all others.
+  // LMIC only selects a new channel if OP_NEXTCHNL is set, which it does after each transmission,
+  // or when changing the data rate.
+  uint16_t channelMap = LMIC.channelMap;
+  LMIC.channelMap = 1 << txChannel;
+  LMIC.opmode |= OP_NEXTCHNL;
+
+  // Dummy data; the SF is redundant (already known in TTN Console/MQTT). A test plan or the payload
+  // sweep may set a larger payload size, for which the length and uplink counter are added, but
+  // never more than the data rate allows.
+  uint8_t data[MAX_LEN_PAYLOAD];
   u1_t sf = 12 - dataRate;
-  data[0] = (sf / 10u) << 4 | (sf % 10u);
-
-  // Save BEFORE scheduling, as it will change immediately after transmission has completed (and
-  // scheduling may actually yield an immediate transmission) while we want to show the uplink
-  // counter while awaiting the RX1 and RX2 as well. We could also capture this next value in the
-  // EV_TXCOMPLETE event.
-  seqnoUp = LMIC.seqnoUp;
-  display.setTxCount(seqnoUp);
+  uint8_t length = min(payloadSize, Airtime::maxPayloadLength(dataRate));
+  PayloadSweep::fillPayload(data, length, sf, seqnoUp);
+
+  // The Fair Access Policy governor may send a requested confirmed uplink as unconfirmed, and may
+  // skip a requested link check, as both take a downlink
+  bool isRequested = isConfirmedUplink() || isLinkCheck;
+  isDownlinkTaken = isRequested && fairAccess.getEnabled() &&
+                    fairAccess.takeDownlink(dataRate, isAdaptiveDataRate());
+  bool isDownlink = isRequested && (!fairAccess.getEnabled() || isDownlinkTaken);
+  bool confirmed = isConfirmedUplink() && isDownlink;
+
+  // Open the receive windows just early enough for this data rate
+  LMIC_setClockError(clockCalibration.getClockError(dataRate));
+
+  // Send an uplink on port number matching SF. As this has been scheduled at the time the duty
+  // cycle allows for it, LMIC will start the transmission right away. "Strict" to ensure LMIC does
+  // not adjust the data rate if the payload would be too long for the given data rate (which, of
+  // course, will not happen here).
+  if (isLinkCheck && isDownlink) {
+    // LMIC cannot add a LinkCheckReq to the FOpts of an uplink, so send it as the only MAC command
+    // on port 0 instead, which replaces the dummy data
+    data[0] = LinkCheck::CID;
+    LMIC_setTxData2_strict(0, data, LinkCheck::REQUEST_LENGTH, confirmed ? 1 : 0);
+  } else {
+    LMIC_setTxData2_strict(sf, data, length, confirmed ? 1 : 0);
+  }
 
-  // Send or enqueue an uplink on port number matching SF, unconfirmed. As this has been scheduled
-  // in the TX_COMPLETE event, without taking the maximum duty cycle into account, LMIC might delay
-  // the actual transmission. "Strict" to ensure LMIC does not adjust the data rate if the payload
-  // would be too long for the given data rate (which, of course, will not happen here).
-  LMIC_setTxData2_strict(sf, data, sizeof(data), isConfirmed ? 1 : 0);
+  // LMIC has selected the channel, and will keep using that if it has to delay the transmission
+  LMIC.channelMap = channelMap;
 
   // Disable the retries for confirmed uplinks by fooling LMIC into thinking it has already done
   // all of its 8 attempts. This also ensures LMIC will not retry with a slower data rate. See
   // https://github.com/mcci-catena/arduino-LMIC/blob/v3.2.0/src/LMIC/LMIC.c#L2285 and
   // https://www.thethingsnetwork.org/forum/t/2902/6
-  if (isConfirmed) {
+  if (confirmed) {
     LMIC.txCnt = TXCONF_ATTEMPTS;
   }
 
   // LMIC.freq will only be set when TX begins, and changes when RX2 starts. LMIC.txChnl is
   // documented as "channel for next TX" and is in fact not changed until the receive windows have
-  // been handled.
+  // been handled. This should be the channel that was selected when scheduling this job.
   txFreq = LMIC.channelFreq[LMIC.txChnl];
-  display.setTxFreq(txFreq);
-
-  int waitTicks = LMIC.txend - os_getTime();
-
-  if (waitTicks > 0) {
-    // Now that we know how many ticks to wait: cancel, and re-schedule to allow for changing the
-    // settings (like SF or toggling confirmed uplinks) just before the transmission is allowed.
-    // This may include a 3-5 second safety zone. After canceling, the next TX for the very same
-    // DR will use the same channel. But when using a different DR then LMIC may also select
-    // another channel.
-    float waitSeconds = osticks2ms(waitTicks) / 1000.0;
-    Logger::logf(
-        "Cannot send yet, rescheduling: seqnoUp=%d; SF=%d; freq=%.1f; wait=%lu ticks/%.1f sec",
-        LMIC.seqnoUp, 12 - LMIC.datarate, txFreq / 1E6, waitTicks, waitSeconds);
-
-    LMIC_clrTxData();
-    os_setTimedCallback(&sendjob, os_getTime() + waitTicks, do_send);
+
+  if ((LMIC.opmode & OP_TXRXPEND) == 0) {
+    // Our duty cycle bookkeeping is off; LMIC will send a bit later, so just let it do its thing
+    Logger::logf("WARNING: LMIC delayed TX: seqnoUp=%d; wait=%d ticks", seqnoUp,
+                 LMIC.txend - os_getTime());
     return;
   }
 
-  String txPayload = "";
-  for (int i = 0; i < LMIC.dataLen; i++) {
-    if (LMIC.frame[i] < 0x10) {
-      txPayload += "0";
-    }
-    txPayload += String(LMIC.frame[i], HEX);
-  }
+  FixedString<2 * MAX_LEN_FRAME> txPayload;
+  txPayload.appendHex(LMIC.frame, LMIC.dataLen);
 
   // We know that LMIC will have started transmission right away; in fact it will already have fired
   // EV_TXSTART and have increased LMIC.seqnoUp
@@ -207,6 +514,178 @@ void do_send(__unused osjob_t *j) {
                LMIC.freq / 1E6, LMIC.dataLen, txPayload.c_str());
 }
 
+/**
+ * Schedule the next transmission at the exact time the maximum duty cycle allows for it, selecting
+ * the next data rate if applicable, and showing the next uplink's details while waiting.
+ */
+void scheduleNextTx() {
+  if (isAutoDataRate) {
+    nextDataRate();
+    Logger::logf("Next auto data rate index=%d", dataRateIdx);
+  }
+
+  // LMIC.seqnoUp has already been increased for the next uplink; save as it will change right after
+  // the next transmission, while we want to show its uplink counter while awaiting RX1 and RX2 too
+  seqnoUp = LMIC.seqnoUp;
+
+  // Use the channel in the sub-band that becomes available first
+  ostime_t now = os_getTime();
+  TxSlot slot = dutyCycle.nextTx(dataRate, now);
+  txChannel = slot.channel;
+  txFreq = LMIC.channelFreq[txChannel];
+
+  txTime = slot.time;
+  LinkEvent event{};
+  if (fairAccess.getEnabled()) {
+    // Wait longer if the Fair Access Policy budget does not allow for the uplink's airtime yet, or,
+    // as the adaptive data rate only learns from confirmed uplinks, for its downlink
+    uint8_t length = min(payloadSize, Airtime::maxPayloadLength(dataRate));
+    uint32_t delayMs = fairAccess.getDelayMillis(dataRate, Airtime::LORAWAN_OVERHEAD + length,
+                                                 isAdaptiveDataRate());
+    if (delayMs > (uint32_t)osticks2ms(txTime - now)) {
+      txTime = now + ms2osticks(delayMs);
+    }
+    fairAccess.log();
+    event.hasBudget = true;
+    event.airtimeLeftMs = fairAccess.getAirtimeLeftMillis();
+    event.downlinksLeft = fairAccess.getDownlinksLeft();
+  }
+  event.state = STATE_WAITING;
+  event.targetTime = txTime;
+  event.seqnoUp = seqnoUp;
+  event.freq = txFreq;
+  event.sf = 12 - dataRate;
+  publishLinkEvent(event);
+
+  Logger::logf("Next TX: seqnoUp=%d; SF=%d; freq=%.1f; wait=%d ticks/%.1f sec; uplinks/hour=%.1f",
+               seqnoUp, 12 - dataRate, txFreq / 1E6, txTime - now,
+               osticks2ms(txTime - now) / 1000.0, dutyCycle.getUplinksPerHour());
+
+  // This should be zero, except for the very first uplinks
+  static uint32_t allocationCount = 0;
+  uint32_t count = HeapStats::getAllocationCount();
+  Logger::logf("Heap allocations since previous uplink: %u", count - allocationCount);
+  allocationCount = count;
+
+  static uint32_t wakeupCount = 0;
+  static uint32_t notifiedCount = 0;
+  uint32_t wakeups = displayWakeups;
+  uint32_t notified = notifiedDisplayWakeups;
+  Logger::logf("Display task wakeups since previous uplink: %u; notified: %u",
+               wakeups - wakeupCount, notified - notifiedCount);
+  wakeupCount = wakeups;
+  notifiedCount = notified;
+
+  static uint32_t sleepCount = 0;
+  uint32_t sleeps = idleLoop.getSleepCount();
+  float idle[portNUM_PROCESSORS];
+  CpuStats::getIdlePercentages(idle);
+  Logger::logf("CPU idle since previous uplink: core 0: %.1f%%; core 1: %.1f%%; loop sleeps: %u",
+               idle[0], idle[1], sleeps - sleepCount);
+  sleepCount = sleeps;
+  os_setTimedCallback(&sendjob, txTime, do_send);
+}
+
+/**
+ * Tell if the last uplink held a LinkCheckReq.
+ */
+static bool isLinkCheckSent() {
+  return LMIC.pendTxPort == 0 && LMIC.pendTxLen && LMIC.pendTxData[0] == LinkCheck::CID;
+}
+
+/**
+ * Get the LinkCheckAns of the last uplink, if it held a LinkCheckReq and the answer was received.
+ */
+static bool getLinkCheckAnswer(LinkCheck::Answer &answer) {
+  return isLinkCheckSent() && LinkCheck::getAnswer(answer);
+}
+
+/**
+ * Persist the results of the transmission that just completed, including its receive windows, and
+ * add them to the statistics.
+ */
+void storeUplinkRecord() {
+  UplinkRecord record{};
+  record.seqnoUp = seqnoUp;
+  record.sf = txSf;
+  // Like LMIC.freq, LMIC.txChnl will only change for the next transmission
+  record.channel = LMIC.txChnl;
+  record.freq = LMIC.channelFreq[LMIC.txChnl] & ~(u4_t)0x3;
+  record.txMillis = txStartMillis;
+  record.completeMillis = millis();
+  record.payloadSize = LMIC.pendTxLen;
+  record.flags = LMIC.pendTxConf ? RECORD_CONFIRMED : 0;
+  LinkCheck::Answer answer;
+  bool isAnswer = getLinkCheckAnswer(answer);
+  if (isLinkCheckSent()) {
+    record.flags |= RECORD_LINK_CHECK;
+  }
+  if (isAnswer) {
+    // Not zero, as at least one gateway received the uplink
+    uint8_t gateways = max(min(answer.gateways, RECORD_MAX_GATEWAYS), (uint8_t)1);
+    record.flags |= gateways << RECORD_GATEWAYS_SHIFT;
+    record.linkMargin = answer.margin;
+  }
+  if ((LMIC.txrxFlags & TXRX_ACK) || LMIC.dataLen || isAnswer) {
+    record.flags |= (LMIC.txrxFlags & TXRX_ACK) ? RECORD_ACK : 0;
+    record.flags |= (LMIC.txrxFlags & TXRX_DNW1) ? RECORD_RX1 : RECORD_RX2;
+    record.rxLength = LMIC.dataLen;
+    // The SX1276 may report down to -137 dBm, which does not fit
+    record.rssi = max(LMIC.rssi - RSSI_OFF, INT8_MIN);
+    record.snr = LMIC.snr;
+  }
+  linkStats.add(record);
+  payloadSweep.add(record);
+  adaptiveDataRate.add(record);
+  if (!isDownlinkTaken && (record.flags & (RECORD_RX1 | RECORD_RX2))) {
+    // Like a MAC command from the network, or any downlink while the governor is disabled
+    fairAccess.registerDownlink();
+  }
+  uplinkStore.append(record);
+  if (isStreaming && !results.push(record)) {
+    Logger::log("WARNING: dropped the result of an uplink");
+  }
+}
+
+/**
+ * Publish that no transmission is scheduled, for the display to stop its countdown.
+ */
+static void publishStopped() {
+  LinkEvent event{};
+  event.state = STATE_NOP;
+  event.seqnoUp = seqnoUp;
+  publishLinkEvent(event);
+}
+
+/**
+ * Schedule the next transmission, unless the run length of a running test plan has been reached,
+ * or the adaptive data rate of a running test plan has converged.
+ */
+static void continueRun() {
+  runUplinks++;
+  bool isConverged = completeAdaptiveDataRate();
+  if (isStreaming && ((runLength && runUplinks >= runLength) || isConverged)) {
+    Logger::logf("Run completed after %u uplinks", runUplinks);
+    isDonePending = isStreaming;
+    isStreaming = false;
+    isStopped = true;
+    publishStopped();
+    return;
+  }
+  scheduleNextTx();
+}
+
+/**
+ * Continue cycling through the data rates or test plan after a run was stopped or completed.
+ */
+static void resumeUplinks() {
+  if (isStopped) {
+    isStopped = false;
+    Logger::log("Resuming uplinks");
+    scheduleNextTx();
+  }
+}
+
 void onEvent(ev_t ev) {
   // Most of the following will never happen in our use case
   switch (ev) {
@@ -240,50 +719,67 @@ void onEvent(ev_t ev) {
       break;
     case EV_TXCOMPLETE:
       Logger::log("> EV_TXCOMPLETE (includes waiting for RX windows)");
+      isTxRxPending = false;
+      {
+        LinkEvent event{};
+        event.state = STATE_RXDONE;
+        event.seqnoUp = seqnoUp;
+        event.sf = txSf;
+        LinkCheck::Answer answer;
+        bool isAnswer = getLinkCheckAnswer(answer);
+        event.hasRxDetails = (LMIC.txrxFlags & TXRX_ACK) || LMIC.dataLen || isAnswer;
+        DisplayText &lastRxDetails = event.rxDetails;
+
+        if (event.hasRxDetails) {
+          // Include the TX counter and SF for analysis. At this point LMIC.seqnoDn and LMIC.seqnoUp
+          // have already been incremented.
+          lastRxDetails.append('#').appendNumber(LMIC.seqnoDn - 1);
+          lastRxDetails.append('/').appendNumber(seqnoUp);
+          lastRxDetails.append(" SF").appendNumber(txSf);
+          lastRxDetails.append((LMIC.txrxFlags & TXRX_DNW1) ? " rx1" : " rx2");
+
+          // The PHY payload holds the MHDR, FHDR, FPort if any, the payload and the MIC; RX1 uses
+          // the data rate of the uplink, assuming the default RX1DROffset of 0
+          dr_t rxDr = (LMIC.txrxFlags & TXRX_DNW1) ? LMIC.datarate : LMIC.dn2Dr;
+          radioTiming.addDownlink((LMIC.txrxFlags & TXRX_DNW1) ? 1 : 2, rxDr,
+                                  LMIC.dataBeg + LMIC.dataLen + 4, LMIC.rxtime);
+
+          // LMIC.freq is still set to the frequency of the receive window
+          radioMetrics.addDownlink(LMIC.freq, rxDr);
+          if (radioMetrics.hasCrystalOffset()) {
+            clockCalibration.setCrystalOffset(radioMetrics.getCrystalOffsetPpm());
+          }
 
-      if ((LMIC.txrxFlags & TXRX_ACK) || LMIC.dataLen) {
-        // Include the TX counter and SF for analysis. At this point LMIC.seqnoDn and LMIC.seqnoUp
-        // have already been incremented. If the user selected data rate has changed during RX1 or
-        // RX2 then this registers the wrong SF.
-        String lastRxDetails = "#" + String(LMIC.seqnoDn - 1) + "/" + String(seqnoUp) + " SF" +
-                               String(12 - dataRate) + " " +
-                               String((LMIC.txrxFlags & TXRX_DNW1) ? "rx1" : "rx2");
-
-        if (LMIC.txrxFlags & TXRX_ACK) {
-          Logger::log("Received ACK");
-          lastRxDetails += " ack";
-        }
+          if (LMIC.txrxFlags & TXRX_ACK) {
+            Logger::log("Received ACK");
+            lastRxDetails.append(" ack");
+          }
 
-        if (LMIC.dataLen) {
-          // Data received in Class A RX slot after TX
-          String rxPayload = "";
-          for (int i = 0; i < LMIC.dataLen; i++) {
-            if (LMIC.frame[LMIC.dataBeg + i] < 0x10) {
-              rxPayload += "0";
-            }
-            rxPayload += String(LMIC.frame[LMIC.dataBeg + i], HEX);
+          if (isAnswer) {
+            Logger::logf("Received LinkCheckAns: margin=%u dB; gateways=%u", answer.margin,
+                         answer.gateways);
+            lastRxDetails.append(' ').appendNumber(answer.margin).append("dB ");
+            lastRxDetails.appendNumber(answer.gateways).append("gw");
           }
 
-          Logger::logf("Received %d bytes: 0x%s", LMIC.dataLen, rxPayload.c_str());
-          lastRxDetails += " " + rxPayload;
+          if (LMIC.dataLen) {
+            // Data received in Class A RX slot after TX
+            FixedString<2 * MAX_LEN_FRAME> rxPayload;
+            rxPayload.appendHex(LMIC.frame + LMIC.dataBeg, LMIC.dataLen);
+            Logger::logf("Received %d bytes: 0x%s", LMIC.dataLen, rxPayload.c_str());
+            lastRxDetails.append(' ').append(rxPayload.c_str());
+          }
         }
-
-        display.setRxDetails(lastRxDetails);
+        publishLinkEvent(event);
       }
+      radioTiming.endTx();
+      radioTiming.logUplink();
+      storeUplinkRecord();
 
-      // Schedule next transmission.
-      //
-      // We could try to calculate the used airtime (or change LMIC to expose its calcAirTime
-      // function), and the applicable maximum duty cycle, to schedule the next transmission. But
-      // when using the maximum allowed duty cycle, we can boldly tell LMIC to send right now, for
-      // which LMIC will delay the actual transmission to keep within the regulations.
-      //
       // Note that the maximum duty cycle is exactly that: a MAXIMUM, so using that for all
-      // transmissions is NOT NICE AT ALL. Also, this does not take any TTN Fair Access Policy into
-      // account. So: FOR TESTING ONLY.
-      //
-      // Delay a bit to allow updateStateAndDisplay to do some bookkeeping first.
-      os_setTimedCallback(&sendjob, ms2osticks(500) + os_getTime(), do_send);
+      // transmissions is NOT NICE AT ALL. Also, unless its governor is enabled, this does not take
+      // any TTN Fair Access Policy into account. So: FOR TESTING ONLY.
+      continueRun();
       break;
     case EV_LOST_TSYNC:
       Logger::log("> EV_LOST_TSYNC");
@@ -306,7 +802,31 @@ void onEvent(ev_t ev) {
       Logger::log("> EV_SCAN_FOUND");
       break;
     case EV_TXSTART:
+      // LMIC has just updated its own duty cycle bookkeeping, using the airtime of LMIC.dataLen
+      // bytes, and a start time that is a bit earlier than now
+      dutyCycle.registerTx(LMIC.txChnl, os_getTime(),
+                           Airtime::frameTicks(LMIC.datarate, LMIC.dataLen));
+      fairAccess.registerTx(LMIC.datarate, LMIC.dataLen);
       Logger::log("> EV_TXSTART");
+
+      // Snapshot what is needed for the receive windows, as the user may select another data rate
+      // while waiting for those
+      txSf = 12 - LMIC.datarate;
+      txStartMillis = millis();
+      isTxRxPending = true;
+      rxWindowCount = 0;
+      lastRxTime = LMIC.rxtime;
+      {
+        LinkEvent event{};
+        event.state = STATE_TX;
+        event.seqnoUp = seqnoUp;
+        event.freq = LMIC.channelFreq[LMIC.txChnl];
+        event.sf = txSf;
+        publishLinkEvent(event);
+      }
+      // LMIC starts the radio right after this event
+      radioTiming.startTx(LMIC.datarate);
+      clockCalibration.startTx(LMIC.datarate, Airtime::frameTicks(LMIC.datarate, LMIC.dataLen));
       break;
     case EV_TXCANCELED:
       Logger::log("> EV_TXCANCELED");
@@ -328,10 +848,11 @@ void onEvent(ev_t ev) {
 int lastCountdown = 0;
 
 /**
- * Log the seconds until the next transmission.
+ * Log the seconds until the next transmission. This is not scheduled on its own, so may skip a
+ * second if stateAndDisplayTask sleeps longer.
  */
 void logTxCountdown() {
-  int txSecsLeft = osticks2ms(LMIC.txend - os_getTime()) / 1000;
+  int txSecsLeft = osticks2ms(countdownTime - os_getTime()) / 1000;
   if (txSecsLeft != lastCountdown) {
     lastCountdown = txSecsLeft;
     if (lastCountdown > 0) {
@@ -351,20 +872,22 @@ void logTxCountdown() {
   // allocates a buffer for the display.
   display.init();
 
-  // We only need to display 1/10th of a second, but for a smooth progress bar we need a bit more
-  const TickType_t xDelay = 50 / portTICK_PERIOD_MS;
-
+  TickType_t delay = 0;
   while (true) {
+    // Sleep until the LMIC core or the button notifies, or until the display or countdown changes
+    if (ulTaskNotifyTake(pdTRUE, delay)) {
+      notifiedDisplayWakeups++;
+    }
+    displayWakeups++;
+
     // To keep logging of updateStateAndDisplay and logTxCountdown in sync, invoke from same core
     updateStateAndDisplay();
-    display.tick();
+    uint32_t delayMs = display.tick();
     logTxCountdown();
-    vTaskDelay(xDelay);
+    delay = delayMs == DISPLAY_IDLE ? portMAX_DELAY : pdMS_TO_TICKS(delayMs);
   }
 }
 
-TaskHandle_t stateAndDisplayTaskHandle;
-
 void setupStateAndDisplayTask() {
   // The task running setup() and loop() is created on core 1 with priority 1
   Logger::logf("Main loop running on core %d", xPortGetCoreID());
@@ -378,14 +901,62 @@ void setupStateAndDisplayTask() {
                           1 - xPortGetCoreID()); // Core for the task
 }
 
-OneButton stateButton; // NOLINT(cert-err58-cpp)
+Button stateButton;
+
+// Holding the button at least this long shows the statistics pages
+static const uint32_t STATS_PRESS_MS = 3000;
+
+/**
+ * Have the LMIC core apply a change of the uplink settings once no transmission is pending. Only to
+ * be invoked by the button task.
+ */
+static void queueCommand(Command command) {
+  if (!commands.push(command)) {
+    Logger::log("WARNING: button pressed too often; ignoring press");
+    return;
+  }
+  idleLoop.wake();
+}
+
+// The button handlers run in the button task on the display core
+
+static void onClick() {
+  if (display.isShowingStats()) {
+    display.showNextPage();
+    wakeStateAndDisplayTask();
+  } else {
+    queueCommand(COMMAND_NEXT_DATA_RATE);
+  }
+}
+
+static void onDoubleClick() {
+  if (!display.isShowingStats()) {
+    queueCommand(COMMAND_TOGGLE_CONFIRMED);
+  }
+}
+
+/**
+ * On release: return to the main page, show the first statistics page after a very long press, or
+ * otherwise toggle automatic data rates.
+ */
+static void onLongPressStop() {
+  if (display.isShowingStats()) {
+    display.showMainPage();
+    wakeStateAndDisplayTask();
+  } else if (stateButton.getPressedMillis() >= STATS_PRESS_MS) {
+    display.showNextPage();
+    wakeStateAndDisplayTask();
+  } else {
+    queueCommand(COMMAND_TOGGLE_AUTO);
+  }
+}
 
 void setupStateButton() {
-  // Button is active LOW
-  stateButton = OneButton(STATE_BUTTON, true);
-  stateButton.attachClick(nextDataRate);
-  stateButton.attachDoubleClick(toggleConfirmed);
-  stateButton.attachLongPressStart(toggleAutoDataRate);
+  stateButton.attachClick(onClick);
+  stateButton.attachDoubleClick(onDoubleClick);
+  stateButton.attachLongPressStop(onLongPressStop);
+  // Like the display, handle the button on the other core
+  stateButton.begin(STATE_BUTTON, 1 - xPortGetCoreID());
 }
 
 const lmic_pinmap lmic_pins = LMIC_PINS;
@@ -424,16 +995,23 @@ void setupLMIC() {
   // LMIC_setSession, as that configures the minimal channel set. LMIC doesn't let you change the
   // three basic settings, so these are just included for documentation here.
 
-  // g-band:
+  // g1-band, 868.0-868.6 MHz, 1%:
   LMIC_setupChannel(0, 868100000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
   LMIC_setupChannel(1, 868300000, DR_RANGE_MAP(DR_SF12, DR_SF7B), BAND_CENTI);
   LMIC_setupChannel(2, 868500000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
-  LMIC_setupChannel(3, 867100000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
-  LMIC_setupChannel(4, 867300000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
-  LMIC_setupChannel(5, 867500000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
-  LMIC_setupChannel(6, 867700000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
-  LMIC_setupChannel(7, 867900000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
-  // g2-band:
+  // g-band, 865-868 MHz, 1%. LMIC puts these in BAND_CENTI too, but the regulations define a
+  // separate duty cycle for this sub-band. So, use the otherwise unused BAND_AUX, which LMIC does
+  // not initialize, to allow for alternating uplinks between the two sub-bands.
+  LMIC.bands[BAND_AUX].txcap = Airtime::BAND_TXCAP[BAND_AUX];
+  LMIC.bands[BAND_AUX].txpow = LMIC.bands[BAND_CENTI].txpow;
+  LMIC.bands[BAND_AUX].lastchnl = LMIC.bands[BAND_CENTI].lastchnl;
+  LMIC.bands[BAND_AUX].avail = os_getTime();
+  LMIC_setupChannel(3, 867100000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_AUX);
+  LMIC_setupChannel(4, 867300000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_AUX);
+  LMIC_setupChannel(5, 867500000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_AUX);
+  LMIC_setupChannel(6, 867700000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_AUX);
+  LMIC_setupChannel(7, 867900000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_AUX);
+  // g2-band, 868.7-869.2 MHz, 0.1%:
   LMIC_setupChannel(8, 868800000, DR_RANGE_MAP(DR_FSK, DR_FSK), BAND_MILLI);
 
   // TTN defines an additional channel at 869.525Mhz using SF9 for class B devices' ping slots. LMIC
@@ -457,11 +1035,16 @@ void setupLMIC() {
   // timing. Beware that a specific value may work for a slow data rate, but not for faster ones,
   // and remember that RX1 may use different data rates than RX2. Like for the Heltec WiFi LoRa 32
   // board used for testing, RX2 in EU868 (using SF9) worked with the standard settings, but RX1 for
-  // SF8 needed 2%, while RX1 for SF7 even needed 5% of the maximum error.
+  // SF8 needed 2%, while RX1 for SF7 even needed 5% of the maximum error. So, do_send replaces this
+  // with the calibrated value for each data rate, once known.
   //
   // For corrections larger than 0.4% (0.4/100) this also needs LMIC_ENABLE_arbitrary_clock_error;
   // see https://github.com/mcci-catena/arduino-LMIC/blob/master/README.md
-  LMIC_setClockError(MAX_CLOCK_ERROR * 5 / 100);
+  LMIC_setClockError(UNCALIBRATED_CLOCK_ERROR);
+
+  // The channels a test plan may select from
+  configuredChannels = LMIC.channelMap;
+  enabledChannels = configuredChannels;
 }
 
 void setup() {
@@ -470,13 +1053,318 @@ void setup() {
   Logger::log("Starting data-rate-tester");
 
   setupStateAndDisplayTask();
+  // From now on, write the log from the display core, to not block LMIC on the serial port
+  Logger::startDrainTask(1 - xPortGetCoreID());
   setupStateButton();
   setupLMIC();
+  // Once LMIC has configured its pins
+  idleLoop.begin();
+  radioTiming.begin(lmic_pins);
+  CpuStats::begin();
+
+  if (!uplinkStore.begin()) {
+    Logger::log("WARNING: no flash partition to store uplink records");
+  }
+  if (testPlans.begin()) {
+    testPlans.select(0);
+  }
+
+  scheduleNextTx();
+}
+
+/**
+ * Get the 16 or 32 bits little-endian value at the start of the given payload.
+ */
+static uint16_t getUint16(const uint8_t *payload) {
+  return payload[0] | payload[1] << 8;
+}
 
-  do_send(&sendjob);
+static uint32_t getUint32(const uint8_t *payload) {
+  return getUint16(payload) | (uint32_t)getUint16(payload + 2) << 16;
+}
+
+/**
+ * Apply a command frame of a test plan, and respond with FRAME_ACK or FRAME_NAK. Only to be invoked
+ * when no transmission or reception is pending.
+ */
+static void applyFrame(const Frame &frame) {
+  const uint8_t *payload = frame.payload;
+  // The payload length each command needs, if fixed
+  uint8_t expectedLength = 0;
+  switch (frame.type) {
+    case FRAME_SET_CONFIRMED:
+    case FRAME_SET_PAYLOAD_SIZE:
+    case FRAME_SET_SWEEP:
+    case FRAME_SET_ADAPTIVE:
+    case FRAME_SET_FAIR_ACCESS:
+    case FRAME_SET_LINK_CHECK:
+      expectedLength = 1;
+      break;
+    case FRAME_SET_CHANNEL_MASK:
+    case FRAME_SELECT_PLAN:
+      expectedLength = 2;
+      break;
+    case FRAME_SET_RUN_LENGTH:
+      expectedLength = 4;
+      break;
+    case FRAME_SET_DATA_RATES:
+      expectedLength = frame.length;
+      break;
+    default:
+      break;
+  }
+  if (frame.length != expectedLength ||
+      (frame.type == FRAME_SET_DATA_RATES && (!frame.length || frame.length > MAX_DATA_RATES))) {
+    serialProtocol.sendNak(frame.type, FRAME_ERROR_LENGTH);
+    return;
+  }
+
+  switch (frame.type) {
+    case FRAME_SET_DATA_RATES:
+      for (uint8_t i = 0; i < frame.length; i++) {
+        // Assume EU868, DR_SF12 thru DR_SF7
+        if (payload[i] > DR_SF7) {
+          serialProtocol.sendNak(frame.type, FRAME_ERROR_VALUE);
+          return;
+        }
+      }
+      memcpy(dataRates, payload, frame.length);
+      dataRateCount = frame.length;
+      dataRateIdx = -1;
+      // These replace the test plan from flash, if any
+      if (testPlans.getSelected()) {
+        selectTestPlan(NO_TEST_PLAN);
+      }
+      break;
+
+    case FRAME_SET_CONFIRMED:
+      if (payload[0] > 1) {
+        serialProtocol.sendNak(frame.type, FRAME_ERROR_VALUE);
+        return;
+      }
+      isConfirmed = payload[0];
+      display.setIsConfirmedUplink(isConfirmed);
+      break;
+
+    case FRAME_SET_PAYLOAD_SIZE:
+      if (payload[0] < 1 || payload[0] > MAX_LEN_PAYLOAD) {
+        serialProtocol.sendNak(frame.type, FRAME_ERROR_VALUE);
+        return;
+      }
+      payloadSize = payload[0];
+      break;
+
+    case FRAME_SET_CHANNEL_MASK: {
+      uint16_t channels = configuredChannels & getUint16(payload);
+      if (!channels) {
+        serialProtocol.sendNak(frame.type, FRAME_ERROR_VALUE);
+        return;
+      }
+      enabledChannels = channels;
+      LMIC.channelMap = channels;
+      break;
+    }
+
+    case FRAME_SELECT_PLAN: {
+      uint16_t index = getUint16(payload);
+      if (index >= testPlans.getPlanCount() && index != NO_TEST_PLAN) {
+        serialProtocol.sendNak(frame.type, FRAME_ERROR_VALUE);
+        return;
+      }
+      selectTestPlan(index);
+      break;
+    }
+
+    case FRAME_SET_RUN_LENGTH:
+      runLength = getUint32(payload);
+      break;
+
+    case FRAME_SET_SWEEP:
+      if (payload[0] > 1) {
+        serialProtocol.sendNak(frame.type, FRAME_ERROR_VALUE);
+        return;
+      }
+      setPayloadSweep(payload[0]);
+      break;
+
+    case FRAME_SET_ADAPTIVE:
+      if (payload[0] > 1) {
+        serialProtocol.sendNak(frame.type, FRAME_ERROR_VALUE);
+        return;
+      }
+      setAdaptiveDataRate(payload[0]);
+      break;
+
+    case FRAME_SET_FAIR_ACCESS:
+      if (payload[0] > 1) {
+        serialProtocol.sendNak(frame.type, FRAME_ERROR_VALUE);
+        return;
+      }
+      setFairAccess(payload[0]);
+      break;
+
+    case FRAME_SET_LINK_CHECK:
+      if (payload[0] > 1) {
+        serialProtocol.sendNak(frame.type, FRAME_ERROR_VALUE);
+        return;
+      }
+      setLinkCheck(payload[0]);
+      break;
+
+    case FRAME_START_RUN:
+      // Start with the first data rate right away, rather than awaiting the scheduled uplink
+      os_clearCallback(&sendjob);
+      isAutoDataRate = true;
+      display.setIsFixedDataRate(false);
+      dataRateIdx = -1;
+      testPlans.restart();
+      payloadSweep.restart();
+      runUplinks = 0;
+      isStreaming = true;
+      isDonePending = false;
+      isStopped = false;
+      serialProtocol.sendAck(frame.type);
+      scheduleNextTx();
+      return;
+
+    case FRAME_STOP_RUN:
+      os_clearCallback(&sendjob);
+      isStreaming = false;
+      isStopped = true;
+      publishStopped();
+      break;
+
+    default:
+      serialProtocol.sendNak(frame.type, FRAME_ERROR_TYPE);
+      return;
+  }
+  serialProtocol.sendAck(frame.type);
+}
+
+/**
+ * Handle single-character commands on the serial port, and the command frames of test plans; see
+ * serialprotocol.cpp. Frames, exports and results are only handled when no transmission or
+ * reception is pending, but may delay the next transmission.
+ */
+void handleSerialCommands() {
+  static bool isExportRequested = false;
+  // The next part of the statistics dump, if less than LinkStats::DUMP_PARTS
+  static uint8_t statsPart = LinkStats::DUMP_PARTS;
+  // Likewise for RadioTiming::DUMP_PARTS and PayloadSweep::DUMP_PARTS
+  static uint8_t timingPart = RadioTiming::DUMP_PARTS;
+  static uint8_t goodputPart = PayloadSweep::DUMP_PARTS;
+  static uint32_t statsMillis = 0;
+  // A command frame that awaits the end of the current transmission and its receive windows
+  static bool isFramePending = false;
+
+  while (Serial.available() && !isFramePending && !serialProtocol.hasPendingNak()) {
+    int c = Serial.read();
+    if (c == FRAME_START || serialProtocol.isParsing()) {
+      isFramePending = serialProtocol.parse(c);
+      continue;
+    }
+    switch (c) {
+      case 'E':
+        // Export the uplink records; see tools/export_records.py
+        isExportRequested = true;
+        break;
+      case 'S':
+        // Log the link statistics
+        statsPart = 0;
+        break;
+      case 'T':
+        // Log the radio timing histograms, and the downlink timing percentiles
+        timingPart = 0;
+        break;
+      case 'P':
+        // Select the next test plan from flash, if any, or the built-in data rates after the last
+        if (testPlans.getPlanCount()) {
+          selectTestPlan(testPlans.getSelected() ? testPlans.getSelectedIndex() + 1 : 0);
+        }
+        break;
+      case 'W':
+        // Toggle the payload sweep
+        setPayloadSweep(!payloadSweep.getEnabled());
+        break;
+      case 'A':
+        // Toggle the adaptive data rate
+        setAdaptiveDataRate(!adaptiveDataRate.getEnabled());
+        break;
+      case 'F':
+        // Toggle the Fair Access Policy governor
+        setFairAccess(!fairAccess.getEnabled());
+        break;
+      case 'L':
+        // Toggle sending a LinkCheckReq
+        setLinkCheck(!isLinkCheck);
+        break;
+      case 'G':
+        // Log the goodput per data rate and payload size of the payload sweep
+        goodputPart = 0;
+        break;
+      case 'C':
+        // Restart the clock error calibration
+        clockCalibration.reset();
+        break;
+      case 'R':
+        // Resume the uplinks after a run was stopped or completed
+        resumeUplinks();
+        break;
+      case 'I':
+        // Toggle sleeping while LMIC has nothing to do
+        idleLoop.setEnabled(!idleLoop.getEnabled());
+        Logger::logf("Idle mode %s", idleLoop.getEnabled() ? "enabled" : "disabled");
+        break;
+      default:
+        break;
+    }
+  }
+  if (isExportRequested && !isTxRxPending) {
+    isExportRequested = false;
+    uplinkStore.startExport();
+  }
+
+  if (!isTxRxPending) {
+    // Write the export in chunks, to allow LMIC and the logger to run in between
+    uplinkStore.continueExport();
+    UplinkRecord record;
+    while (results.pop(record)) {
+      serialProtocol.send(FRAME_RESULT, &record, sizeof(record));
+    }
+    if (isDonePending) {
+      isDonePending = false;
+      serialProtocol.send(FRAME_DONE, &runUplinks, sizeof(runUplinks));
+    }
+    serialProtocol.sendPendingNak();
+    if (isFramePending) {
+      isFramePending = false;
+      applyFrame(serialProtocol.getFrame());
+    }
+  }
+
+  // Log a single part at a time, giving the logger time to write it, and skip empty parts
+  if (statsPart < LinkStats::DUMP_PARTS && millis() - statsMillis >= 100) {
+    statsMillis = millis();
+    while (statsPart < LinkStats::DUMP_PARTS && !linkStats.dump(statsPart++)) {
+    }
+  } else if (timingPart < RadioTiming::DUMP_PARTS && millis() - statsMillis >= 100) {
+    statsMillis = millis();
+    while (timingPart < RadioTiming::DUMP_PARTS && !radioTiming.dump(timingPart++)) {
+    }
+  } else if (goodputPart < PayloadSweep::DUMP_PARTS && millis() - statsMillis >= 100) {
+    statsMillis = millis();
+    while (goodputPart < PayloadSweep::DUMP_PARTS && !payloadSweep.dump(goodputPart++)) {
+    }
+  }
 }
 
 void loop() {
   os_runloop_once();
-  stateButton.tick();
+  publishRxWindows();
+  handleSerialCommands();
+  // Any button press also resumes the uplinks after a run was stopped or completed
+  if (!isTxRxPending && applyCommands()) {
+    resumeUplinks();
+  }
+  idleLoop.sleep();
 }
@@ -0,0 +1,143 @@
+/**
+ * A sweep mode that steps the payload size for each data rate, to tell the goodput (application
+ * bytes per hour within the duty cycle) and the loss versus the payload size, up to the maximum
+ * size each data rate allows. It starts with the smallest size for DR_SF7, works its way up to the
+ * maximum size, and then continues with the next slower data rate, until it starts over after
+ * DR_SF12.
+ *
+ * Each payload starts with a header that holds its length and uplink counter, followed by bytes
+ * that derive from the counter, so the network side can check the payload's integrity. The sizes
+ * double from that header's length, as airtime is not linear in the payload size: for larger sizes,
+ * the fixed preamble and header matter less.
+ *
+ * The goodput assumes a single sub-band with a 1% duty cycle; as the tester alternates between two
+ * such sub-bands, it may get twice that. Only confirmed uplinks tell if an uplink was lost; without
+ * those, all uplinks are counted as delivered.
+ */
+#include "payloadsweep.h"
+#include "airtime.h"
+#include "logger.h"
+
+// Global singleton instance
+PayloadSweep payloadSweep;
+
+PayloadSweep::PayloadSweep() {
+  for (uint8_t dr = 0; dr < TESTED_DATA_RATES; dr++) {
+    uint8_t max = Airtime::maxPayloadLength(dr);
+    uint8_t count = 0;
+    for (uint16_t size = PAYLOAD_HEADER_LENGTH; size < max && count < MAX_SIZES - 1; size *= 2) {
+      sizes[dr][count++] = size;
+    }
+    sizes[dr][count++] = max;
+    sizeCount[dr] = count;
+  }
+}
+
+bool PayloadSweep::getEnabled() const {
+  return isEnabled;
+}
+
+/**
+ * Enable or disable the sweep, starting over when enabled.
+ */
+void PayloadSweep::setEnabled(bool enabled) {
+  isEnabled = enabled;
+  restart();
+}
+
+/**
+ * Make the next uplink use the smallest size for DR_SF7.
+ */
+void PayloadSweep::restart() {
+  isStarted = false;
+}
+
+/**
+ * Get the data rate and payload size for the next uplink.
+ */
+void PayloadSweep::next(uint8_t &dr, uint8_t &payloadSize) {
+  if (!isStarted) {
+    dataRate = DR_SF7;
+    sizeIdx = 0;
+    isStarted = true;
+  } else if (++sizeIdx >= sizeCount[dataRate]) {
+    sizeIdx = 0;
+    dataRate = dataRate == DR_SF12 ? DR_SF7 : dataRate - 1;
+  }
+  dr = dataRate;
+  payloadSize = sizes[dataRate][sizeIdx];
+}
+
+/**
+ * Find the index of the given size in the sizes of the given data rate.
+ */
+bool PayloadSweep::findSize(dr_t dr, uint8_t size, uint8_t &index) const {
+  for (index = 0; index < sizeCount[dr]; index++) {
+    if (sizes[dr][index] == size) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Log the counters and the goodput of a data rate and size.
+ */
+void PayloadSweep::logGoodput(dr_t dr, uint8_t index) const {
+  const SweepCounters &c = counters[dr][index];
+  uint8_t size = sizes[dr][index];
+  uint32_t airtime = Airtime::dataRateMicros(dr, Airtime::LORAWAN_OVERHEAD + size);
+  uint32_t delivered = c.uplinks - c.confirmed + c.acks;
+  // The time a 1% sub-band is unavailable after each uplink, in hours
+  float offHours = (float)airtime * Airtime::BAND_TXCAP[BAND_CENTI] / 3600E6f;
+  Logger::logf("Goodput SF%d; size=%u: uplinks=%u; confirmed=%u; acks=%u; airtime=%.1f ms; "
+               "bytes/hour=%.0f",
+               12 - dr, size, c.uplinks, c.confirmed, c.acks, airtime / 1000.0f,
+               delivered * size / (c.uplinks * offHours));
+}
+
+/**
+ * Count the result of an uplink that was sent while sweeping, and log the goodput of its data rate
+ * and size. Only to be invoked on the LMIC core.
+ */
+void PayloadSweep::add(const UplinkRecord &record) {
+  dr_t dr = recordDataRate(record);
+  uint8_t index;
+  if (!isEnabled || dr >= TESTED_DATA_RATES || !findSize(dr, record.payloadSize, index)) {
+    return;
+  }
+  SweepCounters &c = counters[dr][index];
+  c.uplinks++;
+  if (record.flags & RECORD_CONFIRMED) {
+    c.confirmed++;
+    c.acks += record.flags & RECORD_ACK ? 1 : 0;
+  }
+  logGoodput(dr, index);
+}
+
+/**
+ * Log the goodput of a single data rate and size, DR_SF12 with the smallest size being part 0.
+ * Returns false if nothing was logged, when no uplinks used that data rate and size.
+ */
+bool PayloadSweep::dump(uint8_t part) const {
+  dr_t dr = part / MAX_SIZES;
+  uint8_t index = part % MAX_SIZES;
+  if (index >= sizeCount[dr] || !counters[dr][index].uplinks) {
+    return false;
+  }
+  logGoodput(dr, index);
+  return true;
+}
+
+/**
+ * Fill an uplink's application payload: the header, as far as it fits, followed by bytes that
+ * derive from the uplink counter.
+ */
+void PayloadSweep::fillPayload(uint8_t *data, uint8_t length, uint8_t sf, uint32_t seqnoUp) {
+  // SF in BCD, binary-coded decimal, so: 0x07, 08, 09, 10, 11, 12 rather than 0x07 thru 0x0C
+  const uint8_t header[PAYLOAD_HEADER_LENGTH] = {(uint8_t)((sf / 10u) << 4 | (sf % 10u)), length,
+                                                 (uint8_t)seqnoUp, (uint8_t)(seqnoUp >> 8)};
+  for (uint8_t i = 0; i < length; i++) {
+    data[i] = i < PAYLOAD_HEADER_LENGTH ? header[i] : (uint8_t)(seqnoUp + i);
+  }
+}
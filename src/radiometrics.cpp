@@ -0,0 +1,78 @@
+/**
+ * Reads the metrics of a downlink from the SX1276 registers, which LMIC leaves as they were after
+ * the reception: the frequency error indicator (FEI), and the packet RSSI and SNR. LMIC only
+ * exposes the latter two.
+ *
+ * The gateways of a network use accurate crystals, so the frequency error of a downlink mostly
+ * tells how far off the crystal of the board's radio is: if it runs fast, the radio listens on a
+ * higher frequency than the downlink uses. The running mean of the recent downlinks estimates that
+ * offset in ppm; see clockcalibration.cpp for how it widens the receive windows.
+ *
+ * See sections 4.1.5 and 5.5.5 of the SX1276 datasheet, revision 7.
+ */
+#include "radiometrics.h"
+#include "logger.h"
+
+// Global singleton instance
+RadioMetrics radioMetrics;
+
+// LoRa registers: SNR in 0.25 dB, the packet RSSI, and the 20 bits FEI starting at its MSB
+static const u1_t REG_PKT_SNR_VALUE = 0x19;
+static const u1_t REG_FEI_MSB = 0x28;
+static const float CRYSTAL_HZ = 32E6;
+
+/**
+ * Read the registers of the downlink that was just received with the given frequency and data rate,
+ * log them, and update the crystal offset. Only to be invoked on the LMIC core, for EV_TXCOMPLETE.
+ */
+void RadioMetrics::addDownlink(u4_t freq, dr_t dr) {
+  // RegPktSnrValue is followed by RegPktRssiValue
+  u1_t packet[2];
+  u1_t fei[3];
+  hal_spi_read(REG_PKT_SNR_VALUE, packet, sizeof(packet));
+  hal_spi_read(REG_FEI_MSB, fei, sizeof(fei));
+
+  // In 0.25 dB
+  int8_t snr = (int8_t)packet[0];
+  // For the high frequency port; below the noise floor the SNR tells how much lower the signal is
+  int16_t rssi = snr >= 0 ? -157 + packet[1] * 16 / 15 : -157 + packet[1] + snr / 4;
+
+  // A 20 bits two's complement value, in units of 2^24 / 32 MHz * BW / 500 kHz
+  int32_t raw = (int32_t)(fei[0] & 0x0F) << 16 | fei[1] << 8 | fei[2];
+  if (raw & 0x80000) {
+    raw -= 0x100000;
+  }
+  uint16_t bandwidthKHz = dr == DR_SF7B ? 250 : 125;
+  // The frequency error of the downlink relative to the frequency the radio listens on
+  int32_t errorHz = lroundf(raw * (float)(1 << 24) / CRYSTAL_HZ * bandwidthKHz / 500);
+
+  // A negative error means the downlink is below the frequency the radio listens on, so its
+  // crystal runs fast
+  offsets[nextSample] = -errorHz / (freq / 1E6f);
+  nextSample = (nextSample + 1) % SAMPLES;
+  if (sampleCount < SAMPLES) {
+    sampleCount++;
+  }
+  Logger::logf("Radio metrics: frequency error=%d Hz; rssi=%d dBm; snr=%.2f dB; "
+               "crystal offset=%.2f ppm (%u downlinks)",
+               errorHz, rssi, snr / 4.0f, getCrystalOffsetPpm(), sampleCount);
+}
+
+/**
+ * Tell if there were enough downlinks to estimate the crystal offset.
+ */
+bool RadioMetrics::hasCrystalOffset() const {
+  return sampleCount >= MIN_SAMPLES;
+}
+
+/**
+ * Get the estimated offset of the radio's crystal in ppm, positive if it runs fast, or 0 if there
+ * were no downlinks yet.
+ */
+float RadioMetrics::getCrystalOffsetPpm() const {
+  float sum = 0;
+  for (uint8_t i = 0; i < sampleCount; i++) {
+    sum += offsets[i];
+  }
+  return sampleCount ? sum / sampleCount : 0;
+}
@@ -0,0 +1,355 @@
+/**
+ * Captures the edges of the radio's DIO pins in interrupt handlers, to tell how late LMIC notices
+ * them, and how late it opens the receive windows. This gives hard numbers for the clock error
+ * that LMIC needs to catch a downlink; see clockcalibration.cpp.
+ *
+ * The LMIC Arduino HAL polls the DIO pins in between its jobs, so it detects the end of a
+ * transmission (DIO0) whenever the run loop gets to it, and bases the receive windows on that
+ * time. An interrupt handler timestamps the actual edge.
+ *
+ * LMIC opens a receive window by busy-waiting until LMIC.rxtime using hal_waitUntil, which returns
+ * how late it was invoked; this needs the linker to redirect that call to __wrap_hal_waitUntil
+ * below, using `-Wl,--wrap=hal_waitUntil`; see `platformio.ini`. As LMIC also uses hal_waitUntil
+ * when resetting the radio, only the calls in between EV_TXSTART and EV_TXCOMPLETE are counted.
+ *
+ * For each downlink, the start of the transmission, the end of the transmission from DIO0, the
+ * opening of the receive window and the end of the reception, again from DIO0, are timestamped in
+ * microseconds. The start of the downlink follows from its end and its airtime. This tells how
+ * precisely the network sends the downlink 1 or 2 seconds after the uplink, and how much slack the
+ * receive window had, which may decide whether SF7 downlinks work at all. As networks differ, the
+ * percentiles are kept per data rate and receive window. Those use the P-square algorithm of Jain
+ * and Chlamtac, extended to multiple percentiles by Raatikainen: rather than storing the values, 9
+ * markers track the minimum, the percentiles, the maximum and the midpoints in between, each moved
+ * by a piecewise-parabolic interpolation when its position drifts from where its percentile should
+ * be.
+ */
+#include "radiotiming.h"
+#include "airtime.h"
+#include "fixedstring.h"
+#include "idleloop.h"
+#include "logger.h"
+
+// Global singleton instance
+RadioTiming radioTiming;
+
+extern "C" {
+
+u4_t __real_hal_waitUntil(u4_t time);
+
+u4_t __wrap_hal_waitUntil(u4_t time) {
+  u4_t result = __real_hal_waitUntil(time);
+  radioTiming.addRxOpen(os_getTime() - (ostime_t)time);
+  return result;
+}
+}
+
+void TimingHistogram::add(int32_t us) {
+  minUs = count ? min(minUs, us) : us;
+  maxUs = count ? max(maxUs, us) : us;
+  count++;
+  sumUs += us;
+  uint8_t bin = 0;
+  while (bin < TIMING_HISTOGRAM_BINS - 1 && us >= (1 << bin)) {
+    bin++;
+  }
+  bins[bin]++;
+}
+
+// The fraction of the values at or below each marker of RunningPercentiles
+static const float MARKER_FRACTIONS[RunningPercentiles::MARKERS] = {
+    0, 0.025f, 0.05f, 0.275f, 0.5f, 0.725f, 0.95f, 0.975f, 1};
+
+static_assert(RunningPercentiles::MARKERS == 9, "MARKER_FRACTIONS must match MARKERS");
+
+/**
+ * Get the height of marker i when moving it d positions, using a parabola through its neighbours.
+ */
+float RunningPercentiles::parabolic(uint8_t i, int8_t d) const {
+  float left = (float)(positions[i] - positions[i - 1]);
+  float right = (float)(positions[i + 1] - positions[i]);
+  return heights[i] + d / (left + right) *
+                          ((left + d) * (heights[i + 1] - heights[i]) / right +
+                           (right - d) * (heights[i] - heights[i - 1]) / left);
+}
+
+void RunningPercentiles::add(int32_t us) {
+  float value = us;
+  if (count < MARKERS) {
+    // Until all markers are set, keep the values sorted
+    uint8_t i = count;
+    while (i > 0 && heights[i - 1] > value) {
+      heights[i] = heights[i - 1];
+      i--;
+    }
+    heights[i] = value;
+    positions[count] = count;
+    count++;
+    return;
+  }
+
+  // Find the cell that holds the value, extending the extremes if needed, and shift the markers
+  // above it
+  uint8_t cell = 0;
+  if (value < heights[0]) {
+    heights[0] = value;
+  } else if (value >= heights[MARKERS - 1]) {
+    heights[MARKERS - 1] = value;
+    cell = MARKERS - 2;
+  } else {
+    while (value >= heights[cell + 1]) {
+      cell++;
+    }
+  }
+  for (uint8_t i = cell + 1; i < MARKERS; i++) {
+    positions[i]++;
+  }
+  count++;
+
+  // Move each inner marker that is at least one position off, if that does not make it collide
+  for (uint8_t i = 1; i < MARKERS - 1; i++) {
+    float offset = MARKER_FRACTIONS[i] * (count - 1) - positions[i];
+    int8_t d = 0;
+    if (offset >= 1 && positions[i + 1] - positions[i] > 1) {
+      d = 1;
+    } else if (offset <= -1 && positions[i - 1] - positions[i] < -1) {
+      d = -1;
+    }
+    if (!d) {
+      continue;
+    }
+    float height = parabolic(i, d);
+    if (height <= heights[i - 1] || height >= heights[i + 1]) {
+      // Linear instead
+      height = heights[i] + d * (heights[i + d] - heights[i]) / (positions[i + d] - positions[i]);
+    }
+    heights[i] = height;
+    positions[i] += d;
+  }
+}
+
+/**
+ * Get the 5th (0), 50th (1) or 95th (2) percentile; for fewer than MARKERS values the nearest rank.
+ */
+int32_t RunningPercentiles::get(uint8_t percentile) const {
+  uint8_t marker = 2 + 2 * percentile;
+  if (count < MARKERS) {
+    return count ? lroundf(heights[lroundf(MARKER_FRACTIONS[marker] * (count - 1))]) : 0;
+  }
+  return lroundf(heights[marker]);
+}
+
+void IRAM_ATTR RadioTiming::captureDio(uint8_t dio) {
+  dioMicros[dio].store(micros(), std::memory_order_relaxed);
+  dioCounts[dio].fetch_add(1, std::memory_order_release);
+  idleLoop.wakeFromIsr();
+}
+
+void IRAM_ATTR RadioTiming::onDio0(void *timing) {
+  static_cast<RadioTiming *>(timing)->captureDio(0);
+}
+
+void IRAM_ATTR RadioTiming::onDio1(void *timing) {
+  static_cast<RadioTiming *>(timing)->captureDio(1);
+}
+
+void IRAM_ATTR RadioTiming::onDio2(void *timing) {
+  static_cast<RadioTiming *>(timing)->captureDio(2);
+}
+
+/**
+ * Attach the interrupt handlers, once LMIC has configured the pins.
+ */
+void RadioTiming::begin(const lmic_pinmap &pins) {
+  void (*handlers[DIO_COUNT])(void *) = {onDio0, onDio1, onDio2};
+  for (uint8_t dio = 0; dio < DIO_COUNT; dio++) {
+    if (pins.dio[dio] != LMIC_UNUSED_PIN) {
+      attachInterruptArg(digitalPinToInterrupt(pins.dio[dio]), handlers[dio], this, RISING);
+    }
+  }
+}
+
+/**
+ * Register the start of a transmission with the given data rate; to be invoked for EV_TXSTART,
+ * right before LMIC starts the radio.
+ */
+void RadioTiming::startTx(dr_t dr) {
+  txStartMicros = micros();
+  txDr = dr;
+  downlinkWindow = 0;
+  txDio0Count = dioCounts[0].load(std::memory_order_acquire);
+  isTxPending = true;
+  rxWindowCount = 0;
+  txEndLatencyUs = -1;
+  rxOpenErrorsUs[0] = -1;
+  rxOpenErrorsUs[1] = -1;
+}
+
+/**
+ * Register that LMIC is done with the receive windows of the current transmission; to be invoked
+ * for EV_TXCOMPLETE.
+ */
+void RadioTiming::endTx() {
+  isTxPending = false;
+}
+
+/**
+ * Get the time DIO0 signalled the end of the current transmission, if it did, and add how much
+ * later LMIC detected that to the statistics. To be invoked once LMIC has set LMIC.txend.
+ */
+bool RadioTiming::addTxEnd(ostime_t lmicTxEnd, ostime_t &txEnd) {
+  if (dioCounts[0].load(std::memory_order_acquire) == txDio0Count) {
+    txEndMicros = (uint32_t)micros() - osticks2us(os_getTime() - lmicTxEnd);
+    return false;
+  }
+  // The interrupt handler used micros(), which may differ from os_getTime() by a constant offset
+  txEndMicros = dioMicros[0].load(std::memory_order_relaxed);
+  uint32_t sinceEdge = (uint32_t)micros() - txEndMicros;
+  txEnd = os_getTime() - us2osticks(sinceEdge);
+  txEndLatencyUs = osticks2us(lmicTxEnd - txEnd);
+  txEndLatency.add(txEndLatencyUs);
+  return true;
+}
+
+/**
+ * Add how late LMIC started listening in a receive window of the current transmission.
+ */
+void RadioTiming::addRxOpen(ostime_t lateness) {
+  if (!isTxPending || rxWindowCount >= RX_WINDOWS) {
+    return;
+  }
+  rxOpenMicros[rxWindowCount] = micros();
+  rxOpenErrorsUs[rxWindowCount] = osticks2us(lateness);
+  rxOpenErrors[rxWindowCount].add(rxOpenErrorsUs[rxWindowCount]);
+  rxWindowCount++;
+}
+
+/**
+ * Add the timing of a downlink that was received in the given receive window (1 or 2), with the
+ * given data rate and PHY payload length, to the percentiles. The end of the reception is taken
+ * from DIO0, or else from the time LMIC sets in LMIC.rxtime. To be invoked for EV_TXCOMPLETE.
+ */
+void RadioTiming::addDownlink(uint8_t window, dr_t dr, uint8_t length, ostime_t lmicRxTime) {
+  if (window < 1 || window > rxWindowCount) {
+    return;
+  }
+  // DIO0 signals both the end of the transmission and the end of the reception
+  if (dioCounts[0].load(std::memory_order_acquire) - txDio0Count >= 2) {
+    rxDoneMicros = dioMicros[0].load(std::memory_order_relaxed);
+  } else {
+    rxDoneMicros = (uint32_t)micros() - osticks2us(os_getTime() - lmicRxTime);
+  }
+  downlinkWindow = window;
+  downlinkMicros = rxDoneMicros - Airtime::dataRateMicros(dr, length, false);
+  if (txDr >= TESTED_DATA_RATES) {
+    return;
+  }
+  // The network should start sending RX1DELAY seconds after the end of the uplink, or a second
+  // later for RX2
+  uint32_t nominalMicros = (LMIC.rxDelay + window - 1) * 1000000UL;
+  roundTrips[txDr][window - 1].add(rxDoneMicros - txStartMicros);
+  downlinkLateness[txDr][window - 1].add(downlinkMicros - txEndMicros - nominalMicros);
+  rxSlacks[txDr][window - 1].add(downlinkMicros - rxOpenMicros[window - 1]);
+}
+
+/**
+ * Add how late LMIC ran the job that starts a transmission.
+ */
+void RadioTiming::addSendLag(ostime_t lag) {
+  sendLagUs = osticks2us(lag);
+  sendLag.add(sendLagUs);
+}
+
+static void appendMicros(FixedString<160> &text, const char *label, int32_t us) {
+  text.append(label);
+  if (us < 0) {
+    text.append("n/a");
+  } else {
+    text.appendNumber(us).append(" us");
+  }
+}
+
+/**
+ * Log the timing of the transmission that just completed.
+ */
+void RadioTiming::logUplink() const {
+  FixedString<160> text;
+  appendMicros(text, "TX job late: ", sendLagUs);
+  appendMicros(text, "; TX end detected late: ", txEndLatencyUs);
+  appendMicros(text, "; RX1 opened late: ", rxOpenErrorsUs[0]);
+  appendMicros(text, "; RX2 opened late: ", rxOpenErrorsUs[1]);
+  Logger::logf("Radio timing: %s", text.c_str());
+
+  // The events, relative to the start of the transmission
+  text.clear();
+  text.append("TX start=").appendNumber(txStartMicros).append(" us; TX end=+");
+  text.appendNumber(txEndMicros - txStartMicros).append(" us");
+  for (uint8_t i = 0; i < rxWindowCount; i++) {
+    text.append("; RX").appendNumber(i + 1).append(" open=+");
+    text.appendNumber(rxOpenMicros[i] - txStartMicros).append(" us");
+  }
+  if (downlinkWindow) {
+    text.append("; downlink=+").appendNumber(downlinkMicros - txStartMicros);
+    text.append("..+").appendNumber(rxDoneMicros - txStartMicros).append(" us");
+  }
+  Logger::logf("Radio events: %s", text.c_str());
+}
+
+/**
+ * Log the percentiles of the downlinks of a data rate and receive window, if any.
+ */
+void RadioTiming::dumpDownlinks(dr_t dr, uint8_t window) const {
+  const RunningPercentiles &roundTrip = roundTrips[dr][window];
+  const RunningPercentiles &lateness = downlinkLateness[dr][window];
+  const RunningPercentiles &slack = rxSlacks[dr][window];
+  Logger::logf("Timing SF%d rx%u: downlinks=%u; p5/p50/p95: round trip=%d/%d/%d us; downlink "
+               "late=%d/%d/%d us; window slack=%d/%d/%d us",
+               12 - dr, window + 1, roundTrip.count, roundTrip.get(0), roundTrip.get(1),
+               roundTrip.get(2), lateness.get(0), lateness.get(1), lateness.get(2), slack.get(0),
+               slack.get(1), slack.get(2));
+}
+
+/**
+ * Log a single part of the dump: 0 for the detection of the end of transmissions, 1 and 2 for
+ * opening RX1 and RX2, 3 for starting the job that transmits, followed by the downlinks of each
+ * data rate and receive window. Returns false if nothing was logged, for a data rate and window
+ * without downlinks.
+ */
+bool RadioTiming::dump(uint8_t part) const {
+  if (part >= 2 + RX_WINDOWS) {
+    uint8_t index = part - 2 - RX_WINDOWS;
+    dr_t dr = DR_SF7 - index / RX_WINDOWS;
+    uint8_t window = index % RX_WINDOWS;
+    if (!roundTrips[dr][window].count) {
+      return false;
+    }
+    dumpDownlinks(dr, window);
+    return true;
+  }
+
+  static const char *const names[DUMP_PARTS] = {"TX end detected late", "RX1 opened late",
+                                                "RX2 opened late", "TX job late"};
+  const TimingHistogram &h = part == 0   ? txEndLatency
+                             : part <= 2 ? rxOpenErrors[part - 1]
+                                         : sendLag;
+  if (!h.count) {
+    Logger::logf("Timing %s: count=0", names[part]);
+    return true;
+  }
+
+  uint8_t from = 0;
+  uint8_t to = TIMING_HISTOGRAM_BINS - 1;
+  while (from < to && !h.bins[from]) {
+    from++;
+  }
+  while (to > from && !h.bins[to]) {
+    to--;
+  }
+  FixedString<11 * TIMING_HISTOGRAM_BINS> counts;
+  for (uint8_t i = from; i <= to; i++) {
+    counts.append(i > from ? "," : "").appendNumber(h.bins[i]);
+  }
+  Logger::logf("Timing %s: count=%u; mean=%d (%d..%d) us; histogram per power of 2 from %u us: %s",
+               names[part], h.count, (int32_t)(h.sumUs / h.count), h.minUs, h.maxUs,
+               from ? 1u << (from - 1) : 0u, counts.c_str());
+  return true;
+}
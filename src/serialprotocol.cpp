@@ -0,0 +1,207 @@
+/**
+ * A framed binary protocol on the serial port, to let a script configure and run test campaigns
+ * unattended, and collect the result of each uplink; see tools/run_test_plan.py.
+ *
+ * Each frame, in either direction, is FRAME_START, the frame type, the payload length (at most
+ * MAX_FRAME_PAYLOAD), the payload, and the CRC-16/CCITT-FALSE of the type, length and payload as a
+ * 16 bits little-endian value. All values in the payloads are little-endian too. The single
+ * character commands still work in between frames.
+ *
+ * Commands, each answered by FRAME_ACK with the type of the command, or FRAME_NAK with the type
+ * and a FrameError. Settings take effect for the next uplink that is scheduled.
+ *
+ * - FRAME_SET_DATA_RATES: 1 to 16 EU868 data rates, DR_SF12 (0) thru DR_SF7 (5), to cycle through,
+ *   replacing the test plan from flash, if any
+ * - FRAME_SET_CONFIRMED: 1 byte, 0 for unconfirmed or 1 for confirmed uplinks
+ * - FRAME_SET_PAYLOAD_SIZE: 1 byte, the application payload size, 1 thru MAX_LEN_PAYLOAD, limited
+ *   to the maximum each data rate allows
+ * - FRAME_SET_CHANNEL_MASK: 16 bits, the channels to use, of those configured in setupLMIC
+ * - FRAME_SET_RUN_LENGTH: 32 bits, the number of uplinks after which the next run stops, or 0 to
+ *   not stop
+ * - FRAME_START_RUN: no payload; start a run with the first data rate or step, and stream its
+ *   results
+ * - FRAME_STOP_RUN: no payload; stop transmitting after the current uplink, if any, until the next
+ *   FRAME_START_RUN, a button press, or `R` on the serial port
+ * - FRAME_SELECT_PLAN: 16 bits, the index of the test plan from flash to use rather than the data
+ *   rates, or 0xFFFF (NO_TEST_PLAN) for the data rates; see testplans.cpp. While a plan from flash
+ *   is used, its steps set the data rate, channel, payload size and confirmed flag of each uplink
+ * - FRAME_SET_SWEEP: 1 byte, 1 to step the payload size for each data rate rather than using the
+ *   data rates or test plan, or 0 to stop doing so; see payloadsweep.cpp
+ * - FRAME_SET_ADAPTIVE: 1 byte, 1 to select each next data rate out of the data rates by how much
+ *   its uplink is expected to tell, using confirmed uplinks, or 0 to stop doing so; see
+ *   adaptivedatarate.cpp. Once all data rates have converged, the run completes.
+ * - FRAME_SET_FAIR_ACCESS: 1 byte, 1 to pace the uplinks and confirmations to stay within The
+ *   Things Network's Fair Access Policy, or 0 to only adhere to the duty cycle; see fairaccess.cpp
+ * - FRAME_SET_LINK_CHECK: 1 byte, 1 to send a LinkCheckReq rather than the dummy data, to record
+ *   the margin and gateway count of each uplink, or 0 to stop doing so; see linkcheck.cpp
+ *
+ * While running, FRAME_RESULT holds the UplinkRecord of each uplink, and FRAME_DONE the number of
+ * uplinks (32 bits) once the run length has been reached, or the adaptive data rate has converged.
+ * Like after FRAME_STOP_RUN, the tester then stops transmitting.
+ *
+ * Frames are only parsed in between LMIC's jobs, and only applied when no transmission or
+ * reception is pending. Likewise, a FRAME_NAK for an invalid frame is only sent then, as writing to
+ * the serial port may block. Meanwhile, the bytes that follow a frame wait in the UART's buffer, so
+ * the host should wait for the response before sending the next command. Responses are written
+ * between log lines; the text log never holds FRAME_START, but binary logging (LOG_BINARY) might.
+ *
+ * The payload and CRC of a frame with an invalid length are skipped, as are the bytes of a frame
+ * that is not complete within FRAME_TIMEOUT_MS, until the line is idle for that long.
+ */
+#include "serialprotocol.h"
+#include "crc.h"
+#include "logger.h"
+
+// Global singleton instance
+SerialProtocol serialProtocol;
+
+// Forget an incomplete frame after this time, like when the host was interrupted halfway, and
+// consider the line idle after no bytes arrived for this time
+static const uint32_t FRAME_TIMEOUT_MS = 500;
+
+// For PARSE_DISCARD: skip bytes until the line is idle
+static const uint16_t DISCARD_UNTIL_IDLE = UINT16_MAX;
+
+/**
+ * Tell if a frame has started, which then gets all of the bytes that follow. That includes the
+ * rest of a frame that was rejected or took too long, until all of its bytes have been skipped, or
+ * until the line is idle, so they are not taken for single character commands.
+ */
+bool SerialProtocol::isParsing() const {
+  return parseState != PARSE_IDLE && millis() - lastByteMillis <= FRAME_TIMEOUT_MS;
+}
+
+/**
+ * Reject the current frame, to be answered by FRAME_NAK once sendPendingNak is invoked.
+ */
+void SerialProtocol::rejectFrame(FrameError error) {
+  nak[0] = frame.type;
+  nak[1] = error;
+  isNakPending = true;
+}
+
+/**
+ * Add the next byte, returning true if that completes a valid frame. Invalid frames are rejected,
+ * after which no more bytes should be added until sendPendingNak has been invoked.
+ */
+bool SerialProtocol::parse(uint8_t c) {
+  if (!isParsing()) {
+    parseState = PARSE_IDLE;
+  } else if (parseState != PARSE_DISCARD && millis() - startMillis > FRAME_TIMEOUT_MS) {
+    // Bytes keep arriving, so the rest of the frame may follow yet
+    parseState = PARSE_DISCARD;
+    discardCount = DISCARD_UNTIL_IDLE;
+  }
+  lastByteMillis = millis();
+
+  switch (parseState) {
+    case PARSE_IDLE:
+      if (c == FRAME_START) {
+        parseState = PARSE_TYPE;
+        startMillis = millis();
+        crc = Crc::CRC16_INIT;
+      }
+      return false;
+
+    case PARSE_TYPE:
+      frame.type = c;
+      crc = Crc::crc16(crc, &c, 1);
+      parseState = PARSE_LENGTH;
+      return false;
+
+    case PARSE_LENGTH:
+      if (c > MAX_FRAME_PAYLOAD) {
+        // Skip the payload and CRC
+        parseState = PARSE_DISCARD;
+        discardCount = c + 2;
+        rejectFrame(FRAME_ERROR_LENGTH);
+        return false;
+      }
+      frame.length = c;
+      received = 0;
+      crc = Crc::crc16(crc, &c, 1);
+      parseState = c ? PARSE_PAYLOAD : PARSE_CRC_LOW;
+      return false;
+
+    case PARSE_PAYLOAD:
+      frame.payload[received++] = c;
+      crc = Crc::crc16(crc, &c, 1);
+      if (received == frame.length) {
+        parseState = PARSE_CRC_LOW;
+      }
+      return false;
+
+    case PARSE_CRC_LOW:
+      crcLow = c;
+      parseState = PARSE_CRC_HIGH;
+      return false;
+
+    case PARSE_CRC_HIGH:
+      parseState = PARSE_IDLE;
+      if ((crcLow | c << 8) != crc) {
+        rejectFrame(FRAME_ERROR_CRC);
+        return false;
+      }
+      return true;
+
+    case PARSE_DISCARD:
+      if (discardCount != DISCARD_UNTIL_IDLE && --discardCount == 0) {
+        parseState = PARSE_IDLE;
+      }
+      return false;
+  }
+  return false;
+}
+
+/**
+ * Get the frame that parse() completed most recently.
+ */
+const Frame &SerialProtocol::getFrame() const {
+  return frame;
+}
+
+/**
+ * Write a frame to the serial port, in between log lines. This blocks while a log line and the
+ * frame are being written, so should only be invoked while no transmission is pending.
+ */
+void SerialProtocol::send(FrameType type, const void *payload, uint8_t length) {
+  uint8_t header[] = {FRAME_START, type, length};
+  uint16_t frameCrc = Crc::crc16(Crc::CRC16_INIT, header + 1, 2);
+  frameCrc = Crc::crc16(frameCrc, static_cast<const uint8_t *>(payload), length);
+  uint8_t trailer[] = {(uint8_t)frameCrc, (uint8_t)(frameCrc >> 8)};
+
+  Logger::beginRawOutput();
+  Serial.write(header, sizeof(header));
+  Serial.write(static_cast<const uint8_t *>(payload), length);
+  Serial.write(trailer, sizeof(trailer));
+  Logger::endRawOutput();
+}
+
+void SerialProtocol::sendAck(uint8_t type) {
+  send(FRAME_ACK, &type, 1);
+}
+
+void SerialProtocol::sendNak(uint8_t type, FrameError error) {
+  uint8_t payload[] = {type, error};
+  send(FRAME_NAK, payload, sizeof(payload));
+}
+
+/**
+ * Tell if parse() rejected a frame that has not been answered yet.
+ */
+bool SerialProtocol::hasPendingNak() const {
+  return isNakPending;
+}
+
+/**
+ * Send FRAME_NAK for the frame that parse() rejected, if any. Like send(), this should only be
+ * invoked while no transmission is pending.
+ */
+void SerialProtocol::sendPendingNak() {
+  if (isNakPending) {
+    isNakPending = false;
+    send(FRAME_NAK, nak, sizeof(nak));
+    // The bytes of a rejected frame that still need to be skipped have waited in the UART's buffer
+    lastByteMillis = millis();
+  }
+}
@@ -0,0 +1,160 @@
+/**
+ * Test plans, each being an ordered list of steps that set the data rate, channel, payload size and
+ * confirmed flag for a number of uplinks. Different sites need different plans, so rather than
+ * being compiled into the firmware, the plans are compiled on the host into a compact binary table
+ * and written to a flash partition of their own; see tools/compile_test_plans.py and
+ * partitions.csv. Writing another table only takes a few seconds, and keeps the uplink records.
+ *
+ * The partition is memory-mapped at boot, so the table is used in place, without parsing or
+ * copying it into RAM. Its header and checksum are validated once; if the partition is erased or
+ * the table is invalid, the tester cycles through its built-in data rates.
+ */
+#include <cstring>
+#include "testplans.h"
+#include "crc.h"
+#include "lmic.h"
+#include "logger.h"
+
+// Global singleton instance
+TestPlans testPlans;
+
+static const char PLANS_MAGIC[] = "DRP1";
+
+// Not defined by ESP-IDF; see partitions.csv
+static const esp_partition_subtype_t PLANS_PARTITION_SUBTYPE = (esp_partition_subtype_t)0x40;
+
+/**
+ * Validate the table, including the values the tester depends on, which the host has validated too.
+ * A step's channel must have been set up for its data rate, so this must be invoked after
+ * setupLMIC.
+ */
+bool TestPlans::isValid(const uint8_t *table, uint32_t size) const {
+  auto *tableHeader = reinterpret_cast<const PlanTableHeader *>(table);
+  if (size < sizeof(PlanTableHeader) || memcmp(tableHeader->magic, PLANS_MAGIC, 4) != 0) {
+    return false;
+  }
+  uint32_t length = tableHeader->planCount * sizeof(TestPlan) +
+                    tableHeader->stepCount * sizeof(PlanStep);
+  if (!tableHeader->planCount || length > size - sizeof(PlanTableHeader) ||
+      Crc::crc32(0, table + sizeof(PlanTableHeader), length) != tableHeader->crc) {
+    Logger::log("ERROR: test plans partition holds an invalid table");
+    return false;
+  }
+
+  auto *tablePlans = reinterpret_cast<const TestPlan *>(table + sizeof(PlanTableHeader));
+  auto *tableSteps = reinterpret_cast<const PlanStep *>(tablePlans + tableHeader->planCount);
+  for (uint16_t i = 0; i < tableHeader->planCount; i++) {
+    const TestPlan &plan = tablePlans[i];
+    if (!plan.stepCount || plan.firstStep + plan.stepCount > tableHeader->stepCount ||
+        !memchr(plan.name, 0, sizeof(plan.name))) {
+      Logger::logf("ERROR: invalid test plan %u", i);
+      return false;
+    }
+  }
+  for (uint16_t i = 0; i < tableHeader->stepCount; i++) {
+    const PlanStep &step = tableSteps[i];
+    // Assume EU868, DR_SF12 thru DR_SF7; like the FSK channel, a channel may not support those
+    bool isChannel = step.channel == PLAN_ANY_CHANNEL ||
+                     (step.channel < MAX_CHANNELS && (LMIC.channelMap >> step.channel & 1) &&
+                      (LMIC.channelDrMap[step.channel] >> step.dataRate & 1));
+    if (step.dataRate > DR_SF7 || !isChannel || !step.payloadSize ||
+        step.payloadSize > MAX_LEN_PAYLOAD || !step.repeat) {
+      Logger::logf("ERROR: invalid test plan step %u", i);
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Map the test plans partition, returning false if it does not hold any valid plans.
+ */
+bool TestPlans::begin() {
+  const esp_partition_t *partition =
+      esp_partition_find_first(ESP_PARTITION_TYPE_DATA, PLANS_PARTITION_SUBTYPE, "plans");
+  if (!partition) {
+    return false;
+  }
+  const void *table;
+  if (esp_partition_mmap(partition, 0, partition->size, SPI_FLASH_MMAP_DATA, &table, &handle) !=
+      ESP_OK) {
+    Logger::log("ERROR: could not map the test plans partition");
+    return false;
+  }
+  if (!isValid(static_cast<const uint8_t *>(table), partition->size)) {
+    spi_flash_munmap(handle);
+    return false;
+  }
+
+  header = static_cast<const PlanTableHeader *>(table);
+  plans = reinterpret_cast<const TestPlan *>(header + 1);
+  steps = reinterpret_cast<const PlanStep *>(plans + header->planCount);
+  Logger::logf("Test plans: %u plans; %u steps", header->planCount, header->stepCount);
+  return true;
+}
+
+uint16_t TestPlans::getPlanCount() const {
+  return header ? header->planCount : 0;
+}
+
+/**
+ * Get the selected plan, or nullptr when using the built-in data rates.
+ */
+const TestPlan *TestPlans::getSelected() const {
+  return selected < getPlanCount() ? &plans[selected] : nullptr;
+}
+
+uint16_t TestPlans::getSelectedIndex() const {
+  return selected;
+}
+
+/**
+ * Select the plan with the given index, starting at its first step, or use the built-in data rates
+ * if the index is NO_TEST_PLAN or out of range.
+ */
+void TestPlans::select(uint16_t index) {
+  selected = index < getPlanCount() ? index : NO_TEST_PLAN;
+  restart();
+  if (getSelected()) {
+    Logger::logf("Test plan %u: %s; %u steps", selected, plans[selected].name,
+                 plans[selected].stepCount);
+  } else {
+    Logger::log("Test plan: none; using built-in data rates");
+  }
+}
+
+/**
+ * Make the next step be the first step of the selected plan.
+ */
+void TestPlans::restart() {
+  stepIdx = 0;
+  repeated = 0;
+}
+
+/**
+ * Get the settings for the next uplink, moving to the next step once the current one has been
+ * repeated as often as it says, and starting over after the last step. Only to be invoked if a
+ * plan is selected.
+ */
+const PlanStep &TestPlans::nextStep() {
+  const TestPlan &plan = plans[selected];
+  if (repeated >= steps[plan.firstStep + stepIdx].repeat) {
+    stepIdx = (stepIdx + 1) % plan.stepCount;
+    repeated = 0;
+  }
+  repeated++;
+  return steps[plan.firstStep + stepIdx];
+}
+
+/**
+ * Move to the next step regardless of its repeat count, like when selecting it manually. Only to be
+ * invoked if a plan is selected.
+ */
+const PlanStep &TestPlans::skipStep() {
+  const TestPlan &plan = plans[selected];
+  if (repeated) {
+    stepIdx = (stepIdx + 1) % plan.stepCount;
+  }
+  repeated = 1;
+  return steps[plan.firstStep + stepIdx];
+}
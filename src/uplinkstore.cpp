@@ -0,0 +1,242 @@
+/**
+ * Persists a fixed-size record for each uplink in a ring buffer in a raw flash partition, to allow
+ * for analysing long test runs without scraping the log.
+ *
+ * This uses the data partition that the default ESP32 partition table reserves for SPIFFS, which is
+ * otherwise not used by this tester. Writing flash stalls both cores, and erasing a sector takes
+ * about 45 ms. So, records are written in batches, only erasing a sector when the ring gets there,
+ * which also spreads the wear evenly over the whole partition. A power loss may lose the records of
+ * the last, incomplete batch.
+ *
+ * After a reboot, the sector with the highest record ID tells where to continue writing.
+ */
+#include <cstddef>
+#include "uplinkstore.h"
+#include "crc.h"
+#include "logger.h"
+
+// Global singleton instance
+UplinkStore uplinkStore;
+
+static const uint32_t ERASED = 0xFFFFFFFF;
+
+// Start of the export, of each chunk of records, and of the trailer; see continueExport
+static const char EXPORT_MAGIC[] = "UPL2";
+static const char EXPORT_CHUNK_MAGIC[] = "UPLR";
+static const char EXPORT_END_MAGIC[] = "UPLE";
+
+static uint16_t recordCrc(const UplinkRecord &record) {
+  return Crc::crc16(Crc::CRC16_INIT, reinterpret_cast<const uint8_t *>(&record),
+                    offsetof(UplinkRecord, crc));
+}
+
+/**
+ * Read the record in the given slot, returning whether it holds a valid record.
+ */
+bool UplinkStore::readSlot(uint32_t slot, UplinkRecord &record) const {
+  return esp_partition_read(partition, slot * sizeof(UplinkRecord), &record, sizeof(record)) ==
+             ESP_OK &&
+         record.recordId != ERASED && record.crc == recordCrc(record);
+}
+
+/**
+ * Find where writing stopped before the last reboot.
+ */
+void UplinkStore::findNextSlot() {
+  uint32_t sectors = capacity / RECORDS_PER_SECTOR;
+  uint32_t usedSectors = 0;
+  uint32_t lastSector = 0;
+  UplinkRecord record;
+  UplinkRecord last;
+  last.recordId = ERASED;
+
+  for (uint32_t sector = 0; sector < sectors; sector++) {
+    if (readSlot(sector * RECORDS_PER_SECTOR, record)) {
+      usedSectors++;
+      if (last.recordId == ERASED || record.recordId > last.recordId) {
+        last = record;
+        lastSector = sector;
+      }
+    }
+  }
+
+  if (last.recordId == ERASED) {
+    return;
+  }
+
+  // Find the last valid record in the sector that was written last
+  uint16_t index = 1;
+  while (index < RECORDS_PER_SECTOR && readSlot(lastSector * RECORDS_PER_SECTOR + index, record)) {
+    last = record;
+    index++;
+  }
+  nextSlot = lastSector * RECORDS_PER_SECTOR + index;
+  recordCount = (usedSectors - 1) * RECORDS_PER_SECTOR + index;
+  nextRecordId = last.recordId + 1;
+  bootCount = last.bootCount + 1;
+
+  // If power was lost while writing, the slot may not be erased; then continue in the next sector
+  if (index < RECORDS_PER_SECTOR) {
+    esp_partition_read(partition, nextSlot * sizeof(UplinkRecord), &record, sizeof(record));
+    const auto *bytes = reinterpret_cast<const uint8_t *>(&record);
+    for (size_t i = 0; i < sizeof(record); i++) {
+      if (bytes[i] != 0xFF) {
+        nextSlot = (lastSector + 1) * RECORDS_PER_SECTOR;
+        break;
+      }
+    }
+  }
+  nextSlot %= capacity;
+}
+
+/**
+ * Find the flash partition and where to continue writing, returning false if there is no partition.
+ */
+bool UplinkStore::begin() {
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS,
+                                       nullptr);
+  if (!partition) {
+    return false;
+  }
+  capacity = partition->size / SPI_FLASH_SEC_SIZE * RECORDS_PER_SECTOR;
+  findNextSlot();
+  Logger::logf("Uplink store: %u of %u records used; boot count=%u", recordCount, capacity,
+               bootCount);
+  return true;
+}
+
+/**
+ * Add a record, setting its ID, boot count and CRC, and write the batch to flash when full. Only to
+ * be invoked when no transmission or reception is pending, as writing flash stalls both cores.
+ */
+void UplinkStore::append(UplinkRecord &record) {
+  if (!partition) {
+    return;
+  }
+  record.recordId = nextRecordId++;
+  record.bootCount = bootCount;
+  record.crc = recordCrc(record);
+  batch[batchCount++] = record;
+  if (batchCount == BATCH_SIZE) {
+    flush();
+  }
+}
+
+/**
+ * Write the pending records to flash, erasing the next sector whenever the ring gets there.
+ */
+void UplinkStore::flush() {
+  uint8_t written = 0;
+  while (written < batchCount) {
+    uint16_t index = nextSlot % RECORDS_PER_SECTOR;
+    if (index == 0) {
+      UplinkRecord first;
+      if (readSlot(nextSlot, first)) {
+        recordCount -= RECORDS_PER_SECTOR;
+      }
+      esp_partition_erase_range(partition, nextSlot * sizeof(UplinkRecord), SPI_FLASH_SEC_SIZE);
+    }
+    uint8_t count = min(batchCount - written, RECORDS_PER_SECTOR - index);
+    esp_partition_write(partition, nextSlot * sizeof(UplinkRecord), batch + written,
+                        count * sizeof(UplinkRecord));
+    written += count;
+    recordCount += count;
+    nextSlot = (nextSlot + count) % capacity;
+  }
+  batchCount = 0;
+}
+
+/**
+ * Get the number of records, including those not written to flash yet.
+ */
+uint32_t UplinkStore::getCount() const {
+  return recordCount + batchCount;
+}
+
+/**
+ * Start exporting all records to the serial port, oldest first, in chunks that `continueExport`
+ * writes; see there for the format. Records that are appended meanwhile are not exported.
+ */
+void UplinkStore::startExport() {
+  if (!partition || isExporting) {
+    return;
+  }
+  flush();
+  isExporting = true;
+  exportStart = nextSlot;
+  exportOffset = 0;
+  exportCount = 0;
+  exportCrc = 0;
+
+  uint8_t header[6];
+  memcpy(header, EXPORT_MAGIC, 4);
+  header[4] = sizeof(UplinkRecord);
+  header[5] = 0;
+  Logger::beginRawOutput();
+  Serial.write(header, sizeof(header));
+  Logger::endRawOutput();
+}
+
+/**
+ * Write the next chunk of the export, returning false when there is nothing left to write. Each
+ * chunk blocks for up to about 25 ms, and log lines may be written in between chunks, so should be
+ * invoked from the loop while no transmission is pending.
+ *
+ * The export starts with "UPL2" and the record size as a 16 bits value. Next, each chunk is "UPLR",
+ * the number of records as an 8 bits value, and the records. Finally, "UPLE" is followed by the
+ * number of records and the CRC-32 of all records, as 32 bits values. All values are little-endian.
+ */
+bool UplinkStore::continueExport() {
+  if (!isExporting) {
+    return false;
+  }
+
+  // Read a few records at once, skipping erased chunks. The oldest record is in the first valid
+  // slot after the newest, so the chunk that holds the start slot is visited twice: first for the
+  // oldest records, if the ring has wrapped, and finally for the newest records. Flushing while
+  // exporting only writes to the slots after the start slot, which the export has already visited.
+  uint32_t start = exportStart - exportStart % EXPORT_CHUNK;
+  uint8_t chunk[5 + sizeof(UplinkRecord) * EXPORT_CHUNK];
+  uint8_t count = 0;
+  for (uint8_t scanned = 0; scanned < EXPORT_SCAN && !count && exportOffset <= capacity;
+       scanned++) {
+    UplinkRecord records[EXPORT_CHUNK];
+    uint32_t base = (start + exportOffset) % capacity;
+    esp_partition_read(partition, base * sizeof(UplinkRecord), records, sizeof(records));
+    for (uint8_t j = 0; j < EXPORT_CHUNK; j++) {
+      const UplinkRecord &record = records[j];
+      bool isSkipped = (exportOffset == 0 && base + j < exportStart) ||
+                       (exportOffset == capacity && base + j >= exportStart);
+      if (isSkipped || record.recordId == ERASED || record.crc != recordCrc(record)) {
+        continue;
+      }
+      memcpy(chunk + 5 + sizeof(record) * count++, &record, sizeof(record));
+    }
+    exportOffset += EXPORT_CHUNK;
+  }
+
+  Logger::beginRawOutput();
+  if (count) {
+    memcpy(chunk, EXPORT_CHUNK_MAGIC, 4);
+    chunk[4] = count;
+    Serial.write(chunk, 5 + sizeof(UplinkRecord) * count);
+    exportCrc = Crc::crc32(exportCrc, chunk + 5, sizeof(UplinkRecord) * count);
+    exportCount += count;
+  }
+  if (exportOffset > capacity) {
+    uint8_t trailer[12];
+    memcpy(trailer, EXPORT_END_MAGIC, 4);
+    for (uint8_t i = 0; i < 4; i++) {
+      trailer[4 + i] = exportCount >> (8 * i);
+      trailer[8 + i] = exportCrc >> (8 * i);
+    }
+    Serial.write(trailer, sizeof(trailer));
+    isExporting = false;
+  }
+  Logger::endRawOutput();
+
+  if (!isExporting) {
+    Logger::logf("Exported %u uplink records", exportCount);
+  }
+  return isExporting;
+}
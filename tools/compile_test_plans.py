@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""
+Compile test plans into the binary table the tester reads from its test plans partition, and
+optionally write that to the tester's flash, without rebuilding or uploading the firmware. See
+src/testplans.cpp and include/testplans.h for the table layout, and partitions.csv for where it is
+stored.
+
+The plans are given as a JSON file, holding a list of plans. Each plan has a name of at most 11
+characters and a list of steps, which each set the spreading factor (7 thru 12), the channel (0
+thru 7 as configured in setupLMIC in src/main.cpp, or "any"), the payload size (1 thru 51 for SF10
+thru SF12, 115 for SF9, and 242 for SF7 and SF8), confirmed or unconfirmed uplinks, and the number
+of uplinks to repeat the step for:
+
+  [
+    {"name": "site-a", "steps": [
+      {"sf": 7, "channel": "any", "payload_size": 1, "confirmed": false, "repeat": 10},
+      {"sf": 12, "channel": 0, "payload_size": 11, "confirmed": true, "repeat": 2}
+    ]}
+  ]
+
+All values but "sf" are optional, and default to the values shown for the first step. After the
+last step, a plan starts over. The tester uses the first plan after booting; the serial command P
+selects the next plan. The simulation reads the table from the file given in SIM_PLANS.
+
+Usage:
+  python3 tools/compile_test_plans.py plans.json -o plans.bin
+  python3 tools/compile_test_plans.py plans.json -o plans.bin --flash /dev/ttyUSB0
+  SIM_PLANS=plans.bin .pio/build/native/program
+"""
+import argparse
+import binascii
+import csv
+import json
+import os
+import struct
+import subprocess
+import sys
+
+MAGIC = b'DRP1'
+HEADER = struct.Struct('<4sHHI')
+PLAN = struct.Struct('<12sHH')
+STEP = struct.Struct('<BBBBHH')
+
+ANY_CHANNEL = 0xFF
+STEP_CONFIRMED = 0x01
+
+# Assume EU868, DR_SF12 (DR0) thru DR_SF7 (DR5); LMIC does not allow for enabling SF7BW250 on the
+# default channels
+DATA_RATES = {12: 0, 11: 1, 10: 2, 9: 3, 8: 4, 7: 5}
+# Like setupLMIC, and TestPlans::isValid, which also rejects the FSK channel 8 as it does not
+# support SF7 thru SF12
+CHANNELS = range(8)
+# Like Airtime::MAX_PAYLOAD_LENGTH in include/airtime.h
+MAX_PAYLOAD_LENGTH = {12: 51, 11: 51, 10: 51, 9: 115, 8: 242, 7: 242}
+MAX_NAME = PLAN.size - 4 - 1
+
+
+def compile_step(plan_name, index, step):
+    where = 'plan %s, step %d' % (plan_name, index)
+    if step['sf'] not in DATA_RATES:
+        raise ValueError('%s: invalid sf %s' % (where, step['sf']))
+    channel = step.get('channel', 'any')
+    if channel == 'any':
+        channel = ANY_CHANNEL
+    elif channel not in CHANNELS:
+        raise ValueError('%s: invalid channel %s' % (where, channel))
+    size = step.get('payload_size', 1)
+    if not 1 <= size <= MAX_PAYLOAD_LENGTH[step['sf']]:
+        raise ValueError('%s: invalid payload_size %s' % (where, size))
+    repeat = step.get('repeat', 10)
+    if not 1 <= repeat <= 0xFFFF:
+        raise ValueError('%s: invalid repeat %s' % (where, repeat))
+    flags = STEP_CONFIRMED if step.get('confirmed', False) else 0
+    return STEP.pack(DATA_RATES[step['sf']], channel, size, flags, repeat, 0)
+
+
+def compile_plans(plans, capacity):
+    table_plans = b''
+    table_steps = b''
+    step_count = 0
+    for plan in plans:
+        name = plan['name'].encode('ascii')
+        if len(name) > MAX_NAME:
+            raise ValueError('plan %s: name is longer than %d characters'
+                             % (plan['name'], MAX_NAME))
+        if not plan['steps']:
+            raise ValueError('plan %s: no steps' % plan['name'])
+        table_plans += PLAN.pack(name, step_count, len(plan['steps']))
+        for index, step in enumerate(plan['steps']):
+            table_steps += compile_step(plan['name'], index, step)
+        step_count += len(plan['steps'])
+    if not plans or step_count > 0xFFFF:
+        raise ValueError('expected 1 or more plans, with at most 65535 steps in total')
+    body = table_plans + table_steps
+    table = HEADER.pack(MAGIC, len(plans), step_count, binascii.crc32(body)) + body
+    if len(table) > capacity:
+        raise ValueError('the table needs %d bytes, but the partition holds %d'
+                         % (len(table), capacity))
+    return table
+
+
+def find_partition(name):
+    """Get the offset and size of the partition with the given name in partitions.csv."""
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'partitions.csv')
+    with open(path) as file:
+        for row in csv.reader(line for line in file if not line.startswith('#')):
+            if row and row[0].strip() == name:
+                return int(row[3], 0), int(row[4], 0)
+    raise ValueError('no partition %s in %s' % (name, path))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compile test plans for the data rate tester')
+    parser.add_argument('plans', help='JSON file with a list of test plans')
+    parser.add_argument('-o', '--output', required=True, help='binary file to write')
+    parser.add_argument('--flash', metavar='PORT', help='serial port of the tester to flash to')
+    args = parser.parse_args()
+
+    offset, size = find_partition('plans')
+    with open(args.plans) as file:
+        plans = json.load(file)
+    try:
+        table = compile_plans(plans, size)
+    except (KeyError, ValueError) as e:
+        sys.exit('Invalid test plans: %s' % e)
+    with open(args.output, 'wb') as file:
+        file.write(table)
+    print('Wrote %d plans in %d bytes to %s' % (len(plans), len(table), args.output),
+          file=sys.stderr)
+
+    if args.flash:
+        # esptool is installed along with PlatformIO's ESP32 platform; writing only the partition
+        # keeps the firmware and the uplink records
+        subprocess.check_call([sys.executable, '-m', 'esptool', '--port', args.flash,
+                               'write_flash', hex(offset), args.output])
+
+
+if __name__ == '__main__':
+    main()
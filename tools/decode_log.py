@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""
+Decode the binary log of a build using `-D LOG_BINARY` back into the text the device writes
+without that flag. Any text in between the binary records is passed through as is.
+
+Format strings are only sent the first time they are used, so start decoding before resetting the
+device, or else lines using formats that were defined earlier cannot be decoded. See
+include/binarylog.h for the record layout.
+
+Usage:
+  python3 tools/decode_log.py < capture.bin
+  python3 tools/decode_log.py --port /dev/ttyUSB0 [--baud 115200]
+  SIM_HOURS=1 .pio/build/native/program | python3 tools/decode_log.py
+"""
+import argparse
+import re
+import struct
+import sys
+
+RECORD_MARKER = 0xB1
+RECORD_FORMAT = ord('F')
+RECORD_LOG = ord('L')
+RECORD_PRINT = ord('P')
+
+# Like parseArgs in src/binarylog.cpp: flags, width, precision, length and conversion
+CONVERSION = re.compile(r'%([-+ #0-9.*]*)([hlzjt]*)([diouxXcsfFeEgGaAp%])')
+
+
+def read_varint(payload, offset, is_signed):
+    """Like RecordWriter::appendUnsigned and appendSigned in src/binarylog.cpp."""
+    value = 0
+    shift = 0
+    while True:
+        byte = payload[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if byte < 0x80:
+            break
+    if is_signed:
+        value = (value >> 1) ^ -(value & 1)
+    return value, offset
+
+
+class Format:
+    def __init__(self, text):
+        self.text = text
+        self.args = []
+        parts = []
+        position = 0
+        for match in CONVERSION.finditer(text):
+            parts.append(text[position:match.start()].replace('%', '%%'))
+            position = match.end()
+            flags, length, conversion = match.groups()
+            if conversion == '%':
+                parts.append('%%')
+                continue
+            # A `*` width or precision takes an int argument
+            self.args.extend('i' * flags.count('*'))
+            if conversion in 'fFeEgGaA':
+                self.args.append('f')
+            elif conversion == 's':
+                self.args.append('s')
+            else:
+                self.args.append('i' if conversion in 'di' else 'u')
+            # Python does not know about length modifiers, pointers, nor hexadecimal floats
+            if conversion == 'p':
+                parts.append('0x%' + flags + 'x')
+            else:
+                parts.append('%' + flags + ('e' if conversion in 'aA' else conversion))
+        parts.append(text[position:].replace('%', '%%'))
+        self.python = ''.join(parts)
+
+    def format(self, payload):
+        values = []
+        offset = 0
+        for arg in self.args:
+            if arg == 's':
+                length = payload[offset]
+                values.append(payload[offset + 1:offset + 1 + length].decode('utf-8', 'replace'))
+                offset += 1 + length
+            elif arg == 'f':
+                values.append(struct.unpack_from('<f', payload, offset)[0])
+                offset += 4
+            else:
+                value, offset = read_varint(payload, offset, arg == 'i')
+                values.append(value)
+        return self.python % tuple(values)
+
+
+class Decoder:
+    def __init__(self, output):
+        self.output = output
+        self.formats = {}
+        self.buffer = bytearray()
+
+    def feed(self, data):
+        self.buffer.extend(data)
+        while self.buffer:
+            start = self.buffer.find(RECORD_MARKER)
+            if start < 0:
+                start = len(self.buffer)
+            if start:
+                self.output.write(self.buffer[:start].decode('utf-8', 'replace'))
+                del self.buffer[:start]
+                continue
+            if len(self.buffer) < 3:
+                break
+            record_type, length = self.buffer[1], self.buffer[2]
+            if record_type not in (RECORD_FORMAT, RECORD_LOG, RECORD_PRINT):
+                # Not a record after all
+                self.output.write(self.buffer[:1].decode('latin-1'))
+                del self.buffer[:1]
+                continue
+            if len(self.buffer) < 3 + length:
+                break
+            payload = bytes(self.buffer[3:3 + length])
+            del self.buffer[:3 + length]
+            self.decode(record_type, payload)
+        self.output.flush()
+
+    def decode(self, record_type, payload):
+        if record_type == RECORD_FORMAT:
+            self.formats[payload[0]] = Format(payload[1:].decode('utf-8', 'replace'))
+            return
+        fmt = self.formats.get(payload[0])
+        if record_type == RECORD_LOG:
+            core = payload[1]
+            ticks, offset = read_varint(payload, 2, True)
+            ms, offset = read_varint(payload, offset, False)
+            prefix = '[%d/%dms/%.1fs][%d] ' % (ticks, ms, ms / 1000.0, core)
+            text = fmt.format(payload[offset:]) if fmt else '<unknown format %d>' % payload[0]
+            self.output.write(prefix + text + '\n')
+        else:
+            text = fmt.format(payload[1:]) if fmt else '<unknown format %d>' % payload[0]
+            self.output.write(text)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode the binary log of the data rate tester')
+    parser.add_argument('--port', help='serial port to read from, rather than standard input')
+    parser.add_argument('--baud', type=int, default=115200)
+    args = parser.parse_args()
+
+    decoder = Decoder(sys.stdout)
+    if args.port:
+        # pyserial is installed along with PlatformIO
+        import serial
+        with serial.Serial(args.port, args.baud) as port:
+            while True:
+                decoder.feed(port.read(max(1, port.in_waiting)))
+    else:
+        while True:
+            data = sys.stdin.buffer.read1(4096)
+            if not data:
+                break
+            decoder.feed(data)
+
+
+if __name__ == '__main__':
+    try:
+        main()
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""
+Download the uplink records that the tester keeps in flash, and write them as CSV. See
+src/uplinkstore.cpp for the export format, and include/uplinkstore.h for the record layout.
+
+Any log output before and in between the chunks of the export is skipped. When not using a
+serial port, this reads a capture that holds the export from standard input.
+
+Usage:
+  python3 tools/export_records.py --port /dev/ttyUSB0 [--baud 115200] > records.csv
+  (sleep 5; printf E) | SIM_HOURS=1 .pio/build/native/program | python3 tools/export_records.py
+"""
+import argparse
+import binascii
+import csv
+import struct
+import sys
+
+EXPORT_MAGIC = b'UPL2'
+CHUNK_MAGIC = b'UPLR'
+END_MAGIC = b'UPLE'
+RECORD = struct.Struct('<IHBBIIIIBBbbBBH')
+FIELDS = ['recordId', 'bootCount', 'sf', 'channel', 'seqnoUp', 'txMillis', 'completeMillis',
+          'freq', 'flags', 'rxLength', 'rssi', 'snr', 'payloadSize', 'linkMargin', 'crc']
+
+RECORD_CONFIRMED = 0x01
+RECORD_ACK = 0x02
+RECORD_RX1 = 0x04
+RECORD_RX2 = 0x08
+RECORD_LINK_CHECK = 0x10
+RECORD_GATEWAYS_SHIFT = 5
+
+
+class Reader:
+    def __init__(self, read):
+        self.read = read
+
+    def exactly(self, count):
+        data = b''
+        while len(data) < count:
+            chunk = self.read(count - len(data))
+            if not chunk:
+                raise EOFError('export incomplete')
+            data += chunk
+        return data
+
+    def skip_to(self, *markers):
+        """Skip to the end of any of the given 4 bytes markers, and return that marker."""
+        window = b''
+        while window not in markers:
+            window = (window + self.exactly(1))[-4:]
+        return window
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Export the uplink records of the data rate tester')
+    parser.add_argument('--port', help='serial port to request the export from')
+    parser.add_argument('--baud', type=int, default=115200)
+    args = parser.parse_args()
+
+    if args.port:
+        # pyserial is installed along with PlatformIO
+        import serial
+        port = serial.Serial(args.port, args.baud, timeout=10)
+        port.write(b'E')
+        reader = Reader(port.read)
+    else:
+        reader = Reader(sys.stdin.buffer.read)
+
+    reader.skip_to(EXPORT_MAGIC)
+    (record_size,) = struct.unpack('<H', reader.exactly(2))
+    if record_size != RECORD.size:
+        sys.exit('Unsupported record size %d' % record_size)
+    data = b''
+    while reader.skip_to(CHUNK_MAGIC, END_MAGIC) == CHUNK_MAGIC:
+        data += reader.exactly(reader.exactly(1)[0] * record_size)
+    count, crc = struct.unpack('<II', reader.exactly(8))
+    if count * record_size != len(data) or binascii.crc32(data) != crc:
+        sys.exit('CRC mismatch')
+
+    writer = csv.writer(sys.stdout)
+    writer.writerow(['recordId', 'bootCount', 'seqnoUp', 'sf', 'channel', 'freq', 'txMillis',
+                     'completeMillis', 'confirmed', 'ack', 'window', 'rxLength', 'rssi', 'snr',
+                     'payloadSize', 'linkCheck', 'margin', 'gateways'])
+    for values in RECORD.iter_unpack(data):
+        r = dict(zip(FIELDS, values))
+        downlink = r['flags'] & (RECORD_RX1 | RECORD_RX2)
+        gateways = r['flags'] >> RECORD_GATEWAYS_SHIFT
+        writer.writerow([
+            r['recordId'], r['bootCount'], r['seqnoUp'], r['sf'], r['channel'], r['freq'],
+            r['txMillis'], r['completeMillis'], int(bool(r['flags'] & RECORD_CONFIRMED)),
+            int(bool(r['flags'] & RECORD_ACK)),
+            'rx1' if r['flags'] & RECORD_RX1 else 'rx2' if downlink else '',
+            r['rxLength'] if downlink else '', r['rssi'] if downlink else '',
+            r['snr'] / 4 if downlink else '', r['payloadSize'] or '',
+            int(bool(r['flags'] & RECORD_LINK_CHECK)), r['linkMargin'] if gateways else '',
+            gateways or ''])
+    print('Exported %d records' % count, file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
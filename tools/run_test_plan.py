@@ -0,0 +1,250 @@
+#!/usr/bin/env python3
+"""
+Run one or more test plans on the tester, unattended, and write the result of each uplink as CSV.
+See src/serialprotocol.cpp for the framed binary protocol, and include/uplinkstore.h for the
+record layout of the results.
+
+A plan sets the data rates to cycle through (as spreading factors), confirmed or unconfirmed
+uplinks, the payload size, the channels and the number of uplinks. Multiple plans can be given as a
+file with one JSON object per line, using the same names as the options below, like:
+
+  {"sf": [7, 8, 9], "confirmed": true, "payload_size": 11, "channels": [0, 1, 2], "uplinks": 30}
+
+Instead, a plan can also run one of the test plans in the tester's flash, as written using
+tools/compile_test_plans.py, by its index, optionally limiting the channels:
+
+  {"flash_plan": 0, "uplinks": 100}
+
+Or a plan can sweep the payload size for each spreading factor, from 4 bytes up to the maximum size
+each spreading factor allows, to tell the goodput; see src/payloadsweep.cpp:
+
+  {"sweep": true, "confirmed": true, "uplinks": 36}
+
+Or a plan can select the data rates adaptively, using confirmed uplinks, spending the airtime on
+the data rates for which the success rate is least certain, and completing once that is known well
+enough for each data rate; see src/adaptivedatarate.cpp:
+
+  {"sf": [7, 9, 12], "adaptive": true, "uplinks": 500}
+
+By default, the tester only adheres to the duty cycle. To stay within The Things Network's Fair
+Access Policy instead, which makes a plan take many hours, add "fair_access": true.
+
+Any plan can send a LinkCheckReq rather than the dummy data, to get the demodulation margin and
+gateway count of each uplink from the network, like "link_check": true; see src/linkcheck.cpp.
+
+Log output in between the frames is skipped. Rather than a serial port, this can also run the
+simulation, like for testing a plan.
+
+Usage:
+  python3 tools/run_test_plan.py --port /dev/ttyUSB0 --sf 7,8 --uplinks 20 > results.csv
+  python3 tools/run_test_plan.py --port /dev/ttyUSB0 --plans plans.jsonl > results.csv
+  python3 tools/run_test_plan.py --native .pio/build/native/program --sf 12 --uplinks 5
+"""
+import argparse
+import binascii
+import csv
+import json
+import os
+import struct
+import subprocess
+import sys
+import time
+
+FRAME_START = 0xA5
+
+FRAME_SET_DATA_RATES = 0x01
+FRAME_SET_CONFIRMED = 0x02
+FRAME_SET_PAYLOAD_SIZE = 0x03
+FRAME_SET_CHANNEL_MASK = 0x04
+FRAME_SET_RUN_LENGTH = 0x05
+FRAME_START_RUN = 0x06
+FRAME_STOP_RUN = 0x07
+FRAME_SELECT_PLAN = 0x08
+FRAME_SET_SWEEP = 0x09
+FRAME_SET_ADAPTIVE = 0x0A
+FRAME_SET_FAIR_ACCESS = 0x0B
+FRAME_SET_LINK_CHECK = 0x0C
+FRAME_ACK = 0x81
+FRAME_NAK = 0x82
+FRAME_RESULT = 0x83
+FRAME_DONE = 0x84
+
+FRAME_ERRORS = {1: 'CRC mismatch', 2: 'invalid length', 3: 'invalid value', 4: 'unknown command'}
+
+# Like setupLMIC and tools/compile_test_plans.py; channel 8 only supports FSK
+CHANNELS = range(8)
+
+RECORD = struct.Struct('<IHBBIIIIBBbbBBH')
+FIELDS = ['recordId', 'bootCount', 'sf', 'channel', 'seqnoUp', 'txMillis', 'completeMillis',
+          'freq', 'flags', 'rxLength', 'rssi', 'snr', 'payloadSize', 'linkMargin', 'crc']
+
+RECORD_CONFIRMED = 0x01
+RECORD_ACK = 0x02
+RECORD_RX1 = 0x04
+RECORD_RX2 = 0x08
+RECORD_LINK_CHECK = 0x10
+RECORD_GATEWAYS_SHIFT = 5
+
+
+def crc16(data):
+    """CRC-16/CCITT-FALSE."""
+    return binascii.crc_hqx(data, 0xFFFF)
+
+
+class Link:
+    """Writes command frames, and reads response frames in between the log output."""
+
+    def __init__(self, read, write):
+        self.read = read
+        self.write = write
+        self.buffer = b''
+
+    def send(self, frame_type, payload=b''):
+        body = bytes([frame_type, len(payload)]) + payload
+        self.write(bytes([FRAME_START]) + body + struct.pack('<H', crc16(body)))
+
+    def receive(self, timeout):
+        deadline = time.monotonic() + timeout
+        while True:
+            start = self.buffer.find(bytes([FRAME_START]))
+            if start < 0:
+                self.buffer = b''
+            else:
+                self.buffer = self.buffer[start:]
+                if len(self.buffer) >= 3 and len(self.buffer) >= 5 + self.buffer[2]:
+                    length = self.buffer[2]
+                    body = self.buffer[1:3 + length]
+                    (crc,) = struct.unpack('<H', self.buffer[3 + length:5 + length])
+                    if crc == crc16(body):
+                        self.buffer = self.buffer[5 + length:]
+                        return body[0], body[2:]
+                    # Not a frame after all; skip the start byte
+                    self.buffer = self.buffer[1:]
+                    continue
+            if time.monotonic() > deadline:
+                raise TimeoutError('no response from the tester')
+            # Empty if nothing arrived yet, or None when the tester is gone
+            chunk = self.read()
+            if chunk is None:
+                raise EOFError('the tester closed the connection')
+            self.buffer += chunk
+
+    def command(self, frame_type, payload=b''):
+        self.send(frame_type, payload)
+        while True:
+            # A command is only applied after the current uplink's receive windows
+            response_type, response = self.receive(timeout=30)
+            if response_type == FRAME_ACK and response[0] == frame_type:
+                return
+            if response_type == FRAME_NAK and response[0] == frame_type:
+                raise ValueError('command 0x%02x rejected: %s'
+                                 % (frame_type, FRAME_ERRORS.get(response[1], response[1])))
+
+
+def run_plan(link, plan, index, writer):
+    channels = plan.get('channels', CHANNELS)
+    if not channels or any(ch not in CHANNELS for ch in channels):
+        raise ValueError('plan %d: invalid channels %s' % (index, channels))
+    # The sweep sets the data rate and payload size of each uplink, and takes precedence over the
+    # adaptive data rate, which takes precedence over the flash plans; see nextDataRate in
+    # src/main.cpp
+    link.command(FRAME_SET_SWEEP, bytes([int(bool(plan.get('sweep', False)))]))
+    link.command(FRAME_SET_ADAPTIVE, bytes([int(bool(plan.get('adaptive', False)))]))
+    link.command(FRAME_SET_LINK_CHECK, bytes([int(bool(plan.get('link_check', False)))]))
+    if 'fair_access' in plan:
+        link.command(FRAME_SET_FAIR_ACCESS, bytes([int(plan['fair_access'])]))
+    if 'flash_plan' in plan:
+        # Its steps set the data rate, channel, payload size and confirmed flag
+        link.command(FRAME_SELECT_PLAN, struct.pack('<H', plan['flash_plan']))
+    elif plan.get('sweep'):
+        link.command(FRAME_SET_CONFIRMED, bytes([int(plan.get('confirmed', False))]))
+    else:
+        sfs = plan.get('sf', [7, 8, 9, 10, 11, 12])
+        link.command(FRAME_SET_DATA_RATES, bytes(12 - sf for sf in sfs))
+        link.command(FRAME_SET_CONFIRMED, bytes([int(plan.get('confirmed', False))]))
+        link.command(FRAME_SET_PAYLOAD_SIZE, bytes([plan.get('payload_size', 1)]))
+    link.command(FRAME_SET_CHANNEL_MASK, struct.pack('<H', sum(1 << ch for ch in channels)))
+    link.command(FRAME_SET_RUN_LENGTH, struct.pack('<I', plan['uplinks']))
+    link.command(FRAME_START_RUN)
+
+    while True:
+        # At SF12 and a 1% duty cycle, the uplinks are about 2 minutes apart
+        frame_type, payload = link.receive(timeout=600)
+        if frame_type == FRAME_DONE:
+            (count,) = struct.unpack('<I', payload)
+            print('Plan %d completed after %d uplinks' % (index, count), file=sys.stderr)
+            return
+        if frame_type != FRAME_RESULT:
+            continue
+        r = dict(zip(FIELDS, RECORD.unpack(payload)))
+        downlink = r['flags'] & (RECORD_RX1 | RECORD_RX2)
+        gateways = r['flags'] >> RECORD_GATEWAYS_SHIFT
+        writer.writerow([
+            index, r['seqnoUp'], r['sf'], r['channel'], r['freq'], r['txMillis'],
+            r['completeMillis'], int(bool(r['flags'] & RECORD_CONFIRMED)),
+            int(bool(r['flags'] & RECORD_ACK)),
+            'rx1' if r['flags'] & RECORD_RX1 else 'rx2' if downlink else '',
+            r['rxLength'] if downlink else '', r['rssi'] if downlink else '',
+            r['snr'] / 4 if downlink else '', r['payloadSize'] or '',
+            int(bool(r['flags'] & RECORD_LINK_CHECK)), r['linkMargin'] if gateways else '',
+            gateways or ''])
+        sys.stdout.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Run test plans on the data rate tester')
+    parser.add_argument('--port', help='serial port of the tester')
+    parser.add_argument('--baud', type=int, default=115200)
+    parser.add_argument('--native', help='simulation program to run instead of using a port')
+    parser.add_argument('--plans', help='file with one JSON test plan per line')
+    parser.add_argument('--sf', default='7,8,9,10,11,12', help='spreading factors to cycle through')
+    parser.add_argument('--confirmed', action='store_true')
+    parser.add_argument('--link-check', action='store_true')
+    parser.add_argument('--payload-size', type=int, default=1)
+    parser.add_argument('--channels', default='0,1,2,3,4,5,6,7')
+    parser.add_argument('--uplinks', type=int, default=12)
+    args = parser.parse_args()
+
+    if args.plans:
+        with open(args.plans) as file:
+            plans = [json.loads(line) for line in file if line.strip()]
+    else:
+        plans = [{'sf': [int(sf) for sf in args.sf.split(',')], 'confirmed': args.confirmed,
+                  'link_check': args.link_check,
+                  'payload_size': args.payload_size,
+                  'channels': [int(ch) for ch in args.channels.split(',')],
+                  'uplinks': args.uplinks}]
+
+    process = None
+    if args.port:
+        # pyserial is installed along with PlatformIO
+        import serial
+        port = serial.Serial(args.port, args.baud, timeout=1)
+        link = Link(lambda: port.read(max(port.in_waiting, 1)), port.write)
+    elif args.native:
+        env = dict(os.environ, SIM_HOURS=os.environ.get('SIM_HOURS', '1000'))
+        process = subprocess.Popen([args.native], stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                                   env=env)
+
+        def write(data):
+            process.stdin.write(data)
+            process.stdin.flush()
+
+        link = Link(lambda: os.read(process.stdout.fileno(), 4096) or None, write)
+    else:
+        parser.error('either --port or --native is required')
+
+    writer = csv.writer(sys.stdout)
+    writer.writerow(['plan', 'seqnoUp', 'sf', 'channel', 'freq', 'txMillis', 'completeMillis',
+                     'confirmed', 'ack', 'window', 'rxLength', 'rssi', 'snr', 'payloadSize',
+                     'linkCheck', 'margin', 'gateways'])
+    try:
+        for index, plan in enumerate(plans):
+            run_plan(link, plan, index, writer)
+    finally:
+        if process:
+            process.kill()
+
+
+if __name__ == '__main__':
+    main()